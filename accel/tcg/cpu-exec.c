@@ -43,8 +43,10 @@
 #include "sysemu/tcg.h"
 #include "exec/helper-proto.h"
 #include "tb-hash.h"
+#include "tb-jmp-cache.h"
 #include "tb-context.h"
 #include "internal.h"
+#include "tb-stats.h"
 
 /* -icount align implementation. */
 
@@ -175,28 +177,34 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
     TranslationBlock *tb;
     uint32_t hash;
+    int way;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-
-    if (likely(tb &&
-               tb->pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               tb_cflags(tb) == cflags)) {
-        return tb;
+    hash = tb_jmp_cache_hash_func(jc, pc);
+    for (way = 0; way < TB_JMP_CACHE_WAYS; way++) {
+        tb = tb_jmp_cache_get(jc, hash, way);
+        if (likely(tb &&
+                   tb->pc == pc &&
+                   tb->cs_base == cs_base &&
+                   tb->flags == flags &&
+                   tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+                   tb_cflags(tb) == cflags)) {
+            tb_jmp_cache_hit(jc, hash, way, tb);
+            return tb;
+        }
     }
+    tb_jmp_cache_miss(jc);
+
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(jc, hash, tb);
     return tb;
 }
 
@@ -953,6 +961,7 @@ int cpu_exec(CPUState *cpu)
 
         while (!cpu_handle_interrupt(cpu, &last_tb)) {
             TranslationBlock *tb;
+            CPUJumpCache *jc;
             target_ulong cs_base, pc;
             uint32_t flags, cflags;
 
@@ -985,7 +994,8 @@ int cpu_exec(CPUState *cpu)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+                jc = cpu->tb_jmp_cache;
+                tb_jmp_cache_insert(jc, tb_jmp_cache_hash_func(jc, pc), tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1028,6 +1038,7 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
     tlb_init(cpu);
+    tb_jmp_cache_init(cpu);
     qemu_plugin_vcpu_init_hook(cpu);
 
 #ifndef CONFIG_USER_ONLY
@@ -1040,9 +1051,12 @@ void tcg_exec_unrealizefn(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
+#else
+    translate_ahead_cpu_exit(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
     qemu_plugin_vcpu_exit_hook(cpu);
+    tb_jmp_cache_free(cpu);
     tlb_destroy(cpu);
 }
 
@@ -1082,6 +1096,32 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+HumanReadableText *qmp_x_query_tb_stats(bool has_count, int64_t count,
+                                         Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB statistics are only available with accel=tcg");
+        return NULL;
+    }
+    if (!tb_stats_enabled) {
+        error_setg(errp, "TB statistics are not enabled");
+        error_append_hint(errp, "Use -accel tcg,tb-stats=on\n");
+        return NULL;
+    }
+    if (!has_count) {
+        count = 10;
+    } else if (count <= 0 || count > INT_MAX) {
+        error_setg(errp, "Parameter 'count' expects a positive integer");
+        return NULL;
+    }
+
+    tb_stats_dump(buf, first_cpu, count);
+
+    return human_readable_text_from_str(buf);
+}
+
 HumanReadableText *qmp_x_query_opcount(Error **errp)
 {
     g_autoptr(GString) buf = g_string_new("");
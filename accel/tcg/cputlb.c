@@ -35,6 +35,7 @@
 #include "exec/translate-all.h"
 #include "trace/trace-root.h"
 #include "tb-hash.h"
+#include "tb-jmp-cache.h"
 #include "internal.h"
 #ifdef CONFIG_PLUGIN
 #include "qemu/plugin-memory.h"
@@ -91,28 +92,39 @@ static inline size_t sizeof_tlb(CPUTLBDescFast *fast)
     return fast->mask + (1 << CPU_TLB_ENTRY_BITS);
 }
 
-static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
-                             size_t max_entries)
+/*
+ * The victim tlb set for @page.  Since the main tlb never has fewer
+ * entries than there are sets, this is also a function of the main tlb
+ * index, so an entry evicted from the main tlb can be found again by
+ * any lookup that misses at the same index.
+ */
+QEMU_BUILD_BUG_ON(CPU_VTLB_SETS > (1 << CPU_TLB_DYN_MIN_BITS));
+
+static inline size_t vtlb_set(target_ulong page)
 {
-    desc->window_begin_ns = ns;
-    desc->window_max_entries = max_entries;
+    return (page >> TARGET_PAGE_BITS) & (CPU_VTLB_SETS - 1);
 }
 
-static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
-{
-    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
+#define VTLB_OVERFLOW_BASE (CPU_VTLB_WAYS * CPU_VTLB_SETS)
+#define VTLB_CANDIDATES (CPU_VTLB_WAYS + CPU_VTLB_OVERFLOW)
 
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+/*
+ * The index of the @k-th victim tlb entry that may hold @page: first the
+ * ways of its set, then the overflow area, which holds any page.
+ */
+static inline size_t vtlb_candidate(target_ulong page, int k)
+{
+    if (k < CPU_VTLB_WAYS) {
+        return vtlb_set(page) * CPU_VTLB_WAYS + k;
     }
+    return VTLB_OVERFLOW_BASE + k - CPU_VTLB_WAYS;
 }
 
-static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
+static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
+                             size_t max_entries)
 {
-    /* Discard jump cache entries for any tb which might potentially
-       overlap the flushed page.  */
-    tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
-    tb_jmp_cache_clear_page(cpu, addr);
+    desc->window_begin_ns = ns;
+    desc->window_max_entries = max_entries;
 }
 
 /**
@@ -233,9 +245,9 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
-    desc->large_page_addr = -1;
-    desc->large_page_mask = -1;
-    desc->vindex = 0;
+    memset(desc->large_page, -1, sizeof(desc->large_page));
+    memset(desc->vindex, 0, sizeof(desc->vindex));
+    desc->voindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
 }
@@ -339,6 +351,25 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+void tlb_miss_counts(size_t *pmiss, size_t *pvictim_hit,
+                     size_t *pvictim_overflow_hit)
+{
+    CPUState *cpu;
+    size_t miss = 0, victim_hit = 0, victim_overflow_hit = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        miss += qatomic_read(&env_tlb(env)->c.miss_count);
+        victim_hit += qatomic_read(&env_tlb(env)->c.victim_hit_count);
+        victim_overflow_hit +=
+            qatomic_read(&env_tlb(env)->c.victim_overflow_hit_count);
+    }
+    *pmiss = miss;
+    *pvictim_hit = victim_hit;
+    *pvictim_overflow_hit = victim_overflow_hit;
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -487,30 +518,89 @@ static void tlb_flush_vtlb_page_mask_locked(CPUArchState *env, int mmu_idx,
     }
 }
 
-static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
-                                              target_ulong page)
+/* Called with tlb_c.lock held */
+static void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
+                                       target_ulong page)
 {
-    tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+    int k;
+
+    assert_cpu_is_self(env_cpu(env));
+    for (k = 0; k < VTLB_CANDIDATES; k++) {
+        if (tlb_flush_entry_locked(&d->vtable[vtlb_candidate(page, k)],
+                                   page)) {
+            tlb_n_used_entries_dec(env, mmu_idx);
+        }
+    }
 }
 
-static void tlb_flush_page_locked(CPUArchState *env, int midx,
-                                  target_ulong page)
+/* Called with tlb_c.lock held */
+static void tlb_flush_large_page_locked(CPUArchState *env, int midx,
+                                        CPUTLBLargePage *lp)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    target_ulong lp_addr = lp->addr;
+    target_ulong lp_mask = lp->mask;
+    target_ulong i, n;
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
+    tlb_debug("flushing large page region midx %d ("
+              TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+              midx, lp_addr, lp_mask);
+
+    /*
+     * Each page of the region maps to exactly one entry of the direct
+     * mapped table, so there is no need to look at more pages than the
+     * table has entries: past that point every entry has been visited.
+     */
+    n = MIN(~lp_mask >> TARGET_PAGE_BITS, tlb_n_entries(f) - 1);
+    for (i = 0; i <= n; i++) {
+        target_ulong page = lp_addr + (i << TARGET_PAGE_BITS);
+
+        if (tlb_flush_entry_mask_locked(tlb_entry(env, midx, page),
+                                        lp_addr, lp_mask)) {
             tlb_n_used_entries_dec(env, midx);
         }
-        tlb_flush_vtlb_page_locked(env, midx, page);
     }
+    tlb_flush_vtlb_page_mask_locked(env, midx, lp_addr, lp_mask);
+
+    lp->addr = -1;
+    lp->mask = -1;
+}
+
+/*
+ * Flush the entries of all large page regions that overlap
+ * [addr, addr + len - 1].
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_pages_locked(CPUArchState *env, int midx,
+                                         target_ulong addr, target_ulong len)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    target_ulong last = addr + len - 1;
+    int i;
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+
+        if (lp->addr == (target_ulong)-1) {
+            continue;
+        }
+        if (addr <= (lp->addr | ~lp->mask) && last >= lp->addr) {
+            tlb_flush_large_page_locked(env, midx, lp);
+        }
+    }
+}
+
+static void tlb_flush_page_locked(CPUArchState *env, int midx,
+                                  target_ulong page)
+{
+    /* Check if we need to flush due to large pages.  */
+    tlb_flush_large_pages_locked(env, midx, page, TARGET_PAGE_SIZE);
+
+    if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
+        tlb_n_used_entries_dec(env, midx);
+    }
+    tlb_flush_vtlb_page_locked(env, midx, page);
 }
 
 /**
@@ -541,7 +631,7 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-    tb_flush_jmp_cache(cpu, addr);
+    tb_jmp_cache_clear_range(cpu, addr, TARGET_PAGE_SIZE);
 }
 
 /**
@@ -711,7 +801,6 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
                                    target_ulong addr, target_ulong len,
                                    unsigned bits)
 {
-    CPUTLBDesc *d = &env_tlb(env)->d[midx];
     CPUTLBDescFast *f = &env_tlb(env)->f[midx];
     target_ulong mask = MAKE_64BIT_MASK(0, bits);
 
@@ -733,18 +822,8 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
         return;
     }
 
-    /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
-     */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-        return;
-    }
+    /* Check if we need to flush due to large pages.  */
+    tlb_flush_large_pages_locked(env, midx, addr, len);
 
     for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
         target_ulong page = addr + i;
@@ -783,18 +862,7 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-    /*
-     * If the length is larger than the jump cache size, then it will take
-     * longer to clear each entry individually than it will to clear it all.
-     */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
-        cpu_tb_jmp_cache_clear(cpu);
-        return;
-    }
-
-    for (target_ulong i = 0; i < d.len; i += TARGET_PAGE_SIZE) {
-        tb_flush_jmp_cache(cpu, d.addr + i);
-    }
+    tb_jmp_cache_clear_range(cpu, d.addr, d.len);
 }
 
 static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
@@ -1063,36 +1131,63 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
         int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_set_dirty1_locked(&env_tlb(env)->d[mmu_idx].vtable[k], vaddr);
+
+        for (k = 0; k < VTLB_CANDIDATES; k++) {
+            tlb_set_dirty1_locked(&d->vtable[vtlb_candidate(vaddr, k)],
+                                  vaddr);
         }
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB does not support large pages, so remember the areas covered by
+   large pages and flush every entry of an area if it is invalidated.  */
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
                                target_ulong vaddr, target_ulong size)
 {
-    target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+    CPUTLBLargePage *free_lp = NULL, *best_lp = NULL;
     target_ulong lp_mask = ~(size - 1);
+    target_ulong best_mask = 0;
+    int i;
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+        target_ulong mask;
 
-    if (lp_addr == (target_ulong)-1) {
-        /* No previous large page.  */
-        lp_addr = vaddr;
+        if (lp->addr == (target_ulong)-1) {
+            if (!free_lp) {
+                free_lp = lp;
+            }
+            continue;
+        }
+
+        mask = lp_mask & lp->mask;
+        while (((lp->addr ^ vaddr) & mask) != 0) {
+            mask <<= 1;
+        }
+        if (mask == lp->mask) {
+            /* Already covered by this region.  */
+            return;
+        }
+        if (!best_lp || mask > best_mask) {
+            best_lp = lp;
+            best_mask = mask;
+        }
+    }
+
+    if (free_lp) {
+        free_lp->addr = vaddr & lp_mask;
+        free_lp->mask = lp_mask;
     } else {
-        /* Extend the existing region to include the new page.
+        /* Extend the region that grows the least to include the new page.
            This is a compromise between unnecessary flushes and
            the cost of maintaining a full variable size TLB.  */
-        lp_mask &= env_tlb(env)->d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ vaddr) & lp_mask) != 0) {
-            lp_mask <<= 1;
-        }
+        best_lp->addr &= best_mask;
+        best_lp->mask = best_mask;
     }
-    env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
 }
 
 /* Add a new TLB entry. At most one entry for a given virtual address
@@ -1214,9 +1309,23 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, vaddr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+        size_t set = vtlb_set(vaddr_page);
+        size_t vidx = set * CPU_VTLB_WAYS
+                      + desc->vindex[set]++ % CPU_VTLB_WAYS;
         CPUTLBEntry *tv = &desc->vtable[vidx];
 
+        /*
+         * A full set passes its oldest entry on to the overflow area, so
+         * that more pages than there are ways can conflict in a set.
+         */
+        if (!tlb_entry_is_empty(tv)) {
+            size_t oidx = VTLB_OVERFLOW_BASE
+                          + desc->voindex++ % CPU_VTLB_OVERFLOW;
+
+            copy_tlb_helper_locked(&desc->vtable[oidx], tv);
+            desc->viotlb[oidx] = desc->viotlb[vidx];
+        }
+
         /* Evict the old entry into the victim tlb.  */
         copy_tlb_helper_locked(tv, te);
         desc->viotlb[vidx] = desc->iotlb[index];
@@ -1456,10 +1565,14 @@ static inline target_ulong tlb_read_ofs(CPUTLBEntry *entry, size_t ofs)
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
-    size_t vidx;
+    CPUTLBCommon *c = &env_tlb(env)->c;
+    int k;
 
     assert_cpu_is_self(env_cpu(env));
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
+    qatomic_set(&c->miss_count, c->miss_count + 1);
+
+    for (k = 0; k < VTLB_CANDIDATES; ++k) {
+        size_t vidx = vtlb_candidate(page, k);
         CPUTLBEntry *vtlb = &env_tlb(env)->d[mmu_idx].vtable[vidx];
         target_ulong cmp;
 
@@ -1483,6 +1596,12 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
             CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
             tmpio = *io; *io = *vio; *vio = tmpio;
+
+            qatomic_set(&c->victim_hit_count, c->victim_hit_count + 1);
+            if (k >= CPU_VTLB_WAYS) {
+                qatomic_set(&c->victim_overflow_hit_count,
+                            c->victim_overflow_hit_count + 1);
+            }
             return true;
         }
     }
@@ -1556,7 +1675,8 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
 
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
-    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
+    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE) &&
+        tb_invalidate_phys_page_needed(ram_addr, size)) {
         struct page_collection *pages
             = page_collection_lock(ram_addr, ram_addr + size);
         tb_invalidate_phys_page_fast(pages, ram_addr, size, retaddr);
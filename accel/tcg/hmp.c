@@ -2,13 +2,30 @@
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-machine.h"
+#include "qapi/qmp/qdict.h"
 #include "exec/exec-all.h"
 #include "monitor/monitor.h"
 
+static void hmp_info_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+    g_autoptr(HumanReadableText) info = NULL;
+    bool has_count = qdict_haskey(qdict, "count");
+    int64_t count = qdict_get_try_int(qdict, "count", 0);
+
+    info = qmp_x_query_tb_stats(has_count, count, &err);
+    if (err) {
+        error_report_err(err);
+        return;
+    }
+    monitor_printf(mon, "%s", info->human_readable_text);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp("tb-stats", true, hmp_info_tb_stats);
 }
 
 type_init(hmp_tcg_register);
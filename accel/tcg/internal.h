@@ -14,6 +14,14 @@
 TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
                               target_ulong cs_base, uint32_t flags,
                               int cflags);
+#ifdef CONFIG_USER_ONLY
+TranslationBlock *tb_gen_code_ahead(CPUState *cpu, target_ulong pc,
+                                    target_ulong cs_base, uint32_t flags,
+                                    int cflags);
+bool page_has_tbs(target_ulong addr);
+void translate_ahead_queue(CPUState *cpu, TranslationBlock *tb);
+void translate_ahead_cpu_exit(CPUState *cpu);
+#endif
 G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
@@ -41,6 +41,12 @@
  * optimization to avoid generating redundant operations. For instance, for the
  * second and all subsequent callbacks of an event, we do not need to reload the
  * CPU's index into a TCG temp, since the first callback did it already.
+ *
+ * Inline ops and conditional callbacks do not follow this scheme: their shape
+ * depends on the op, on the condition and on whether they target a per-vCPU
+ * scoreboard, so the empty event is left empty and their ops are generated
+ * from scratch when injecting. Since tcg_gen_FOO always appends to the op
+ * list, the new ops are then moved to the insertion point.
  */
 #include "qemu/osdep.h"
 #include "tcg/tcg.h"
@@ -73,7 +79,9 @@ enum plugin_gen_from {
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
+    PLUGIN_GEN_CB_COND,
     PLUGIN_GEN_CB_MEM,
+    PLUGIN_GEN_CB_MEM_BATCH,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
     PLUGIN_GEN_N_CBS,
@@ -123,21 +131,9 @@ static void gen_empty_udata_cb(void)
     tcg_temp_free_i32(cpu_index);
 }
 
-/*
- * For now we only support addi_i64.
- * When we support more ops, we can generate one empty inline cb for each.
- */
+/* Inline ops and conditional callbacks are generated at injection time. */
 static void gen_empty_inline_cb(void)
 {
-    TCGv_i64 val = tcg_temp_new_i64();
-    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
-
-    tcg_gen_ld_i64(val, ptr, 0);
-    /* pass an immediate != 0 so that it doesn't get optimized away */
-    tcg_gen_addi_i64(val, val, 0xdeadface);
-    tcg_gen_st_i64(val, ptr, 0);
-    tcg_temp_free_ptr(ptr);
-    tcg_temp_free_i64(val);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -145,6 +141,27 @@ static void gen_empty_mem_cb(TCGv addr, uint32_t info)
     do_gen_mem_cb(addr, info);
 }
 
+/*
+ * Fill in a trace buffer record.  The record's address and the update of
+ * the buffer's fill level are added around a copy of these ops.
+ */
+static void gen_empty_mem_batch(TCGv addr, uint32_t info)
+{
+    TCGv_i32 meminfo = tcg_const_i32(info);
+    TCGv_i64 vaddr64 = tcg_temp_new_i64();
+    TCGv_ptr rec = tcg_temp_new_ptr(); /* computed later */
+
+    tcg_gen_extu_tl_i64(vaddr64, addr);
+    tcg_gen_st_i64(vaddr64, rec, offsetof(struct qemu_plugin_mem_record,
+                                          vaddr));
+    tcg_gen_st_i32(meminfo, rec, offsetof(struct qemu_plugin_mem_record,
+                                          info));
+
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_i64(vaddr64);
+    tcg_temp_free_i32(meminfo);
+}
+
 /*
  * Share the same function for enable/disable. When enabling, the NULL
  * pointer will be overwritten later.
@@ -187,10 +204,12 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
          */
         gen_wrapped(from, PLUGIN_GEN_ENABLE_MEM_HELPER,
                     gen_empty_mem_helper);
+        gen_wrapped(from, PLUGIN_GEN_CB_MEM_BATCH, gen_empty_inline_cb);
         /* fall through */
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_COND, gen_empty_inline_cb);
         break;
     default:
         g_assert_not_reached();
@@ -226,6 +245,9 @@ void plugin_gen_empty_mem_callback(TCGv addr, uint32_t info)
 
     fn.inline_fn = gen_empty_inline_cb;
     gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, 0, info, false);
+
+    fn.mem_fn = gen_empty_mem_batch;
+    gen_mem_wrapped(PLUGIN_GEN_CB_MEM_BATCH, &fn, addr, info, true);
 }
 
 static TCGOp *find_op(TCGOp *op, TCGOpcode opc)
@@ -325,19 +347,6 @@ static TCGOp *copy_extu_tl_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* 2x ld_i32 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-    } else {
-        /* ld_i64 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i64);
-    }
-    return op;
-}
-
 static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -351,21 +360,6 @@ static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* all 32-bit backends must implement add2_i32 */
-        g_assert(TCG_TARGET_HAS_add2_i32);
-        op = copy_op(begin_op, op, INDEX_op_add2_i32);
-        op->args[4] = tcgv_i32_arg(tcg_constant_i32(v));
-        op->args[5] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
-    } else {
-        op = copy_op(begin_op, op, INDEX_op_add_i64);
-        op->args[2] = tcgv_i64_arg(tcg_constant_i64(v));
-    }
-    return op;
-}
-
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -438,23 +432,139 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * Move the ops that were appended to the op list after @last so that
+ * they follow @op instead.  Returns the last op that was moved.
+ */
+static TCGOp *move_ops_after(TCGOp *last, TCGOp *op)
+{
+    TCGOp *next = QTAILQ_NEXT(last, link);
+
+    while (next) {
+        TCGOp *cur = next;
+
+        next = QTAILQ_NEXT(cur, link);
+        QTAILQ_REMOVE(&tcg_ctx->ops, cur, link);
+        QTAILQ_INSERT_AFTER(&tcg_ctx->ops, op, cur, link);
+        op = cur;
+    }
+    return op;
+}
+
+/* Compute the address of @entry for the running vCPU, or of @ptr. */
+static TCGv_ptr gen_plugin_u64_ptr(qemu_plugin_u64 entry, void *ptr)
+{
+    GArray *arr;
+    TCGv_ptr addr;
+    TCGv_i32 cpu_index;
+
+    if (!entry.score) {
+        return tcg_const_ptr(ptr);
+    }
+
+    arr = entry.score->data;
+    addr = tcg_temp_new_ptr();
+    cpu_index = tcg_temp_new_i32();
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_muli_i32(cpu_index, cpu_index, g_array_get_element_size(arr));
+    tcg_gen_ext_i32_ptr(addr, cpu_index);
+    tcg_temp_free_i32(cpu_index);
+    tcg_gen_addi_ptr(addr, addr, (intptr_t)(arr->data + entry.offset));
+    return addr;
+}
+
+static void gen_inline_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cb->inline_insn.entry, cb->userp);
+    TCGv_i64 val;
+
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        val = tcg_temp_new_i64();
+        tcg_gen_ld_i64(val, ptr, 0);
+        tcg_gen_addi_i64(val, val, cb->inline_insn.imm);
+        tcg_gen_st_i64(val, ptr, 0);
+        tcg_temp_free_i64(val);
+        break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        tcg_gen_st_i64(tcg_constant_i64(cb->inline_insn.imm), ptr, 0);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    tcg_temp_free_ptr(ptr);
+}
+
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* NEVER and ALWAYS are resolved at registration time */
+        g_assert_not_reached();
+    }
+}
+
+static void gen_cond_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGCond cond = plugin_cond_to_tcgcond(cb->cond.cond);
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cb->cond.entry, NULL);
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_i32 cpu_index;
+    TCGLabel *skip = gen_new_label();
+    TCGOp *op;
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_temp_free_ptr(ptr);
+    tcg_gen_brcondi_i64(tcg_invert_cond(cond), val, cb->cond.imm, skip);
+    tcg_temp_free_i64(val);
+
+    cpu_index = tcg_temp_new_i32();
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, tcg_constant_ptr(cb->userp));
+    tcg_temp_free_i32(cpu_index);
+
+    /* call the plugin directly instead of the empty helper */
+    op = QTAILQ_LAST(&tcg_ctx->ops);
+    while (op->opc != INDEX_op_call) {
+        op = QTAILQ_PREV(op, link);
+    }
+    op->args[TCGOP_CALLO(op) + TCGOP_CALLI(op)] = (uintptr_t)cb->f.vcpu_udata;
+
+    gen_set_label(skip);
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
-
-    /* ld_i64 */
-    op = copy_ld_i64(&begin_op, op);
+    TCGOp *last = QTAILQ_LAST(&tcg_ctx->ops);
 
-    /* add_i64 */
-    op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
+    gen_inline_cb(cb);
+    return move_ops_after(last, op);
+}
 
-    /* st_i64 */
-    op = copy_st_i64(&begin_op, op);
+static TCGOp *append_cond_cb(const struct qemu_plugin_dyn_cb *cb,
+                             TCGOp *begin_op, TCGOp *op,
+                             int *unused)
+{
+    TCGOp *last = QTAILQ_LAST(&tcg_ctx->ops);
 
-    return op;
+    gen_cond_cb(cb);
+    return move_ops_after(last, op);
 }
 
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
@@ -490,6 +600,80 @@ static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGOp *append_mem_batch_cb(const struct qemu_plugin_dyn_cb *cb,
+                                  TCGOp *begin_op, TCGOp *op, int *unused)
+{
+    struct qemu_plugin_mem_buffer *buf = cb->batch.buf;
+    qemu_plugin_u64 entry = { buf->score, 0 };
+    TCGOp *last = QTAILQ_LAST(&tcg_ctx->ops);
+    TCGOp *first;
+    TCGv_ptr vbuf, rec;
+    TCGv_i64 n, off;
+
+    /* rec = &vbuf->records[vbuf->n] */
+    vbuf = gen_plugin_u64_ptr(entry, NULL);
+    n = tcg_temp_new_i64();
+    tcg_gen_ld_i64(n, vbuf, offsetof(struct qemu_plugin_mem_buffer_vcpu, n));
+    off = tcg_temp_new_i64();
+    tcg_gen_muli_i64(off, n, sizeof(struct qemu_plugin_mem_record));
+    rec = tcg_temp_new_ptr();
+    tcg_gen_trunc_i64_ptr(rec, off);
+    tcg_temp_free_i64(off);
+    tcg_gen_add_ptr(rec, rec, vbuf);
+    tcg_gen_addi_ptr(rec, rec,
+                     offsetof(struct qemu_plugin_mem_buffer_vcpu, records));
+    op = move_ops_after(last, op);
+
+    /* const_i32 == mov_i32 ("info", so it remains as is) */
+    first = op = copy_op(&begin_op, op, INDEX_op_mov_i32);
+
+    /* extu_tl_i64 */
+    op = copy_extu_tl_i64(&begin_op, op);
+
+    /* st_i64 of the vaddr, st_i32 of the info */
+    op = copy_st_i64(&begin_op, op);
+    op = copy_op(&begin_op, op, INDEX_op_st_i32);
+
+    /* store them into the record */
+    do {
+        first = QTAILQ_NEXT(first, link);
+        if (first->opc == INDEX_op_st_i32 || first->opc == INDEX_op_st_i64) {
+            first->args[1] = tcgv_ptr_arg(rec);
+        }
+    } while (first != op);
+
+    last = QTAILQ_LAST(&tcg_ctx->ops);
+    tcg_gen_st_ptr(tcg_constant_ptr(cb->userp), rec,
+                   offsetof(struct qemu_plugin_mem_record, userdata));
+    tcg_temp_free_ptr(rec);
+    tcg_gen_addi_i64(n, n, 1);
+    tcg_gen_st_i64(n, vbuf, offsetof(struct qemu_plugin_mem_buffer_vcpu, n));
+    tcg_temp_free_i64(n);
+    tcg_temp_free_ptr(vbuf);
+    return move_ops_after(last, op);
+}
+
+/*
+ * Make room in @buf for the @n_accesses records that the instruction is
+ * about to append.  Done at the start of the instruction, by a helper
+ * rather than an inline branch: a branch would end the basic block, and
+ * with it the front end's normal temps, between two instructions.
+ */
+static void gen_mem_buffer_reserve(struct qemu_plugin_mem_buffer *buf,
+                                   unsigned n_accesses)
+{
+    TCGv_i32 cpu_index;
+
+    g_assert(n_accesses <= buf->n_records);
+
+    cpu_index = tcg_temp_new_i32();
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_mem_buffer_reserve(cpu_index, tcg_constant_ptr(buf),
+                                         tcg_constant_i32(n_accesses));
+    tcg_temp_free_i32(cpu_index);
+}
+
 typedef TCGOp *(*inject_fn)(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *intp);
 typedef bool (*op_ok_fn)(const TCGOp *op, const struct qemu_plugin_dyn_cb *cb);
@@ -548,12 +732,94 @@ inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
     inject_cb_type(cbs, begin_op, append_inline_cb, ok);
 }
 
+static void
+inject_cond_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_cond_cb, op_ok);
+}
+
 static void
 inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
 {
     inject_cb_type(cbs, begin_op, append_mem_cb, op_rw);
 }
 
+static void
+inject_mem_batch_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_mem_batch_cb, op_rw);
+}
+
+/* Count the memory accesses after @op in the current insn that @buf traces */
+static unsigned count_mem_batch_accesses(const GArray *cbs, TCGOp *op,
+                                         struct qemu_plugin_mem_buffer *buf)
+{
+    unsigned n = 0;
+    int i;
+
+    for (op = QTAILQ_NEXT(op, link);
+         op && op->opc != INDEX_op_insn_start;
+         op = QTAILQ_NEXT(op, link)) {
+        if (op->opc != INDEX_op_plugin_cb_start ||
+            op->args[0] != PLUGIN_GEN_FROM_MEM ||
+            op->args[1] != PLUGIN_GEN_CB_MEM_BATCH) {
+            continue;
+        }
+        for (i = 0; i < cbs->len; i++) {
+            struct qemu_plugin_dyn_cb *cb =
+                &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+
+            if (cb->batch.buf == buf && op_rw(op, cb)) {
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static void inject_mem_buffer_check(const GArray *cbs, TCGOp *begin_op)
+{
+    TCGOp *end_op;
+    TCGOp *op;
+    int i, j;
+
+    if (!cbs || cbs->len == 0) {
+        rm_ops(begin_op);
+        return;
+    }
+
+    end_op = find_op(begin_op, INDEX_op_plugin_cb_end);
+    tcg_debug_assert(end_op);
+
+    op = end_op;
+    for (i = 0; i < cbs->len; i++) {
+        struct qemu_plugin_mem_buffer *buf =
+            g_array_index(cbs, struct qemu_plugin_dyn_cb, i).batch.buf;
+        unsigned n_accesses;
+        TCGOp *last;
+
+        /* check each buffer only once */
+        for (j = 0; j < i; j++) {
+            if (g_array_index(cbs, struct qemu_plugin_dyn_cb, j).batch.buf ==
+                buf) {
+                break;
+            }
+        }
+        if (j < i) {
+            continue;
+        }
+
+        n_accesses = count_mem_batch_accesses(cbs, end_op, buf);
+        if (n_accesses == 0) {
+            continue;
+        }
+        last = QTAILQ_LAST(&tcg_ctx->ops);
+        gen_mem_buffer_reserve(buf, n_accesses);
+        op = move_ops_after(last, op);
+    }
+    rm_ops_range(begin_op, end_op);
+}
+
 /* we could change the ops in place, but we can reuse more code by copying */
 static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 {
@@ -588,12 +854,13 @@ static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 static void inject_mem_enable_helper(struct qemu_plugin_insn *plugin_insn,
                                      TCGOp *begin_op)
 {
-    GArray *cbs[2];
+    GArray *cbs[3];
     GArray *arr;
     size_t n_cbs, i;
 
     cbs[0] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR];
     cbs[1] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
+    cbs[2] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_BATCH];
 
     n_cbs = 0;
     for (i = 0; i < ARRAY_SIZE(cbs); i++) {
@@ -655,6 +922,12 @@ static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static void plugin_gen_tb_cond(const struct qemu_plugin_tb *ptb,
+                               TCGOp *begin_op)
+{
+    inject_cond_cb(ptb->cbs[PLUGIN_CB_COND], begin_op);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -671,6 +944,14 @@ static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                      begin_op, op_ok);
 }
 
+static void plugin_gen_insn_cond(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_cond_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_COND], begin_op);
+}
+
 static void plugin_gen_mem_regular(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -688,6 +969,23 @@ static void plugin_gen_mem_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(cbs, begin_op, op_rw);
 }
 
+static void plugin_gen_mem_batch(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_mem_batch_cb(insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_BATCH], begin_op);
+}
+
+static void plugin_gen_mem_buffer_check(const struct qemu_plugin_tb *ptb,
+                                        TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_mem_buffer_check(insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_BATCH],
+                            begin_op);
+}
+
 static void plugin_gen_enable_mem_helper(const struct qemu_plugin_tb *ptb,
                                          TCGOp *begin_op, int insn_idx)
 {
@@ -737,9 +1035,15 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
+            case PLUGIN_GEN_CB_COND:
+                type = "cond";
+                break;
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
+            case PLUGIN_GEN_CB_MEM_BATCH:
+                type = "mem batch";
+                break;
             case PLUGIN_GEN_ENABLE_MEM_HELPER:
                 type = "enable mem helper";
                 break;
@@ -785,6 +1089,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_tb_inline(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    plugin_gen_tb_cond(plugin_tb, op);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -801,9 +1108,15 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_insn_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    plugin_gen_insn_cond(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_ENABLE_MEM_HELPER:
                     plugin_gen_enable_mem_helper(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_MEM_BATCH:
+                    plugin_gen_mem_buffer_check(plugin_tb, op, insn_idx);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -820,6 +1133,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_mem_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_MEM_BATCH:
+                    plugin_gen_mem_batch(plugin_tb, op, insn_idx);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -22,6 +22,7 @@
 
 #include "qemu/thread.h"
 #include "qemu/qht.h"
+#include "qemu/stats64.h"
 
 #define CODE_GEN_HTABLE_BITS     15
 #define CODE_GEN_HTABLE_SIZE     (1 << CODE_GEN_HTABLE_BITS)
@@ -33,8 +34,10 @@ struct TBContext {
     struct qht htable;
 
     /* statistics */
-    unsigned tb_flush_count;
+    unsigned tb_flush_count; /* full flushes only */
+    unsigned tb_evict_count;
     unsigned tb_phys_invalidate_count;
+    Stat64 tb_flush_stall_ns; /* time spent with all vCPUs stopped */
 };
 
 extern TBContext tb_ctx;
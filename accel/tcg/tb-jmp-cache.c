@@ -0,0 +1,151 @@
+/*
+ * The per-CPU TranslationBlock jump cache
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "exec/exec-all.h"
+#include "tb-jmp-cache.h"
+
+unsigned tb_jmp_cache_bits = TB_JMP_CACHE_DEFAULT_BITS;
+
+static size_t tb_jmp_cache_nb_sets(CPUJumpCache *jc)
+{
+    return (size_t)1 << jc->set_bits;
+}
+
+void tb_jmp_cache_init(CPUState *cpu)
+{
+    unsigned set_bits = tb_jmp_cache_bits - ctz32(TB_JMP_CACHE_WAYS);
+    CPUJumpCache *jc;
+
+    jc = g_malloc0(sizeof(*jc) + (sizeof(jc->set[0]) << set_bits));
+    jc->set_bits = set_bits;
+#ifdef CONFIG_SOFTMMU
+    {
+        /*
+         * Half of the bits of the set index come from the page offset,
+         * as long as the page is large enough.
+         */
+        unsigned page_bits = MIN(set_bits / 2, TARGET_PAGE_BITS - 1);
+
+        jc->page_shift = TARGET_PAGE_BITS - page_bits;
+        jc->addr_mask = (1u << page_bits) - 1;
+        jc->page_mask = ((1u << set_bits) - 1) & ~jc->addr_mask;
+    }
+#endif
+    qatomic_rcu_set(&cpu->tb_jmp_cache, jc);
+}
+
+void tb_jmp_cache_free(CPUState *cpu)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+    /* Other threads may still be invalidating TBs in the cache. */
+    qatomic_set(&cpu->tb_jmp_cache, NULL);
+    g_free_rcu(jc, rcu);
+}
+
+void cpu_tb_jmp_cache_clear(CPUState *cpu)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+    if (!jc) {
+        return;
+    }
+    /*
+     * Stale entries are ignored.  Only when the epoch wraps around must
+     * they really be cleared, lest they become valid again.
+     */
+    if (++jc->epoch == 0) {
+        size_t i;
+
+        for (i = 0; i < tb_jmp_cache_nb_sets(jc); i++) {
+            tb_jmp_cache_set_entry(&jc->set[i][0], NULL, 0);
+            tb_jmp_cache_set_entry(&jc->set[i][1], NULL, 0);
+        }
+    }
+}
+
+void tb_jmp_cache_remove(TranslationBlock *tb)
+{
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+        unsigned h;
+        int way;
+
+        if (!jc) {
+            continue;
+        }
+        h = tb_jmp_cache_hash_func(jc, tb->pc);
+        for (way = 0; way < TB_JMP_CACHE_WAYS; way++) {
+            if (qatomic_read(&jc->set[h][way].tb) == tb) {
+                qatomic_set(&jc->set[h][way].tb, NULL);
+            }
+        }
+    }
+}
+
+void tb_jmp_cache_counts(size_t *phits, size_t *pmisses)
+{
+    CPUState *cpu;
+    size_t hits = 0, misses = 0;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (!jc) {
+            continue;
+        }
+        hits += qatomic_read(&jc->hits);
+        misses += qatomic_read(&jc->misses);
+    }
+    *phits = hits;
+    *pmisses = misses;
+}
+
+#ifdef CONFIG_SOFTMMU
+static void tb_jmp_cache_clear_page(CPUJumpCache *jc, target_ulong page_addr)
+{
+    unsigned int i, i0 = tb_jmp_cache_hash_page(jc, page_addr);
+
+    for (i = 0; i <= jc->addr_mask; i++) {
+        qatomic_set(&jc->set[i0 + i][0].tb, NULL);
+        qatomic_set(&jc->set[i0 + i][1].tb, NULL);
+    }
+}
+
+void tb_jmp_cache_clear_range(CPUState *cpu, target_ulong addr,
+                              target_ulong len)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    size_t nb_groups = tb_jmp_cache_nb_sets(jc) / (jc->addr_mask + 1);
+    target_ulong i;
+
+    /*
+     * Each page uses its own group of sets.  If the range has at least
+     * as many pages as there are groups, every set would be cleared;
+     * starting a new epoch is cheaper.
+     */
+    if (len >= (target_ulong)TARGET_PAGE_SIZE * nb_groups) {
+        cpu_tb_jmp_cache_clear(cpu);
+        return;
+    }
+
+    /*
+     * Discard jump cache entries for any tb which might potentially
+     * overlap the flushed pages.
+     */
+    tb_jmp_cache_clear_page(jc, addr - TARGET_PAGE_SIZE);
+    for (i = 0; i < len; i += TARGET_PAGE_SIZE) {
+        tb_jmp_cache_clear_page(jc, addr + i);
+    }
+}
+#endif /* CONFIG_SOFTMMU */
@@ -0,0 +1,166 @@
+/*
+ * The per-CPU TranslationBlock jump cache
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef ACCEL_TCG_TB_JMP_CACHE_H
+#define ACCEL_TCG_TB_JMP_CACHE_H
+
+#include "exec/exec-all.h"
+#include "qemu/rcu.h"
+
+/*
+ * The jump cache maps the virtual pc of a TB to the TB, in front of the
+ * global TB hash table.  It is 2-way set associative; a hit in the
+ * second way swaps the two, so that the first way is the most recently
+ * used one and a new TB replaces the least recently used one.
+ *
+ * The number of entries is a power of two, chosen with the jmp-cache-size
+ * property of the TCG accelerator.
+ *
+ * Each entry records the epoch in which it was filled; clearing the whole
+ * cache just starts a new epoch, so that it costs the same whatever its
+ * size.  In system mode, the sets used by the pcs of a page are
+ * contiguous, so that a TLB flush of a few pages only needs to clear
+ * their sets and not the whole cache.
+ *
+ * Only the vCPU thread fills the cache and changes the epoch; other
+ * threads may concurrently reset entries to NULL when invalidating a TB.
+ */
+
+#define TB_JMP_CACHE_WAYS         2
+#define TB_JMP_CACHE_MIN_BITS     8
+#define TB_JMP_CACHE_MAX_BITS     20
+#define TB_JMP_CACHE_DEFAULT_BITS 12
+
+typedef struct CPUJumpCacheEntry {
+    /* Accessed in parallel; all accesses must be atomic */
+    TranslationBlock *tb;
+    uint32_t epoch;
+} CPUJumpCacheEntry;
+
+typedef struct CPUJumpCache {
+    struct rcu_head rcu;
+    uint32_t epoch;
+    unsigned set_bits;
+#ifdef CONFIG_SOFTMMU
+    /* Hash parameters, see tb_jmp_cache_hash_func. */
+    unsigned page_shift;
+    unsigned page_mask;
+    unsigned addr_mask;
+#endif
+
+    /* Statistics, for "info jit" */
+    size_t hits;
+    size_t misses;
+
+    CPUJumpCacheEntry set[][TB_JMP_CACHE_WAYS];
+} CPUJumpCache;
+
+/* Log2 of the number of entries of the jump caches created from now on. */
+extern unsigned tb_jmp_cache_bits;
+
+void tb_jmp_cache_init(CPUState *cpu);
+void tb_jmp_cache_free(CPUState *cpu);
+
+/**
+ * tb_jmp_cache_remove:
+ * @tb: TB being invalidated
+ *
+ * Remove @tb from the jump cache of all CPUs.
+ */
+void tb_jmp_cache_remove(TranslationBlock *tb);
+
+/* Return the total hits and misses of the jump caches of all CPUs. */
+void tb_jmp_cache_counts(size_t *hits, size_t *misses);
+
+#ifdef CONFIG_SOFTMMU
+/**
+ * tb_jmp_cache_clear_range:
+ * @cpu: CPU whose jump cache is cleared
+ * @addr: first virtual address of the range, page aligned
+ * @len: length of the range
+ *
+ * Clear the entries for any TB that might overlap the range.
+ */
+void tb_jmp_cache_clear_range(CPUState *cpu, target_ulong addr,
+                              target_ulong len);
+
+/*
+ * Only the addr_mask bits at the bottom of the set index vary for
+ * addresses on the same page.  The top bits are the same.  This allows
+ * TLB invalidation to quickly clear a subset of the cache.
+ */
+static inline unsigned tb_jmp_cache_hash_page(CPUJumpCache *jc,
+                                              target_ulong pc)
+{
+    target_ulong tmp = pc ^ (pc >> jc->page_shift);
+
+    return (tmp >> jc->page_shift) & jc->page_mask;
+}
+
+static inline unsigned tb_jmp_cache_hash_func(CPUJumpCache *jc,
+                                              target_ulong pc)
+{
+    target_ulong tmp = pc ^ (pc >> jc->page_shift);
+
+    return ((tmp >> jc->page_shift) & jc->page_mask) | (tmp & jc->addr_mask);
+}
+
+#else
+
+/* In user-mode we can get better hashing because we do not have a TLB */
+static inline unsigned tb_jmp_cache_hash_func(CPUJumpCache *jc,
+                                              target_ulong pc)
+{
+    return (pc ^ (pc >> jc->set_bits)) & ((1u << jc->set_bits) - 1);
+}
+
+#endif /* CONFIG_SOFTMMU */
+
+/* Return the TB in @way of set @hash, or NULL if the entry is stale. */
+static inline TranslationBlock *tb_jmp_cache_get(CPUJumpCache *jc,
+                                                 unsigned hash, int way)
+{
+    CPUJumpCacheEntry *e = &jc->set[hash][way];
+    TranslationBlock *tb = qatomic_rcu_read(&e->tb);
+
+    return e->epoch == jc->epoch ? tb : NULL;
+}
+
+static inline void tb_jmp_cache_set_entry(CPUJumpCacheEntry *e,
+                                          TranslationBlock *tb,
+                                          uint32_t epoch)
+{
+    e->epoch = epoch;
+    qatomic_set(&e->tb, tb);
+}
+
+static inline void tb_jmp_cache_miss(CPUJumpCache *jc)
+{
+    qatomic_set(&jc->misses, jc->misses + 1);
+}
+
+/* Add @tb to set @hash, evicting the least recently used entry. */
+static inline void tb_jmp_cache_insert(CPUJumpCache *jc, unsigned hash,
+                                       TranslationBlock *tb)
+{
+    CPUJumpCacheEntry *e = jc->set[hash];
+
+    tb_jmp_cache_set_entry(&e[1], qatomic_read(&e[0].tb), e[0].epoch);
+    tb_jmp_cache_set_entry(&e[0], tb, jc->epoch);
+}
+
+/* Record a hit for @tb in @way of set @hash. */
+static inline void tb_jmp_cache_hit(CPUJumpCache *jc, unsigned hash,
+                                    int way, TranslationBlock *tb)
+{
+    if (way) {
+        tb_jmp_cache_insert(jc, hash, tb);
+    }
+    qatomic_set(&jc->hits, jc->hits + 1);
+}
+
+#endif /* ACCEL_TCG_TB_JMP_CACHE_H */
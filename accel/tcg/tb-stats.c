@@ -0,0 +1,173 @@
+/*
+ * Per-block execution and translation statistics
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/qht.h"
+#include "qemu/rcu.h"
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+#include "tb-hash.h"
+#include "tb-stats.h"
+
+bool tb_stats_enabled;
+
+static struct qht tb_stats_ht;
+
+#define TB_STATS_HTABLE_SIZE (1 << 12)
+
+static bool tb_stats_cmp(const void *ap, const void *bp)
+{
+    const TBStatistics *a = ap;
+    const TBStatistics *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+           a->pc == b->pc &&
+           a->cs_base == b->cs_base &&
+           a->flags == b->flags;
+}
+
+void tb_stats_enable(void)
+{
+    qht_init(&tb_stats_ht, tb_stats_cmp, TB_STATS_HTABLE_SIZE,
+             QHT_MODE_AUTO_RESIZE);
+    tb_stats_enabled = true;
+}
+
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags)
+{
+    TBStatistics key = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .cs_base = cs_base,
+        .flags = flags,
+    };
+    uint32_t hash = tb_hash_func(phys_pc, pc, flags, 0, 0);
+    TBStatistics *s;
+    void *existing;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        s = qht_lookup(&tb_stats_ht, &key, hash);
+    }
+    if (s) {
+        return s;
+    }
+
+    s = g_new(TBStatistics, 1);
+    *s = key;
+    qemu_spin_init(&s->lock);
+    if (!qht_insert(&tb_stats_ht, s, hash, &existing)) {
+        /* Another vCPU got there first. */
+        g_free(s);
+        return existing;
+    }
+    return s;
+}
+
+void tb_stats_record_translation(TranslationBlock *tb, int64_t translate_ns)
+{
+    TBStatistics *s = tb->tb_stats;
+
+    qemu_spin_lock(&s->lock);
+    s->translations++;
+    s->translate_ns += translate_ns;
+    s->guest_insns = tb->icount;
+    s->guest_size = tb->size;
+    s->ops = tcg_ctx->nb_ops;
+    s->spills = tcg_ctx->nb_spills;
+    s->host_size = tb->tc.size;
+    qemu_spin_unlock(&s->lock);
+}
+
+typedef struct TBStatsEntry {
+    TBStatistics *s;
+    uint64_t exec_count;
+} TBStatsEntry;
+
+static void tb_stats_collect(void *p, uint32_t hash, void *userp)
+{
+    TBStatistics *s = p;
+    TBStatsEntry e = {
+        .s = s,
+        .exec_count = qatomic_read__nocheck(&s->exec_count),
+    };
+
+    g_array_append_val((GArray *)userp, e);
+}
+
+static gint tb_stats_entry_cmp(gconstpointer ap, gconstpointer bp)
+{
+    const TBStatsEntry *a = ap;
+    const TBStatsEntry *b = bp;
+
+    /* Most executed first. */
+    return a->exec_count < b->exec_count ? 1 :
+           a->exec_count > b->exec_count ? -1 : 0;
+}
+
+void tb_stats_dump(GString *buf, CPUState *cpu, int max)
+{
+    g_autoptr(GArray) entries = g_array_new(false, false,
+                                            sizeof(TBStatsEntry));
+    uint64_t execs = 0, translations = 0, translate_ns = 0;
+    size_t retranslated = 0;
+    guint i;
+
+    qht_iter(&tb_stats_ht, tb_stats_collect, entries);
+    g_array_sort(entries, tb_stats_entry_cmp);
+
+    for (i = 0; i < entries->len; i++) {
+        TBStatsEntry *e = &g_array_index(entries, TBStatsEntry, i);
+
+        qemu_spin_lock(&e->s->lock);
+        execs += e->exec_count;
+        translations += e->s->translations;
+        translate_ns += e->s->translate_ns;
+        retranslated += e->s->translations > 1;
+        qemu_spin_unlock(&e->s->lock);
+    }
+
+    g_string_append_printf(buf, "blocks                %u\n", entries->len);
+    g_string_append_printf(buf, "executions            %" PRIu64 "\n", execs);
+    g_string_append_printf(buf, "translations          %" PRIu64
+                           " (%zu blocks more than once)\n",
+                           translations, retranslated);
+    g_string_append_printf(buf, "translation time      %" PRIu64 " us\n",
+                           translate_ns / 1000);
+
+    for (i = 0; i < entries->len && i < max; i++) {
+        TBStatsEntry *e = &g_array_index(entries, TBStatsEntry, i);
+        TBStatistics s;
+
+        qemu_spin_lock(&e->s->lock);
+        s = *e->s;
+        qemu_spin_unlock(&e->s->lock);
+
+        g_string_append_printf(buf, "\nblock %u: pc 0x" TARGET_FMT_lx
+                               " phys 0x" TB_PAGE_ADDR_FMT
+                               " cs_base 0x" TARGET_FMT_lx
+                               " flags 0x%08x\n",
+                               i + 1, s.pc, s.phys_pc, s.cs_base, s.flags);
+        g_string_append_printf(buf, "  executions %" PRIu64 " (%.2f%%),"
+                               " translations %" PRIu64 " (%" PRIu64
+                               " us)\n",
+                               e->exec_count,
+                               execs ? 100.0 * e->exec_count / execs : 0,
+                               s.translations, s.translate_ns / 1000);
+        g_string_append_printf(buf, "  guest %u insns, %u bytes;"
+                               " %u ops, %u spills;"
+                               " host %u bytes (%.1f per insn)\n",
+                               s.guest_insns, s.guest_size, s.ops, s.spills,
+                               s.host_size,
+                               s.guest_insns ?
+                               (double)s.host_size / s.guest_insns : 0);
+        if (cpu && s.guest_size) {
+            target_disas_buf(buf, cpu, s.pc, s.guest_size);
+        }
+    }
+}
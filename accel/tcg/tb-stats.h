@@ -0,0 +1,83 @@
+/*
+ * Per-block execution and translation statistics
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef ACCEL_TCG_TB_STATS_H
+#define ACCEL_TCG_TB_STATS_H
+
+#include "exec/exec-all.h"
+#include "qemu/thread.h"
+
+/*
+ * Statistics are kept per guest block, identified like a TB by its
+ * physical and virtual pc, cs_base and flags, so that they survive the
+ * invalidation and retranslation of the TBs for the block.  They are
+ * never freed.
+ */
+typedef struct TBStatistics {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+
+    /*
+     * Incremented by the generated code without atomics, so concurrent
+     * executions on several vCPUs may occasionally be lost.
+     */
+    uint64_t exec_count;
+
+    /* The rest is updated at translation time under @lock. */
+    QemuSpin lock;
+    uint64_t translations;
+    uint64_t translate_ns;
+    /* These describe the last translation. */
+    unsigned guest_insns;
+    unsigned guest_size;
+    unsigned ops;
+    unsigned spills;
+    unsigned host_size;
+} TBStatistics;
+
+extern bool tb_stats_enabled;
+
+/**
+ * tb_stats_enable:
+ *
+ * Start collecting statistics for the TBs translated from now on.
+ */
+void tb_stats_enable(void);
+
+/**
+ * tb_stats_get:
+ *
+ * Return the statistics for the block identified by @phys_pc, @pc,
+ * @cs_base and @flags, creating them if needed.
+ */
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags);
+
+/**
+ * tb_stats_record_translation:
+ * @tb: the TB that was just translated
+ * @translate_ns: time spent translating it
+ *
+ * Account a translation of @tb in @tb->tb_stats, reading the number of
+ * TCG ops and spills from tcg_ctx.
+ */
+void tb_stats_record_translation(TranslationBlock *tb, int64_t translate_ns);
+
+/**
+ * tb_stats_dump:
+ * @buf: output buffer
+ * @cpu: CPU used to read the guest code
+ * @max: number of blocks to show
+ *
+ * Print totals and the @max most executed blocks, with their
+ * guest code.
+ */
+void tb_stats_dump(GString *buf, CPUState *cpu, int max);
+
+#endif /* ACCEL_TCG_TB_STATS_H */
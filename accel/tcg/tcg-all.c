@@ -36,6 +36,8 @@
 #include "hw/boards.h"
 #endif
 #include "internal.h"
+#include "tb-jmp-cache.h"
+#include "tb-stats.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -43,6 +45,8 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    bool tb_stats;
+    uint32_t jmp_cache_size;
 };
 typedef struct TCGState TCGState;
 
@@ -105,6 +109,7 @@ static void tcg_accel_instance_init(Object *obj)
 #else
     s->splitwx_enabled = 0;
 #endif
+    s->jmp_cache_size = 1 << TB_JMP_CACHE_DEFAULT_BITS;
 }
 
 bool mttcg_enabled;
@@ -124,6 +129,10 @@ static int tcg_init_machine(MachineState *ms)
     page_init();
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    if (s->tb_stats) {
+        tb_stats_enable();
+    }
+    tb_jmp_cache_bits = ctz32(s->jmp_cache_size);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -195,6 +204,39 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_jmp_cache_size(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->jmp_cache_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_jmp_cache_size(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    if (!is_power_of_2(value) ||
+        value < (1 << TB_JMP_CACHE_MIN_BITS) ||
+        value > (1 << TB_JMP_CACHE_MAX_BITS)) {
+        error_setg(errp, "jmp-cache-size must be a power of 2 between "
+                   "%d and %d", 1 << TB_JMP_CACHE_MIN_BITS,
+                   1 << TB_JMP_CACHE_MAX_BITS);
+        return;
+    }
+
+    s->jmp_cache_size = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -207,6 +249,18 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_tb_stats(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_stats;
+}
+
+static void tcg_set_tb_stats(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_stats = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -228,6 +282,17 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add(oc, "jmp-cache-size", "int",
+        tcg_get_jmp_cache_size, tcg_set_jmp_cache_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "jmp-cache-size",
+        "Number of entries of the per-CPU TB jump cache");
+
+    object_class_property_add_bool(oc, "tb-stats",
+        tcg_get_tb_stats, tcg_set_tb_stats);
+    object_class_property_set_description(oc, "tb-stats",
+        "Collect execution and translation statistics for each block");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -36,6 +36,202 @@ static inline void clear_high(void *d, intptr_t oprsz, uint32_t desc)
     }
 }
 
+/*
+ * Hand-written AVX-512 versions of the most common operations, used
+ * for operands of 64 bytes or more when the host supports them.  The
+ * TCG backend only expands operations inline up to the widest vector
+ * type it supports, so these are what SVE and AVX-512 guests end up
+ * calling for their widest vectors.
+ *
+ * Operand sizes are multiples of 8 bytes: each 64-byte chunk is loaded
+ * and stored with a mask of 64-bit lanes, which also covers a partial
+ * final chunk.
+ */
+typedef void gvec_avx512_3_fn(void *d, void *a, void *b, intptr_t oprsz);
+
+#ifdef CONFIG_AVX512F_OPT
+#include "qemu/cpuid.h"
+
+static bool have_avx512f;
+
+static void __attribute__((constructor)) init_gvec_avx512(void)
+{
+    unsigned max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+
+    if (max >= 7) {
+        __cpuid(1, a, b, c, d);
+        if (c & bit_OSXSAVE) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            /* OPMASK, ZMM and YMM/XMM state must all be enabled by the OS */
+            have_avx512f = (bv & 0xe6) == 0xe6 && (b & bit_AVX512F);
+        }
+    }
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#include <immintrin.h>
+
+static inline __mmask8 avx512_mask(intptr_t i, intptr_t oprsz)
+{
+    intptr_t n = (oprsz - i) / 8;
+
+    return n >= 8 ? 0xff : (1 << n) - 1;
+}
+
+static inline __m512i avx512_andc(__m512i a, __m512i b)
+{
+    return _mm512_andnot_si512(b, a);
+}
+
+static inline __m512i avx512_orc(__m512i a, __m512i b)
+{
+    /* a | ~b */
+    return _mm512_ternarylogic_epi64(a, b, b, 0xf3);
+}
+
+static inline __m512i avx512_bitsel(__m512i a, __m512i b, __m512i c)
+{
+    /* (b & a) | (c & ~a) */
+    return _mm512_ternarylogic_epi64(a, b, c, 0xca);
+}
+
+#define GVEC_AVX512_DUP(NAME, TYPE, SET1)                               \
+static void NAME(void *d, intptr_t oprsz, TYPE c)                       \
+{                                                                       \
+    __m512i r = SET1(c);                                                \
+    intptr_t i;                                                         \
+    for (i = 0; i < oprsz; i += 64) {                                   \
+        _mm512_mask_storeu_epi64(d + i, avx512_mask(i, oprsz), r);      \
+    }                                                                   \
+}
+
+#define GVEC_AVX512_SHIFT(NAME, OP)                                     \
+static void NAME(void *d, void *a, intptr_t oprsz, int shift)           \
+{                                                                       \
+    __m128i count = _mm_cvtsi32_si128(shift);                           \
+    intptr_t i;                                                         \
+    for (i = 0; i < oprsz; i += 64) {                                   \
+        __mmask8 k = avx512_mask(i, oprsz);                             \
+        __m512i x = _mm512_maskz_loadu_epi64(k, a + i);                 \
+        _mm512_mask_storeu_epi64(d + i, k, OP(x, count));               \
+    }                                                                   \
+}
+
+#define GVEC_AVX512_3(NAME, OP)                                         \
+static void NAME(void *d, void *a, void *b, intptr_t oprsz)             \
+{                                                                       \
+    intptr_t i;                                                         \
+    for (i = 0; i < oprsz; i += 64) {                                   \
+        __mmask8 k = avx512_mask(i, oprsz);                             \
+        __m512i x = _mm512_maskz_loadu_epi64(k, a + i);                 \
+        __m512i y = _mm512_maskz_loadu_epi64(k, b + i);                 \
+        _mm512_mask_storeu_epi64(d + i, k, OP(x, y));                   \
+    }                                                                   \
+}
+
+#define GVEC_AVX512_4(NAME, OP)                                         \
+static void NAME(void *d, void *a, void *b, void *c, intptr_t oprsz)    \
+{                                                                       \
+    intptr_t i;                                                         \
+    for (i = 0; i < oprsz; i += 64) {                                   \
+        __mmask8 k = avx512_mask(i, oprsz);                             \
+        __m512i x = _mm512_maskz_loadu_epi64(k, a + i);                 \
+        __m512i y = _mm512_maskz_loadu_epi64(k, b + i);                 \
+        __m512i z = _mm512_maskz_loadu_epi64(k, c + i);                 \
+        _mm512_mask_storeu_epi64(d + i, k, OP(x, y, z));                \
+    }                                                                   \
+}
+
+/* Comparisons produce a mask that is expanded back to all-ones lanes */
+#define GVEC_AVX512_CMP(NAME, SZ, SU, PRED)                             \
+static inline __m512i NAME##_op(__m512i a, __m512i b)                   \
+{                                                                       \
+    return _mm512_maskz_set1_epi##SZ(                                   \
+        _mm512_cmp_ep##SU##SZ##_mask(a, b, PRED), -1);                  \
+}                                                                       \
+GVEC_AVX512_3(NAME, NAME##_op)
+
+#else
+#define have_avx512f false
+
+#define GVEC_AVX512_DUP(NAME, TYPE, SET1)                               \
+static void NAME(void *d, intptr_t oprsz, TYPE c)                       \
+{                                                                       \
+    g_assert_not_reached();                                             \
+}
+
+#define GVEC_AVX512_SHIFT(NAME, OP)                                     \
+static void NAME(void *d, void *a, intptr_t oprsz, int shift)           \
+{                                                                       \
+    g_assert_not_reached();                                             \
+}
+
+#define GVEC_AVX512_3(NAME, OP)                                         \
+static void NAME(void *d, void *a, void *b, intptr_t oprsz)             \
+{                                                                       \
+    g_assert_not_reached();                                             \
+}
+
+#define GVEC_AVX512_4(NAME, OP)                                         \
+static void NAME(void *d, void *a, void *b, void *c, intptr_t oprsz)    \
+{                                                                       \
+    g_assert_not_reached();                                             \
+}
+
+#define GVEC_AVX512_CMP(NAME, SZ, SU, PRED)  GVEC_AVX512_3(NAME, )
+#endif /* CONFIG_AVX512F_OPT */
+
+GVEC_AVX512_3(add32_avx512, _mm512_add_epi32)
+GVEC_AVX512_3(add64_avx512, _mm512_add_epi64)
+GVEC_AVX512_3(sub32_avx512, _mm512_sub_epi32)
+GVEC_AVX512_3(sub64_avx512, _mm512_sub_epi64)
+GVEC_AVX512_3(mul32_avx512, _mm512_mullo_epi32)
+GVEC_AVX512_3(and_avx512, _mm512_and_si512)
+GVEC_AVX512_3(or_avx512, _mm512_or_si512)
+GVEC_AVX512_3(xor_avx512, _mm512_xor_si512)
+GVEC_AVX512_3(andc_avx512, avx512_andc)
+GVEC_AVX512_3(orc_avx512, avx512_orc)
+GVEC_AVX512_4(bitsel_avx512, avx512_bitsel)
+GVEC_AVX512_DUP(dup32_avx512, uint32_t, _mm512_set1_epi32)
+GVEC_AVX512_DUP(dup64_avx512, uint64_t, _mm512_set1_epi64)
+GVEC_AVX512_SHIFT(shl32i_avx512, _mm512_sll_epi32)
+GVEC_AVX512_SHIFT(shl64i_avx512, _mm512_sll_epi64)
+GVEC_AVX512_SHIFT(shr32i_avx512, _mm512_srl_epi32)
+GVEC_AVX512_SHIFT(shr64i_avx512, _mm512_srl_epi64)
+GVEC_AVX512_SHIFT(sar32i_avx512, _mm512_sra_epi32)
+GVEC_AVX512_SHIFT(sar64i_avx512, _mm512_sra_epi64)
+
+#define GVEC_AVX512_CMP2(SZ)                                            \
+    GVEC_AVX512_CMP(eq##SZ##_avx512, SZ, i, _MM_CMPINT_EQ)              \
+    GVEC_AVX512_CMP(ne##SZ##_avx512, SZ, i, _MM_CMPINT_NE)              \
+    GVEC_AVX512_CMP(lt##SZ##_avx512, SZ, i, _MM_CMPINT_LT)              \
+    GVEC_AVX512_CMP(le##SZ##_avx512, SZ, i, _MM_CMPINT_LE)              \
+    GVEC_AVX512_CMP(ltu##SZ##_avx512, SZ, u, _MM_CMPINT_LT)             \
+    GVEC_AVX512_CMP(leu##SZ##_avx512, SZ, u, _MM_CMPINT_LE)
+
+GVEC_AVX512_CMP2(32)
+GVEC_AVX512_CMP2(64)
+
+#undef GVEC_AVX512_CMP2
+#undef GVEC_AVX512_CMP
+#undef GVEC_AVX512_4
+#undef GVEC_AVX512_3
+#undef GVEC_AVX512_SHIFT
+#undef GVEC_AVX512_DUP
+
+#ifdef CONFIG_AVX512F_OPT
+#pragma GCC pop_options
+#endif
+
+static inline bool use_avx512(intptr_t oprsz)
+{
+    return have_avx512f && oprsz >= 64;
+}
+
 void HELPER(gvec_add8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
@@ -63,8 +259,12 @@ void HELPER(gvec_add32)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) + *(uint32_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        add32_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+            *(uint32_t *)(d + i) = *(uint32_t *)(a + i) + *(uint32_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -74,8 +274,12 @@ void HELPER(gvec_add64)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) + *(uint64_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        add64_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) + *(uint64_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -151,8 +355,12 @@ void HELPER(gvec_sub32)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) - *(uint32_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        sub32_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+            *(uint32_t *)(d + i) = *(uint32_t *)(a + i) - *(uint32_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -162,8 +370,12 @@ void HELPER(gvec_sub64)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) - *(uint64_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        sub64_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) - *(uint64_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -239,8 +451,12 @@ void HELPER(gvec_mul32)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) * *(uint32_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        mul32_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+            *(uint32_t *)(d + i) = *(uint32_t *)(a + i) * *(uint32_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -407,6 +623,8 @@ void HELPER(gvec_dup64)(void *d, uint32_t desc, uint64_t c)
 
     if (c == 0) {
         oprsz = 0;
+    } else if (use_avx512(oprsz)) {
+        dup64_avx512(d, oprsz, c);
     } else {
         for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
             *(uint64_t *)(d + i) = c;
@@ -422,6 +640,8 @@ void HELPER(gvec_dup32)(void *d, uint32_t desc, uint32_t c)
 
     if (c == 0) {
         oprsz = 0;
+    } else if (use_avx512(oprsz)) {
+        dup32_avx512(d, oprsz, c);
     } else {
         for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
             *(uint32_t *)(d + i) = c;
@@ -456,8 +676,12 @@ void HELPER(gvec_and)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) & *(uint64_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        and_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) & *(uint64_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -467,8 +691,12 @@ void HELPER(gvec_or)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) | *(uint64_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        or_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) | *(uint64_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -478,8 +706,12 @@ void HELPER(gvec_xor)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) ^ *(uint64_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        xor_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) ^ *(uint64_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -489,8 +721,12 @@ void HELPER(gvec_andc)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) &~ *(uint64_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        andc_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) &~ *(uint64_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -500,8 +736,12 @@ void HELPER(gvec_orc)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) |~ *(uint64_t *)(b + i);
+    if (use_avx512(oprsz)) {
+        orc_avx512(d, a, b, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) |~ *(uint64_t *)(b + i);
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -602,8 +842,12 @@ void HELPER(gvec_shl32i)(void *d, void *a, uint32_t desc)
     int shift = simd_data(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) << shift;
+    if (use_avx512(oprsz)) {
+        shl32i_avx512(d, a, oprsz, shift);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+            *(uint32_t *)(d + i) = *(uint32_t *)(a + i) << shift;
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -614,8 +858,12 @@ void HELPER(gvec_shl64i)(void *d, void *a, uint32_t desc)
     int shift = simd_data(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) << shift;
+    if (use_avx512(oprsz)) {
+        shl64i_avx512(d, a, oprsz, shift);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) << shift;
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -650,8 +898,12 @@ void HELPER(gvec_shr32i)(void *d, void *a, uint32_t desc)
     int shift = simd_data(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) >> shift;
+    if (use_avx512(oprsz)) {
+        shr32i_avx512(d, a, oprsz, shift);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+            *(uint32_t *)(d + i) = *(uint32_t *)(a + i) >> shift;
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -662,8 +914,12 @@ void HELPER(gvec_shr64i)(void *d, void *a, uint32_t desc)
     int shift = simd_data(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) >> shift;
+    if (use_avx512(oprsz)) {
+        shr64i_avx512(d, a, oprsz, shift);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(uint64_t *)(d + i) = *(uint64_t *)(a + i) >> shift;
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -698,8 +954,12 @@ void HELPER(gvec_sar32i)(void *d, void *a, uint32_t desc)
     int shift = simd_data(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(int32_t *)(d + i) = *(int32_t *)(a + i) >> shift;
+    if (use_avx512(oprsz)) {
+        sar32i_avx512(d, a, oprsz, shift);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+            *(int32_t *)(d + i) = *(int32_t *)(a + i) >> shift;
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -710,8 +970,12 @@ void HELPER(gvec_sar64i)(void *d, void *a, uint32_t desc)
     int shift = simd_data(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(int64_t *)(d + i) = *(int64_t *)(a + i) >> shift;
+    if (use_avx512(oprsz)) {
+        sar64i_avx512(d, a, oprsz, shift);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            *(int64_t *)(d + i) = *(int64_t *)(a + i) >> shift;
+        }
     }
     clear_high(d, oprsz, desc);
 }
@@ -1004,32 +1268,42 @@ void HELPER(gvec_rotr64v)(void *d, void *a, void *b, uint32_t desc)
     clear_high(d, oprsz, desc);
 }
 
-#define DO_CMP1(NAME, TYPE, OP)                                            \
+#define DO_CMP1(NAME, TYPE, OP, AVX512)                                    \
 void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)                \
 {                                                                          \
+    gvec_avx512_3_fn *avx512 = AVX512;                                     \
     intptr_t oprsz = simd_oprsz(desc);                                     \
     intptr_t i;                                                            \
-    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                            \
-        *(TYPE *)(d + i) = -(*(TYPE *)(a + i) OP *(TYPE *)(b + i));        \
+    if (avx512 && use_avx512(oprsz)) {                                     \
+        avx512(d, a, b, oprsz);                                            \
+    } else {                                                               \
+        for (i = 0; i < oprsz; i += sizeof(TYPE)) {                        \
+            *(TYPE *)(d + i) = -(*(TYPE *)(a + i) OP *(TYPE *)(b + i));    \
+        }                                                                  \
     }                                                                      \
     clear_high(d, oprsz, desc);                                            \
 }
 
-#define DO_CMP2(SZ) \
-    DO_CMP1(gvec_eq##SZ, uint##SZ##_t, ==)    \
-    DO_CMP1(gvec_ne##SZ, uint##SZ##_t, !=)    \
-    DO_CMP1(gvec_lt##SZ, int##SZ##_t, <)      \
-    DO_CMP1(gvec_le##SZ, int##SZ##_t, <=)     \
-    DO_CMP1(gvec_ltu##SZ, uint##SZ##_t, <)    \
-    DO_CMP1(gvec_leu##SZ, uint##SZ##_t, <=)
+#define DO_CMP2(SZ, AVX) \
+    DO_CMP1(gvec_eq##SZ, uint##SZ##_t, ==, AVX(eq##SZ))    \
+    DO_CMP1(gvec_ne##SZ, uint##SZ##_t, !=, AVX(ne##SZ))    \
+    DO_CMP1(gvec_lt##SZ, int##SZ##_t, <, AVX(lt##SZ))      \
+    DO_CMP1(gvec_le##SZ, int##SZ##_t, <=, AVX(le##SZ))     \
+    DO_CMP1(gvec_ltu##SZ, uint##SZ##_t, <, AVX(ltu##SZ))   \
+    DO_CMP1(gvec_leu##SZ, uint##SZ##_t, <=, AVX(leu##SZ))
 
-DO_CMP2(8)
-DO_CMP2(16)
-DO_CMP2(32)
-DO_CMP2(64)
+#define NO_AVX512(NAME)  NULL
+#define AVX512(NAME)     NAME##_avx512
+
+DO_CMP2(8, NO_AVX512)
+DO_CMP2(16, NO_AVX512)
+DO_CMP2(32, AVX512)
+DO_CMP2(64, AVX512)
 
 #undef DO_CMP1
 #undef DO_CMP2
+#undef NO_AVX512
+#undef AVX512
 
 void HELPER(gvec_ssadd8)(void *d, void *a, void *b, uint32_t desc)
 {
@@ -1524,11 +1798,15 @@ void HELPER(gvec_bitsel)(void *d, void *a, void *b, void *c, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        uint64_t aa = *(uint64_t *)(a + i);
-        uint64_t bb = *(uint64_t *)(b + i);
-        uint64_t cc = *(uint64_t *)(c + i);
-        *(uint64_t *)(d + i) = (bb & aa) | (cc & ~aa);
+    if (use_avx512(oprsz)) {
+        bitsel_avx512(d, a, b, c, oprsz);
+    } else {
+        for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+            uint64_t aa = *(uint64_t *)(a + i);
+            uint64_t bb = *(uint64_t *)(b + i);
+            uint64_t cc = *(uint64_t *)(c + i);
+            *(uint64_t *)(d + i) = (bb & aa) | (cc & ~aa);
+        }
     }
     clear_high(d, oprsz, desc);
 }
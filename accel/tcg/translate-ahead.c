@@ -0,0 +1,232 @@
+/*
+ * Translation of static successors ahead of execution, for user mode
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * When a vCPU translates a TB, the static destinations of its direct
+ * branches are queued here.  Worker threads translate them and insert
+ * them in the TB hash table, so that the vCPU finds them there instead
+ * of stopping to translate them when it gets to them.
+ *
+ * In user mode all translation uses the same TCGContext and is
+ * serialized by mmap_lock.  The workers take the lock too, which also
+ * keeps the guest mappings stable while they fetch code; the queue is
+ * protected by it as well.
+ *
+ * A TB only depends on its pc, cs_base, flags and cflags and on guest
+ * code, so a TB translated ahead is no different from one translated
+ * by the vCPU.  The successor is assumed to start with the same
+ * cs_base, flags and cflags as the TB that branches to it; if it does
+ * not, the TB is simply never found.
+ *
+ * Front ends also read the CPU state that they are given, e.g. the
+ * enabled extensions, which the vCPU may change while it runs.  The
+ * workers therefore translate with a copy of the vCPU, taken by the
+ * vCPU itself each time it queues requests.
+ *
+ * Code is fetched outside the vCPU thread, where a fault could not be
+ * delivered to the guest: the workers run with all signals blocked and
+ * without thread_cpu.  PAGE_EXEC does not rule out a SIGBUS, e.g. past
+ * the end of a mapped file, so a TB is translated ahead only if both
+ * its page and the next one are anonymous memory or already hold code
+ * that a vCPU has fetched.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/memalign.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+#include "internal.h"
+#include "trace.h"
+
+#define AHEAD_QUEUE_SIZE 64
+
+typedef struct AheadRequest {
+    CPUState *cpu;      /* NULL if the vCPU has exited */
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} AheadRequest;
+
+static int ahead_threads;
+static QemuSemaphore ahead_sem;
+
+/*
+ * Protected by mmap_lock.  Requests are served newest first, since
+ * the vCPU is most likely to be executing the TB that queued them;
+ * when the queue is full, the oldest request is dropped.
+ */
+static AheadRequest ahead_queue[AHEAD_QUEUE_SIZE];
+static unsigned ahead_head, ahead_tail;
+
+/* Copies of the vCPUs that queued requests, protected by mmap_lock. */
+static GHashTable *ahead_snapshots;
+
+/* Called with mmap_lock held, on the thread of @cpu. */
+static void translate_ahead_snapshot(CPUState *cpu)
+{
+    ArchCPU *snap = g_hash_table_lookup(ahead_snapshots, cpu);
+
+    if (!snap) {
+        snap = qemu_memalign(__alignof__(ArchCPU), sizeof(ArchCPU));
+        g_hash_table_insert(ahead_snapshots, cpu, snap);
+    }
+    memcpy(snap, env_archcpu(cpu->env_ptr), sizeof(ArchCPU));
+    cpu_set_cpustate_pointers(snap);
+}
+
+/* Called with mmap_lock held, after @cpu translated @tb. */
+void translate_ahead_queue(CPUState *cpu, TranslationBlock *tb)
+{
+    int i;
+
+    if (!ahead_threads || tb_cflags(tb) != curr_cflags(cpu)) {
+        return;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Plugins would be told about TBs that may never be executed. */
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS, cpu->plugin_mask)) {
+        return;
+    }
+#endif
+
+    if (tcg_ctx->nb_goto_tb_dest) {
+        translate_ahead_snapshot(cpu);
+    }
+    for (i = 0; i < tcg_ctx->nb_goto_tb_dest; i++) {
+        target_ulong dest = tcg_ctx->goto_tb_dest[i];
+
+        if (dest == tb->pc) {
+            continue;
+        }
+        if (ahead_head - ahead_tail == AHEAD_QUEUE_SIZE) {
+            ahead_tail++;
+        }
+        ahead_queue[ahead_head++ % AHEAD_QUEUE_SIZE] = (AheadRequest) {
+            .cpu = cpu,
+            .pc = dest,
+            .cs_base = tb->cs_base,
+            .flags = tb->flags,
+            .cflags = tb_cflags(tb),
+        };
+        qemu_sem_post(&ahead_sem);
+    }
+}
+
+/* Forget the requests of @cpu, which is going away. */
+void translate_ahead_cpu_exit(CPUState *cpu)
+{
+    unsigned i;
+
+    if (!ahead_threads) {
+        return;
+    }
+
+    /* Workers hold mmap_lock while they use a request. */
+    mmap_lock();
+    for (i = ahead_tail; i != ahead_head; i++) {
+        if (ahead_queue[i % AHEAD_QUEUE_SIZE].cpu == cpu) {
+            ahead_queue[i % AHEAD_QUEUE_SIZE].cpu = NULL;
+        }
+    }
+    g_hash_table_remove(ahead_snapshots, cpu);
+    mmap_unlock();
+}
+
+/* Whether fetching code from the page at @addr cannot fault. */
+static bool translate_ahead_page_ok(target_ulong addr)
+{
+    int flags = page_get_flags(addr);
+
+    if (!(flags & PAGE_EXEC)) {
+        return false;
+    }
+    return (flags & PAGE_ANON) || page_has_tbs(addr);
+}
+
+static void translate_ahead_one(AheadRequest *req)
+{
+    target_ulong next_page = (req->pc & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+    ArchCPU *snap = g_hash_table_lookup(ahead_snapshots, req->cpu);
+    CPUState *cpu = env_cpu(&snap->env);
+    TranslationBlock *tb;
+
+    if (!translate_ahead_page_ok(req->pc) ||
+        !translate_ahead_page_ok(next_page)) {
+        return;
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        tb = tb_htable_lookup(cpu, req->pc, req->cs_base,
+                              req->flags, req->cflags);
+    }
+    if (tb) {
+        return;
+    }
+
+    tb = tb_gen_code_ahead(cpu, req->pc, req->cs_base,
+                           req->flags, req->cflags);
+    if (tb) {
+        trace_translate_ahead(tb, req->pc);
+    }
+}
+
+static void *translate_ahead_thread(void *arg)
+{
+    rcu_register_thread();
+    tcg_register_thread();
+
+    while (true) {
+        qemu_sem_wait(&ahead_sem);
+
+        mmap_lock();
+        if (ahead_head != ahead_tail) {
+            AheadRequest *req;
+
+            req = &ahead_queue[--ahead_head % AHEAD_QUEUE_SIZE];
+
+            if (req->cpu) {
+                translate_ahead_one(req);
+            }
+        }
+        mmap_unlock();
+    }
+    return NULL;
+}
+
+void translate_ahead_init(int threads)
+{
+    int i;
+
+    ahead_threads = threads;
+    qemu_sem_init(&ahead_sem, 0);
+    if (!ahead_snapshots) {
+        ahead_snapshots = g_hash_table_new_full(NULL, NULL, NULL,
+                                                qemu_vfree);
+    }
+    for (i = 0; i < threads; i++) {
+        QemuThread thread;
+
+        qemu_thread_create(&thread, "translate-ahead",
+                           translate_ahead_thread, NULL,
+                           QEMU_THREAD_DETACHED);
+    }
+}
+
+/* Called with mmap_lock held, see fork_start. */
+void translate_ahead_fork_end(int child)
+{
+    if (child && ahead_threads) {
+        /* The workers did not survive the fork; start new ones. */
+        ahead_head = ahead_tail = 0;
+        g_hash_table_remove_all(ahead_snapshots);
+        translate_ahead_init(ahead_threads);
+    }
+}
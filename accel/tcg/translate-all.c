@@ -47,6 +47,7 @@
 #include "exec/cputlb.h"
 #include "exec/translate-all.h"
 #include "qemu/bitmap.h"
+#include "qemu/interval-tree.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
@@ -58,8 +59,10 @@
 #include "qapi/error.h"
 #include "hw/core/tcg-cpu-ops.h"
 #include "tb-hash.h"
+#include "tb-jmp-cache.h"
 #include "tb-context.h"
 #include "internal.h"
+#include "tb-stats.h"
 
 /* #define DEBUG_TB_INVALIDATE */
 /* #define DEBUG_TB_FLUSH */
@@ -103,16 +106,26 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+#ifdef CONFIG_SOFTMMU
+/*
+ * Bitmap of the bytes of a page that are covered by TBs.  It is freed
+ * with RCU, so that writers can consult it without taking the page lock.
+ */
+typedef struct PageCodeBitmap {
+    struct rcu_head rcu;
+    unsigned long bits[];
+} PageCodeBitmap;
+#endif
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
 #ifdef CONFIG_SOFTMMU
     /* in order to optimize self modifying code, we count the number
        of lookups we do to a given page to use a bitmap */
-    unsigned long *code_bitmap;
+    PageCodeBitmap *code_bitmap;
     unsigned int code_write_count;
 #else
-    unsigned long flags;
     void *target_data;
 #endif
 #ifndef CONFIG_USER_ONLY
@@ -911,8 +924,12 @@ static inline void invalidate_page_bitmap(PageDesc *p)
 {
     assert_page_locked(p);
 #ifdef CONFIG_SOFTMMU
-    g_free(p->code_bitmap);
-    p->code_bitmap = NULL;
+    if (p->code_bitmap) {
+        PageCodeBitmap *bitmap = p->code_bitmap;
+
+        qatomic_set(&p->code_bitmap, NULL);
+        g_free_rcu(bitmap, rcu);
+    }
     p->code_write_count = 0;
 #endif
 }
@@ -961,19 +978,47 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-/* flush all the translation blocks */
-static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
+/* Unlink a TB of a region that is being evicted */
+static void tb_evict(TranslationBlock *tb)
 {
+    tb_phys_invalidate(tb, -1);
+}
+
+/*
+ * Number of full flushes or, with @evict, of full flushes and evictions.
+ * An explicit tb_flush() must not be skipped because of an eviction,
+ * which leaves the TBs of the other regions live.
+ */
+static unsigned tb_flush_generation(bool evict)
+{
+    unsigned count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+
+    if (evict) {
+        count += qatomic_mb_read(&tb_ctx.tb_evict_count);
+    }
+    return count;
+}
+
+/*
+ * Flush all the translation blocks or, if @evict is set, only those
+ * in the oldest regions of the buffer.
+ */
+static void tb_flush_common(run_on_cpu_data tb_flush_count, bool evict)
+{
+    CPUState *cpu;
     bool did_flush = false;
+    size_t n_evicted = 0;
+    int64_t start, stall;
 
     mmap_lock();
     /* If it is already been done on request of another CPU,
      * just retry.
      */
-    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
+    if (tb_flush_generation(evict) != tb_flush_count.host_int) {
         goto done;
     }
     did_flush = true;
+    start = get_clock();
 
     if (DEBUG_TB_FLUSH_GATE) {
         size_t nb_tbs = tcg_nb_tbs();
@@ -984,39 +1029,90 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
                tcg_code_size(), nb_tbs, nb_tbs > 0 ? host_size / nb_tbs : 0);
     }
 
-    CPU_FOREACH(cpu) {
-        cpu_tb_jmp_cache_clear(cpu);
+    /*
+     * The callback data that plugins attach to TBs is only freed by
+     * qemu_plugin_flush_cb(), which must see every TB gone.  With
+     * plugins, do a full flush instead.
+     */
+    if (evict && !qemu_plugin_loaded()) {
+        qemu_thread_jit_write();
+        n_evicted = tcg_region_evict(tb_evict);
+        qemu_thread_jit_execute();
     }
 
-    qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
-    page_flush_tb();
+    if (!n_evicted) {
+        CPU_FOREACH(cpu) {
+            cpu_tb_jmp_cache_clear(cpu);
+        }
+
+        qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
+        page_flush_tb();
 
-    tcg_region_reset_all();
+        tcg_region_reset_all();
+    }
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
-    qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
+    if (n_evicted) {
+        qatomic_mb_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+    } else {
+        qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
+    }
+
+    stall = get_clock() - start;
+    stat64_add(&tb_ctx.tb_flush_stall_ns, stall);
+    if (n_evicted) {
+        trace_tb_evict(n_evicted, stall);
+    } else {
+        trace_tb_flush(stall);
+    }
 
 done:
     mmap_unlock();
-    if (did_flush) {
+    /* Only a full flush gets here with plugins loaded */
+    if (did_flush && !n_evicted) {
         qemu_plugin_flush_cb();
     }
 }
 
-void tb_flush(CPUState *cpu)
+static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    tb_flush_common(tb_flush_count, false);
+}
+
+static void do_tb_flush_full_buffer(CPUState *cpu,
+                                    run_on_cpu_data tb_flush_count)
+{
+    tb_flush_common(tb_flush_count, true);
+}
+
+static void tb_flush_with(CPUState *cpu, run_on_cpu_func func, bool evict)
 {
     if (tcg_enabled()) {
-        unsigned tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+        unsigned tb_flush_count = tb_flush_generation(evict);
 
         if (cpu_in_exclusive_context(cpu)) {
-            do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+            func(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
         } else {
-            async_safe_run_on_cpu(cpu, do_tb_flush,
+            async_safe_run_on_cpu(cpu, func,
                                   RUN_ON_CPU_HOST_INT(tb_flush_count));
         }
     }
 }
 
+void tb_flush(CPUState *cpu)
+{
+    tb_flush_with(cpu, do_tb_flush, false);
+}
+
+/*
+ * Make room in a full translation buffer.  Unlike tb_flush(), this may
+ * keep the TBs that were generated most recently.
+ */
+static void tb_flush_full_buffer(CPUState *cpu)
+{
+    tb_flush_with(cpu, do_tb_flush_full_buffer, true);
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1171,7 +1267,6 @@ static inline void tb_jmp_unlink(TranslationBlock *dest)
  */
 static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 {
-    CPUState *cpu;
     PageDesc *p;
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -1204,13 +1299,8 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
         }
     }
 
-    /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
-    CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
-        }
-    }
+    /* remove the TB from the jump caches */
+    tb_jmp_cache_remove(tb);
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -1251,9 +1341,11 @@ static void build_page_bitmap(PageDesc *p)
 {
     int n, tb_start, tb_end;
     TranslationBlock *tb;
+    PageCodeBitmap *bitmap;
 
     assert_page_locked(p);
-    p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    bitmap = g_malloc0(sizeof(PageCodeBitmap) +
+                       BITS_TO_LONGS(TARGET_PAGE_SIZE) * sizeof(long));
 
     PAGE_FOR_EACH_TB(p, tb, n) {
         /* NOTE: this is subtle as a TB may span two physical pages */
@@ -1269,8 +1361,9 @@ static void build_page_bitmap(PageDesc *p)
             tb_start = 0;
             tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
         }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+        bitmap_set(bitmap->bits, tb_start, tb_end - tb_start);
     }
+    qatomic_rcu_set(&p->code_bitmap, bitmap);
 }
 #endif
 
@@ -1298,7 +1391,7 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
 
 #if defined(CONFIG_USER_ONLY)
     /* translator_loop() must have made all TB pages non-writable */
-    assert(!(p->flags & PAGE_WRITE));
+    assert(!(page_get_flags(page_addr) & PAGE_WRITE));
 #else
     /* if some code is already present, then the pages are already
        protected. So we handle the case where only the first TB is
@@ -1377,10 +1470,16 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              target_ulong pc, target_ulong cs_base,
-                              uint32_t flags, int cflags)
+/*
+ * Called with mmap_lock held for user mode emulation.  If @ahead is
+ * set, the caller is not @cpu's thread and NULL is returned instead of
+ * flushing the buffer when it is full.
+ */
+static TranslationBlock *tb_gen_code_common(CPUState *cpu,
+                                            target_ulong pc,
+                                            target_ulong cs_base,
+                                            uint32_t flags, int cflags,
+                                            bool ahead)
 {
     CPUArchState *env = cpu->env_ptr;
     TranslationBlock *tb, *existing_tb;
@@ -1388,6 +1487,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+    int64_t stats_start = 0;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1409,11 +1509,19 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     QEMU_BUILD_BUG_ON(CF_COUNT_MASK + 1 != TCG_MAX_INSNS);
 
+    if (tb_stats_enabled) {
+        stats_start = get_clock();
+    }
+
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
+        if (ahead) {
+            /* Leave the flush to the next vCPU that needs a TB. */
+            return NULL;
+        }
         /* flush must be done */
-        tb_flush(cpu);
+        tb_flush_full_buffer(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1427,6 +1535,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->tb_stats = NULL;
+    if (tb_stats_enabled && phys_pc != -1) {
+        tb->tb_stats = tb_stats_get(phys_pc, pc, cs_base, flags);
+    }
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1444,6 +1556,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_func_start(tcg_ctx);
 
     tcg_ctx->cpu = env_cpu(env);
+    tcg_ctx->nb_goto_tb_dest = 0;
     gen_intermediate_code(cpu, tb, max_insns);
     assert(tb->size != 0);
     tcg_ctx->cpu = NULL;
@@ -1517,6 +1630,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     tb->tc.size = gen_code_size;
 
+    if (tb->tb_stats) {
+        tb_stats_record_translation(tb, get_clock() - stats_start);
+    }
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
     qatomic_set(&prof->code_in_len, prof->code_in_len + tb->size);
@@ -1657,9 +1774,38 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         tcg_tb_remove(tb);
         return existing_tb;
     }
+#ifdef CONFIG_USER_ONLY
+    if (!ahead) {
+        translate_ahead_queue(cpu, tb);
+    }
+#endif
     return tb;
 }
 
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              target_ulong pc, target_ulong cs_base,
+                              uint32_t flags, int cflags)
+{
+    return tb_gen_code_common(cpu, pc, cs_base, flags, cflags, false);
+}
+
+#ifdef CONFIG_USER_ONLY
+TranslationBlock *tb_gen_code_ahead(CPUState *cpu,
+                                    target_ulong pc, target_ulong cs_base,
+                                    uint32_t flags, int cflags)
+{
+    return tb_gen_code_common(cpu, pc, cs_base, flags, cflags, true);
+}
+
+/* Called with mmap_lock held. */
+bool page_has_tbs(target_ulong addr)
+{
+    PageDesc *p = page_find(addr >> TARGET_PAGE_BITS);
+
+    return p && p->first_tb;
+}
+#endif
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -1812,6 +1958,38 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
 }
 
 #ifdef CONFIG_SOFTMMU
+static bool page_bitmap_test(PageCodeBitmap *bitmap, tb_page_addr_t start,
+                             int len)
+{
+    unsigned int nr = start & ~TARGET_PAGE_MASK;
+    unsigned long b;
+
+    b = bitmap->bits[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+    return b & ((1 << len) - 1);
+}
+
+/*
+ * Return false if a write of @len bytes at @start is known not to
+ * touch any translated code, in which case there is no need to call
+ * tb_invalidate_phys_page_fast().  This does not take any lock, so it
+ * can only rule out writes to pages that already have a code bitmap.
+ * The same constraints on @start and @len apply.
+ *
+ * Called within an RCU read-side critical section.
+ */
+bool tb_invalidate_phys_page_needed(tb_page_addr_t start, int len)
+{
+    PageCodeBitmap *bitmap;
+    PageDesc *p;
+
+    p = page_find(start >> TARGET_PAGE_BITS);
+    if (!p) {
+        return false;
+    }
+    bitmap = qatomic_rcu_read(&p->code_bitmap);
+    return !bitmap || page_bitmap_test(bitmap, start, len);
+}
+
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
  * iothread mutex not held.
@@ -1837,12 +2015,7 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
         build_page_bitmap(p);
     }
     if (p->code_bitmap) {
-        unsigned int nr;
-        unsigned long b;
-
-        nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
-        if (b & ((1 << len) - 1)) {
+        if (page_bitmap_test(p->code_bitmap, start, len)) {
             goto do_invalidate;
         }
     } else {
@@ -2075,7 +2248,8 @@ void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, miss, victim_hit;
+    size_t victim_overflow_hit, jc_hits, jc_misses;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2114,6 +2288,10 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB evict count      %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
+    g_string_append_printf(buf, "TB flush stall time %" PRIu64 " us\n",
+                           stat64_get(&tb_ctx.tb_flush_stall_ns) / SCALE_US);
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
@@ -2121,6 +2299,22 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    tlb_miss_counts(&miss, &victim_hit, &victim_overflow_hit);
+    g_string_append_printf(buf, "TLB misses          %zu\n", miss);
+    g_string_append_printf(buf, "TLB victim hits     %zu (%zu%%)\n",
+                           victim_hit, miss ? (victim_hit * 100) / miss : 0);
+    g_string_append_printf(buf, "TLB overflow hits   %zu (%zu%%)\n",
+                           victim_overflow_hit, miss ?
+                           (victim_overflow_hit * 100) / miss : 0);
+
+    tb_jmp_cache_counts(&jc_hits, &jc_misses);
+    g_string_append_printf(buf, "jump cache entries  %u\n",
+                           1u << tb_jmp_cache_bits);
+    g_string_append_printf(buf, "jump cache hits     %zu (%zu%%)\n", jc_hits,
+                           jc_hits + jc_misses ?
+                           (jc_hits * 100) / (jc_hits + jc_misses) : 0);
+    g_string_append_printf(buf, "jump cache misses   %zu\n", jc_misses);
     tcg_dump_info(buf);
 }
 
@@ -2134,91 +2328,257 @@ void cpu_interrupt(CPUState *cpu, int mask)
 }
 
 /*
- * Walks guest process memory "regions" one by one
- * and calls callback function 'fn' for each region.
+ * In user-mode emulation, the page flags are kept in an interval tree of
+ * disjoint ranges of pages that share the same flags, rather than in the
+ * PageDesc of every page.  A mapping costs a single node whatever its
+ * size.  mmap, munmap and mprotect take time logarithmic in the number
+ * of mappings, plus linear in the number of mappings they change and
+ * of pages that hold translated code, instead of linear in the number
+ * of pages they touch.
+ *
+ * The tree is only modified with the mmap_lock held.  Lookups made
+ * without it may miss a range while the tree is being modified, so
+ * they are repeated with the lock held before reporting a page as
+ * unmapped.
  */
-struct walk_memory_regions_data {
-    walk_memory_regions_fn fn;
-    void *priv;
+typedef struct PageFlagsNode {
+    struct rcu_head rcu;
+    IntervalTreeNode itree;
+    int flags;
+} PageFlagsNode;
+
+typedef struct PageFlagsRange {
     target_ulong start;
-    int prot;
-};
+    target_ulong last;
+    int flags;
+} PageFlagsRange;
+
+static IntervalTreeRoot pageflags_root;
+
+/* Set once some page gets target data, which then has to be reset. */
+static bool page_target_data_used;
+
+static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
+{
+    IntervalTreeNode *n;
+
+    n = interval_tree_iter_first(&pageflags_root, start, last);
+    return n ? container_of(n, PageFlagsNode, itree) : NULL;
+}
 
-static int walk_memory_regions_end(struct walk_memory_regions_data *data,
-                                   target_ulong end, int new_prot)
+static PageFlagsNode *pageflags_next(PageFlagsNode *p, target_ulong start,
+                                     target_ulong last)
 {
-    if (data->start != -1u) {
-        int rc = data->fn(data->priv, data->start, end, data->prot);
-        if (rc != 0) {
-            return rc;
+    IntervalTreeNode *n;
+
+    n = interval_tree_iter_next(&p->itree, start, last);
+    return n ? container_of(n, PageFlagsNode, itree) : NULL;
+}
+
+/* Append [start, last] to @ranges, merging it with the previous range. */
+static void pageflags_add_range(GArray *ranges, target_ulong start,
+                                target_ulong last, int flags)
+{
+    PageFlagsRange *prev;
+
+    if (ranges->len) {
+        prev = &g_array_index(ranges, PageFlagsRange, ranges->len - 1);
+        if (prev->flags == flags && prev->last + 1 == start) {
+            prev->last = last;
+            return;
         }
     }
+    g_array_append_vals(ranges, &(PageFlagsRange){ start, last, flags }, 1);
+}
+
+/*
+ * Invalidate the TBs in the pages [first, last] below @lp, a table @level
+ * levels above the PageDescs whose first page is @base.  Like the tables
+ * themselves, the walk only goes where code has been translated.
+ */
+static void pageflags_invalidate_1(void **lp, int level, uint64_t base,
+                                   uint64_t first, uint64_t last)
+{
+    void *p = qatomic_rcu_read(lp);
+    int shift = level * V_L2_BITS;
+    uint64_t i, i_first, i_last;
 
-    data->start = (new_prot ? end : -1u);
-    data->prot = new_prot;
+    if (p == NULL) {
+        return;
+    }
+    i_first = first > base ? (first - base) >> shift : 0;
+    i_last = MIN(last - base, ((uint64_t)V_L2_SIZE << shift) - 1) >> shift;
 
-    return 0;
+    if (level == 0) {
+        PageDesc *pd = p;
+
+        for (i = i_first; i <= i_last; i++) {
+            if (pd[i].first_tb) {
+                tb_invalidate_phys_page((base + i) << TARGET_PAGE_BITS, 0);
+            }
+        }
+    } else {
+        void **pp = p;
+
+        for (i = i_first; i <= i_last; i++) {
+            pageflags_invalidate_1(pp + i, level - 1, base + (i << shift),
+                                   first, last);
+        }
+    }
 }
 
-static int walk_memory_regions_1(struct walk_memory_regions_data *data,
-                                 target_ulong base, int level, void **lp)
+/* Invalidate the TBs in the pages of [start, last]. */
+static void pageflags_invalidate(target_ulong start, target_ulong last)
 {
-    target_ulong pa;
-    int i, rc;
+    uint64_t first = start >> TARGET_PAGE_BITS;
+    uint64_t last_page = MIN((uint64_t)last >> TARGET_PAGE_BITS,
+                             ((uint64_t)v_l1_size << v_l1_shift) - 1);
+    uint64_t i;
 
-    if (*lp == NULL) {
-        return walk_memory_regions_end(data, base, 0);
+    for (i = first >> v_l1_shift; i <= last_page >> v_l1_shift; i++) {
+        pageflags_invalidate_1(l1_map + i, v_l2_levels, i << v_l1_shift,
+                               first, last_page);
     }
+}
 
-    if (level == 0) {
-        PageDesc *pd = *lp;
+/*
+ * Change the flags of the pages in [start, last]: mapped pages get
+ * (flags & ~clear) | set and unmapped ones get @fill, with 0 meaning
+ * unmapped.  Ranges that end up next to a range with the same flags,
+ * including the ones just outside [start, last], are merged with it.
+ *
+ * TBs can only exist in pages that are not writable.  They are
+ * invalidated when such a page becomes writable or, if @replace, when
+ * its contents are replaced or unmapped.
+ */
+static void pageflags_set_clear(target_ulong start, target_ulong last,
+                                int set, int clear, int fill, bool replace)
+{
+    g_autoptr(GPtrArray) old = g_ptr_array_new();
+    g_autoptr(GArray) ranges = g_array_new(false, false,
+                                           sizeof(PageFlagsRange));
+    target_ulong qstart = start ? start - 1 : start;
+    target_ulong qlast = last + 1 ? last + 1 : last;
+    target_ulong next = start;
+    bool done = false, changed = false;
+    PageFlagsNode *p;
+    guint i;
 
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            int prot = pd[i].flags;
+    assert_memory_lock();
 
-            pa = base | (i << TARGET_PAGE_BITS);
-            if (prot != data->prot) {
-                rc = walk_memory_regions_end(data, pa, prot);
-                if (rc != 0) {
-                    return rc;
-                }
+    /* Collect the ranges overlapping or adjacent to [start, last]. */
+    for (p = pageflags_find(qstart, qlast); p;
+         p = pageflags_next(p, qstart, qlast)) {
+        g_ptr_array_add(old, p);
+    }
+
+    for (i = 0; i < old->len; i++) {
+        target_ulong s, l;
+        int f, nf;
+
+        p = g_ptr_array_index(old, i);
+        s = p->itree.start;
+        l = p->itree.last;
+        f = p->flags;
+
+        if (s < start) {
+            pageflags_add_range(ranges, s, MIN(l, start - 1), f);
+            if (l < start) {
+                continue;
             }
+            s = start;
         }
-    } else {
-        void **pp = *lp;
+        if (!done && next < s) {
+            /* A hole inside [start, last]. */
+            changed |= fill != 0;
+            if (s - 1 >= last) {
+                pageflags_add_range(ranges, next, last, fill);
+                done = true;
+            } else {
+                pageflags_add_range(ranges, next, s - 1, fill);
+                next = s;
+            }
+        }
+        if (s <= last) {
+            target_ulong il = MIN(l, last);
 
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            pa = base | ((target_ulong)i <<
-                (TARGET_PAGE_BITS + V_L2_BITS * level));
-            rc = walk_memory_regions_1(data, pa, level - 1, pp + i);
-            if (rc != 0) {
-                return rc;
+            nf = (f & ~clear) | set;
+            changed |= nf != f;
+            if (!(f & PAGE_WRITE) && (replace || (nf & PAGE_WRITE))) {
+                pageflags_invalidate(s, il);
+            }
+            pageflags_add_range(ranges, s, il, nf);
+            if (il == last) {
+                done = true;
+            } else {
+                next = il + 1;
+            }
+            if (l == il) {
+                continue;
             }
+            s = il + 1;
         }
+        pageflags_add_range(ranges, s, l, f);
+    }
+    if (!done) {
+        changed |= fill != 0;
+        pageflags_add_range(ranges, next, last, fill);
     }
 
-    return 0;
+    if (!changed) {
+        return;
+    }
+
+    for (i = 0; i < old->len; i++) {
+        p = g_ptr_array_index(old, i);
+        interval_tree_remove(&p->itree, &pageflags_root);
+        g_free_rcu(p, rcu);
+    }
+    for (i = 0; i < ranges->len; i++) {
+        PageFlagsRange *r = &g_array_index(ranges, PageFlagsRange, i);
+
+        if (r->flags) {
+            p = g_new(PageFlagsNode, 1);
+            p->itree.start = r->start;
+            p->itree.last = r->last;
+            p->flags = r->flags;
+            interval_tree_insert(&p->itree, &pageflags_root);
+        }
+    }
 }
 
+/*
+ * Walks guest process memory "regions" one by one
+ * and calls callback function 'fn' for each region.
+ */
 int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
 {
-    struct walk_memory_regions_data data;
-    uintptr_t i, l1_sz = v_l1_size;
+    PageFlagsNode *p;
+    target_ulong start = 0, end = 0;
+    int prot = 0, rc = 0;
 
-    data.fn = fn;
-    data.priv = priv;
-    data.start = -1u;
-    data.prot = 0;
-
-    for (i = 0; i < l1_sz; i++) {
-        target_ulong base = i << (v_l1_shift + TARGET_PAGE_BITS);
-        int rc = walk_memory_regions_1(&data, base, v_l2_levels, l1_map + i);
-        if (rc != 0) {
-            return rc;
+    mmap_lock();
+    for (p = pageflags_find(0, -1); p; p = pageflags_next(p, 0, -1)) {
+        if (prot) {
+            if (p->itree.start == end && p->flags == prot) {
+                end = p->itree.last + 1;
+                continue;
+            }
+            rc = fn(priv, start, end, prot);
+            if (rc != 0) {
+                break;
+            }
         }
+        start = p->itree.start;
+        end = p->itree.last + 1;
+        prot = p->flags;
+    }
+    if (prot && rc == 0) {
+        rc = fn(priv, start, end, prot);
     }
+    mmap_unlock();
 
-    return walk_memory_regions_end(&data, 0, 0);
+    return rc;
 }
 
 static int dump_region(void *priv, target_ulong start,
@@ -2247,13 +2607,42 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageDesc *p;
+    PageFlagsNode *p;
+    int flags;
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
+    WITH_RCU_READ_LOCK_GUARD() {
+        p = pageflags_find(address, address);
+        if (p) {
+            return p->flags;
+        }
+    }
+
+    /* The lockless lookup may have raced with an update, try again. */
+    if (have_mmap_lock()) {
         return 0;
     }
-    return p->flags;
+    mmap_lock();
+    p = pageflags_find(address, address);
+    flags = p ? p->flags : 0;
+    mmap_unlock();
+    return flags;
+}
+
+static void page_reset_target_data(target_ulong start, target_ulong last)
+{
+    target_ulong addr;
+
+    for (addr = start; ; addr += TARGET_PAGE_SIZE) {
+        PageDesc *p = page_find(addr >> TARGET_PAGE_BITS);
+
+        if (p) {
+            g_free(p->target_data);
+            p->target_data = NULL;
+        }
+        if (last - addr < TARGET_PAGE_SIZE) {
+            break;
+        }
+    }
 }
 
 /* Modify the flags of a page and invalidate the code if necessary.
@@ -2261,8 +2650,8 @@ int page_get_flags(target_ulong address)
    on PAGE_WRITE.  The mmap_lock should already be held.  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
-    target_ulong addr, len;
-    bool reset_target_data;
+    target_ulong last;
+    bool reset;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2274,34 +2663,22 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     assert_memory_lock();
 
     start = start & TARGET_PAGE_MASK;
-    end = TARGET_PAGE_ALIGN(end);
+    last = TARGET_PAGE_ALIGN(end) - 1;
 
     if (flags & PAGE_WRITE) {
         flags |= PAGE_WRITE_ORG;
     }
-    reset_target_data = !(flags & PAGE_VALID) || (flags & PAGE_RESET);
+    reset = !(flags & PAGE_VALID) || (flags & PAGE_RESET);
     flags &= ~PAGE_RESET;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
-
-        /* If the write protection bit is set, then we invalidate
-           the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0);
-        }
-        if (reset_target_data) {
-            g_free(p->target_data);
-            p->target_data = NULL;
-            p->flags = flags;
-        } else {
-            /* Using mprotect on a page does not change MAP_ANON. */
-            p->flags = (p->flags & PAGE_ANON) | flags;
+    if (reset) {
+        if (page_target_data_used) {
+            page_reset_target_data(start, last);
         }
+        pageflags_set_clear(start, last, flags, -1, flags, true);
+    } else {
+        /* Using mprotect on a page does not change MAP_ANON. */
+        pageflags_set_clear(start, last, flags, ~PAGE_ANON, flags, false);
     }
 }
 
@@ -2313,13 +2690,15 @@ void *page_get_target_data(target_ulong address)
 
 void *page_alloc_target_data(target_ulong address, size_t size)
 {
-    PageDesc *p = page_find(address >> TARGET_PAGE_BITS);
+    PageDesc *p;
     void *ret = NULL;
 
-    if (p->flags & PAGE_VALID) {
+    if (page_get_flags(address) & PAGE_VALID) {
+        p = page_find_alloc(address >> TARGET_PAGE_BITS, 1);
         ret = p->target_data;
         if (!ret) {
             p->target_data = ret = g_malloc0(size);
+            page_target_data_used = true;
         }
     }
     return ret;
@@ -2327,9 +2706,10 @@ void *page_alloc_target_data(target_ulong address, size_t size)
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
-    target_ulong end;
-    target_ulong addr;
+    PageFlagsNode *p;
+    target_ulong last;
+    bool locked, unlock = false;
+    int ret = -1;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2341,53 +2721,92 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     if (len == 0) {
         return 0;
     }
-    if (start + len - 1 < start) {
+    last = start + len - 1;
+    if (last < start) {
         /* We've wrapped around.  */
         return -1;
     }
 
-    /* must do before we loose bits in the next step */
-    end = TARGET_PAGE_ALIGN(start + len);
-    start = start & TARGET_PAGE_MASK;
+    RCU_READ_LOCK_GUARD();
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if (!p) {
-            return -1;
+    locked = have_mmap_lock();
+    while (true) {
+        p = pageflags_find(start, start);
+        if (!p && !locked) {
+            /* The lockless lookup may have raced with an update. */
+            mmap_lock();
+            locked = unlock = true;
+            p = pageflags_find(start, start);
         }
-        if (!(p->flags & PAGE_VALID)) {
-            return -1;
+        if (!p || !(p->flags & PAGE_VALID)) {
+            break;
         }
-
         if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
-            return -1;
+            break;
         }
-        if (flags & PAGE_WRITE) {
+        if ((flags & PAGE_WRITE) && !(p->flags & PAGE_WRITE)) {
             if (!(p->flags & PAGE_WRITE_ORG)) {
-                return -1;
+                break;
             }
             /* unprotect the page if it was put read-only because it
                contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0)) {
-                    return -1;
-                }
+            if (!page_unprotect(start, 0)) {
+                break;
             }
+            /* That may have changed the tree, look the page up again. */
+            continue;
         }
+        if (last <= p->itree.last) {
+            ret = 0;
+            break;
+        }
+        start = p->itree.last + 1;
     }
-    return 0;
+
+    if (unlock) {
+        mmap_unlock();
+    }
+    return ret;
+}
+
+target_ulong page_find_range_empty(target_ulong min, target_ulong max,
+                                   target_ulong len, target_ulong align)
+{
+    target_ulong addr;
+
+    assert_memory_lock();
+
+    if (len == 0 || max < min || max - min < len - 1) {
+        return -1;
+    }
+
+    /*
+     * Any lower candidate that still overlaps the lowest range in the
+     * way also overlaps that range, so skip directly below it.
+     */
+    addr = (max - len + 1) & -align;
+    while (addr >= min) {
+        PageFlagsNode *p = pageflags_find(addr, addr + len - 1);
+
+        if (!p) {
+            return addr;
+        }
+        if (p->itree.start < min || p->itree.start - min < len) {
+            break;
+        }
+        addr = (p->itree.start - len) & -align;
+    }
+    return -1;
 }
 
 void page_protect(tb_page_addr_t page_addr)
 {
     target_ulong addr;
-    PageDesc *p;
     int prot;
 
-    p = page_find(page_addr >> TARGET_PAGE_BITS);
-    if (p && (p->flags & PAGE_WRITE)) {
+    assert_memory_lock();
+
+    if (page_get_flags(page_addr) & PAGE_WRITE) {
         /*
          * Force the host page as non writable (writes will have a page fault +
          * mprotect overhead).
@@ -2396,14 +2815,10 @@ void page_protect(tb_page_addr_t page_addr)
         prot = 0;
         for (addr = page_addr; addr < page_addr + qemu_host_page_size;
              addr += TARGET_PAGE_SIZE) {
-
-            p = page_find(addr >> TARGET_PAGE_BITS);
-            if (!p) {
-                continue;
-            }
-            prot |= p->flags;
-            p->flags &= ~PAGE_WRITE;
+            prot |= page_get_flags(addr);
         }
+        pageflags_set_clear(page_addr, page_addr + qemu_host_page_size - 1,
+                            0, PAGE_WRITE, 0, false);
         mprotect(g2h_untagged(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
         if (DEBUG_TB_INVALIDATE_GATE) {
@@ -2422,7 +2837,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
 {
     unsigned int prot;
     bool current_tb_invalidated;
-    PageDesc *p;
+    int flags;
     target_ulong host_start, host_end, addr;
 
     /* Technically this isn't safe inside a signal handler.  However we
@@ -2430,17 +2845,13 @@ int page_unprotect(target_ulong address, uintptr_t pc)
        practice it seems to be ok.  */
     mmap_lock();
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        mmap_unlock();
-        return 0;
-    }
+    flags = page_get_flags(address);
 
     /* if the page was really writable, then we change its
        protection back to writable */
-    if (p->flags & PAGE_WRITE_ORG) {
+    if (flags & PAGE_WRITE_ORG) {
         current_tb_invalidated = false;
-        if (p->flags & PAGE_WRITE) {
+        if (flags & PAGE_WRITE) {
             /* If the page is actually marked WRITE then assume this is because
              * this thread raced with another one which got here first and
              * set the page to PAGE_WRITE and did the TB invalidate for us.
@@ -2455,11 +2866,9 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             host_start = address & qemu_host_page_mask;
             host_end = host_start + qemu_host_page_size;
 
-            prot = 0;
+            prot = PAGE_WRITE;
             for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
-                p = page_find(addr >> TARGET_PAGE_BITS);
-                p->flags |= PAGE_WRITE;
-                prot |= p->flags;
+                prot |= page_get_flags(addr);
 
                 /* and since the content will be modified, we must invalidate
                    the corresponding translated code. */
@@ -2470,6 +2879,8 @@ int page_unprotect(target_ulong address, uintptr_t pc)
                 }
 #endif
             }
+            pageflags_set_clear(host_start, host_end - 1,
+                                PAGE_WRITE, 0, 0, false);
             mprotect((void *)g2h_untagged(host_start), qemu_host_page_size,
                      prot & PAGE_BITS);
         }
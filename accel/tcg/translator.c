@@ -17,6 +17,7 @@
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "tb-stats.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -38,10 +39,42 @@ bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest)
         return false;
     }
 
+    /* Remember the destination as a candidate for translation ahead. */
+    if (tcg_ctx->nb_goto_tb_dest < ARRAY_SIZE(tcg_ctx->goto_tb_dest)) {
+        tcg_ctx->goto_tb_dest[tcg_ctx->nb_goto_tb_dest++] = dest;
+    }
+
     /* Check for the dest on the same page as the start of the TB.  */
     return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
 }
 
+bool translator_follow_jump(DisasContextBase *db, target_ulong dest)
+{
+    /* Honour the same suppression as for goto_tb. */
+    if (tb_cflags(db->tb) & CF_NO_GOTO_TB) {
+        return false;
+    }
+
+    /*
+     * Only follow forward jumps that stay within the first page, so that
+     * [pc_first, pc_next) still covers every instruction in the TB.
+     */
+    return dest > db->pc_next
+        && ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
+}
+
+/* Count the executions of @tb in its TBStatistics. */
+static void gen_tb_exec_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_constant_ptr(&tb->tb_stats->exec_count);
+    TCGv_i64 count = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+    tcg_temp_free_i64(count);
+}
+
 static inline void translator_page_protect(DisasContextBase *dcbase,
                                            target_ulong pc)
 {
@@ -75,6 +108,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     /* Start translating.  */
     gen_tb_start(db->tb);
+    if (tb->tb_stats) {
+        gen_tb_exec_count(tb);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
@@ -201,16 +201,16 @@ static void initialize_debug_host(CPUDebug *s)
 #endif
 }
 
-/* Disassemble this for me please... (debugging).  */
-void target_disas(FILE *out, CPUState *cpu, target_ulong code,
-                  target_ulong size)
+static void target_disas_with(fprintf_function fprintf_func, FILE *out,
+                              CPUState *cpu, target_ulong code,
+                              target_ulong size)
 {
     target_ulong pc;
     int count;
     CPUDebug s;
 
     initialize_debug_target(&s, cpu);
-    s.info.fprintf_func = fprintf;
+    s.info.fprintf_func = fprintf_func;
     s.info.stream = out;
     s.info.buffer_vma = code;
     s.info.buffer_length = size;
@@ -224,21 +224,29 @@ void target_disas(FILE *out, CPUState *cpu, target_ulong code,
     }
 
     for (pc = code; size > 0; pc += count, size -= count) {
-	fprintf(out, "0x" TARGET_FMT_lx ":  ", pc);
-	count = s.info.print_insn(pc, &s.info);
-	fprintf(out, "\n");
-	if (count < 0)
-	    break;
+        fprintf_func(out, "0x" TARGET_FMT_lx ":  ", pc);
+        count = s.info.print_insn(pc, &s.info);
+        fprintf_func(out, "\n");
+        if (count < 0) {
+            break;
+        }
         if (size < count) {
-            fprintf(out,
-                    "Disassembler disagrees with translator over instruction "
-                    "decoding\n"
-                    "Please report this to qemu-devel@nongnu.org\n");
+            fprintf_func(out,
+                         "Disassembler disagrees with translator over "
+                         "instruction decoding\n"
+                         "Please report this to qemu-devel@nongnu.org\n");
             break;
         }
     }
 }
 
+/* Disassemble this for me please... (debugging).  */
+void target_disas(FILE *out, CPUState *cpu, target_ulong code,
+                  target_ulong size)
+{
+    target_disas_with(fprintf, out, cpu, code, size);
+}
+
 static int plugin_printf(FILE *stream, const char *fmt, ...)
 {
     /* We abuse the FILE parameter to pass a GString. */
@@ -258,6 +266,12 @@ static void plugin_print_address(bfd_vma addr, struct disassemble_info *info)
     /* does nothing */
 }
 
+void target_disas_buf(GString *buf, CPUState *cpu, target_ulong code,
+                      target_ulong size)
+{
+    target_disas_with(plugin_printf, (FILE *)buf, cpu, code, size);
+}
+
 
 /*
  * We should only be dissembling one instruction at a time here. If
@@ -84,6 +84,7 @@ this code that are retained.
  */
 #include "qemu/osdep.h"
 #include <math.h>
+#include <fenv.h>
 #include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
@@ -232,15 +233,112 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 # define QEMU_SOFTFLOAT_ATTR QEMU_FLATTEN __attribute__((noinline))
 #endif
 
+/*
+ * The host FPU does not tell us for free whether a result is exact, so
+ * hardfloat was originally limited to the case where the guest's inexact
+ * flag is already set.  Guests that clear their flags before most FP
+ * operations (or read them back often) would then always take the soft
+ * path.  Where we can cheaply access the host's own inexact flag, clear
+ * it before the operation and copy it to the guest afterwards instead.
+ */
+#if defined(__x86_64__)
+# define QEMU_HARDFLOAT_HOST_INEXACT 1
+/* MXCSR.PE */
+static inline void host_inexact_clear(void)
+{
+    __builtin_ia32_ldmxcsr(__builtin_ia32_stmxcsr() & ~0x20);
+}
+
+static inline bool host_inexact_test(void)
+{
+    return __builtin_ia32_stmxcsr() & 0x20;
+}
+#elif defined(__aarch64__)
+# define QEMU_HARDFLOAT_HOST_INEXACT 1
+/* FPSR.IXC */
+static inline void host_inexact_clear(void)
+{
+    uint64_t fpsr;
+
+    asm volatile("mrs %0, fpsr" : "=r"(fpsr));
+    asm volatile("msr fpsr, %0" : : "r"(fpsr & ~0x10));
+}
+
+static inline bool host_inexact_test(void)
+{
+    uint64_t fpsr;
+
+    asm volatile("mrs %0, fpsr" : "=r"(fpsr));
+    return fpsr & 0x10;
+}
+#elif defined(FE_INEXACT)
+# define QEMU_HARDFLOAT_HOST_INEXACT 1
+static inline void host_inexact_clear(void)
+{
+    feclearexcept(FE_INEXACT);
+}
+
+static inline bool host_inexact_test(void)
+{
+    return fetestexcept(FE_INEXACT);
+}
+#else
+# define QEMU_HARDFLOAT_HOST_INEXACT 0
+static inline void host_inexact_clear(void)
+{
+}
+
+static inline bool host_inexact_test(void)
+{
+    g_assert_not_reached();
+}
+#endif
+
 static inline bool can_use_fpu(const float_status *s)
 {
     if (QEMU_NO_HARDFLOAT) {
         return false;
     }
-    return likely(s->float_exception_flags & float_flag_inexact &&
-                  s->float_rounding_mode == float_round_nearest_even);
+    return likely(s->float_rounding_mode == float_round_nearest_even &&
+                  (QEMU_HARDFLOAT_HOST_INEXACT ||
+                   s->float_exception_flags & float_flag_inexact));
+}
+
+/*
+ * Call before a host FP operation that may be inexact.  Returns true
+ * if the inexact flag has to be computed, in which case the operands
+ * and the result of the operation must go through fp_barrier() and
+ * hardfloat_inexact_end() must be called once the result is known
+ * to be valid.
+ */
+static inline bool hardfloat_inexact_begin(const float_status *s)
+{
+    if (likely(s->float_exception_flags & float_flag_inexact)) {
+        return false;
+    }
+    host_inexact_clear();
+    return true;
+}
+
+static inline void hardfloat_inexact_end(bool track, float_status *s)
+{
+    if (track && host_inexact_test()) {
+        float_raise(float_flag_inexact, s);
+    }
 }
 
+/*
+ * The compiler does not know that FP operations access the host's flags,
+ * and would happily move them across host_inexact_clear/test.  Pin @x
+ * in place with respect to them.
+ */
+#define fp_barrier(track, x)                    \
+    do {                                        \
+        if (track) {                            \
+            asm volatile("" : "+m"(x));         \
+        }                                       \
+    } while (0)
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -345,6 +443,7 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
              f32_check_fn pre, f32_check_fn post)
 {
     union_float32 ua, ub, ur;
+    bool track;
 
     ua.s = xa;
     ub.s = xb;
@@ -358,12 +457,17 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
         goto soft;
     }
 
+    track = hardfloat_inexact_begin(s);
+    fp_barrier(track, ua.h);
+    fp_barrier(track, ub.h);
     ur.h = hard(ua.h, ub.h);
+    fp_barrier(track, ur.h);
     if (unlikely(f32_is_inf(ur))) {
         float_raise(float_flag_overflow, s);
     } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && post(ua, ub)) {
         goto soft;
     }
+    hardfloat_inexact_end(track, s);
     return ur.s;
 
  soft:
@@ -376,6 +480,7 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
              f64_check_fn pre, f64_check_fn post)
 {
     union_float64 ua, ub, ur;
+    bool track;
 
     ua.s = xa;
     ub.s = xb;
@@ -389,12 +494,17 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
         goto soft;
     }
 
+    track = hardfloat_inexact_begin(s);
+    fp_barrier(track, ua.h);
+    fp_barrier(track, ub.h);
     ur.h = hard(ua.h, ub.h);
+    fp_barrier(track, ur.h);
     if (unlikely(f64_is_inf(ur))) {
         float_raise(float_flag_overflow, s);
     } else if (unlikely(fabs(ur.h) <= DBL_MIN) && post(ua, ub)) {
         goto soft;
     }
+    hardfloat_inexact_end(track, s);
     return ur.s;
 
  soft:
@@ -2277,6 +2387,7 @@ float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
     } else {
         union_float32 ua_orig = ua;
         union_float32 uc_orig = uc;
+        bool track;
 
         if (flags & float_muladd_negate_product) {
             ua.h = -ua.h;
@@ -2285,7 +2396,12 @@ float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
             uc.h = -uc.h;
         }
 
+        track = hardfloat_inexact_begin(s);
+        fp_barrier(track, ua.h);
+        fp_barrier(track, ub.h);
+        fp_barrier(track, uc.h);
         ur.h = fmaf(ua.h, ub.h, uc.h);
+        fp_barrier(track, ur.h);
 
         if (unlikely(f32_is_inf(ur))) {
             float_raise(float_flag_overflow, s);
@@ -2294,6 +2410,7 @@ float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
             uc = uc_orig;
             goto soft;
         }
+        hardfloat_inexact_end(track, s);
     }
     if (flags & float_muladd_negate_result) {
         return float32_chs(ur.s);
@@ -2348,6 +2465,7 @@ float64_muladd(float64 xa, float64 xb, float64 xc, int flags, float_status *s)
     } else {
         union_float64 ua_orig = ua;
         union_float64 uc_orig = uc;
+        bool track;
 
         if (flags & float_muladd_negate_product) {
             ua.h = -ua.h;
@@ -2356,7 +2474,12 @@ float64_muladd(float64 xa, float64 xb, float64 xc, int flags, float_status *s)
             uc.h = -uc.h;
         }
 
+        track = hardfloat_inexact_begin(s);
+        fp_barrier(track, ua.h);
+        fp_barrier(track, ub.h);
+        fp_barrier(track, uc.h);
         ur.h = fma(ua.h, ub.h, uc.h);
+        fp_barrier(track, ur.h);
 
         if (unlikely(f64_is_inf(ur))) {
             float_raise(float_flag_overflow, s);
@@ -2365,6 +2488,7 @@ float64_muladd(float64 xa, float64 xb, float64 xc, int flags, float_status *s)
             uc = uc_orig;
             goto soft;
         }
+        hardfloat_inexact_end(track, s);
     }
     if (flags & float_muladd_negate_result) {
         return float64_chs(ur.s);
@@ -2807,6 +2931,26 @@ float32 float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(float64_is_normal(a)) && can_use_fpu(s)) {
+        union_float64 ua;
+        union_float32 ur;
+        bool track = hardfloat_inexact_begin(s);
+
+        ua.s = a;
+        fp_barrier(track, ua.h);
+        ur.h = ua.h;
+        fp_barrier(track, ur.h);
+        if (unlikely(f32_is_inf(ur))) {
+            float_raise(float_flag_overflow, s);
+        } else if (unlikely(fabsf(ur.h) <= FLT_MIN)) {
+            /* Let softfloat deal with tininess and flush-to-zero */
+            goto soft;
+        }
+        hardfloat_inexact_end(track, s);
+        return ur.s;
+    }
+
+ soft:
     float64_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -3805,7 +3949,12 @@ float32 int64_to_float32_scalbn(int64_t a, int scale, float_status *status)
     /* Without scaling, there are no overflow concerns. */
     if (likely(scale == 0) && can_use_fpu(status)) {
         union_float32 ur;
+        bool track = hardfloat_inexact_begin(status);
+
+        fp_barrier(track, a);
         ur.h = a;
+        fp_barrier(track, ur.h);
+        hardfloat_inexact_end(track, status);
         return ur.s;
     }
 
@@ -3845,7 +3994,12 @@ float64 int64_to_float64_scalbn(int64_t a, int scale, float_status *status)
     /* Without scaling, there are no overflow concerns. */
     if (likely(scale == 0) && can_use_fpu(status)) {
         union_float64 ur;
+        bool track = hardfloat_inexact_begin(status);
+
+        fp_barrier(track, a);
         ur.h = a;
+        fp_barrier(track, ur.h);
+        hardfloat_inexact_end(track, status);
         return ur.s;
     }
 
@@ -4015,7 +4169,12 @@ float32 uint64_to_float32_scalbn(uint64_t a, int scale, float_status *status)
     /* Without scaling, there are no overflow concerns. */
     if (likely(scale == 0) && can_use_fpu(status)) {
         union_float32 ur;
+        bool track = hardfloat_inexact_begin(status);
+
+        fp_barrier(track, a);
         ur.h = a;
+        fp_barrier(track, ur.h);
+        hardfloat_inexact_end(track, status);
         return ur.s;
     }
 
@@ -4055,7 +4214,12 @@ float64 uint64_to_float64_scalbn(uint64_t a, int scale, float_status *status)
     /* Without scaling, there are no overflow concerns. */
     if (likely(scale == 0) && can_use_fpu(status)) {
         union_float64 ur;
+        bool track = hardfloat_inexact_begin(status);
+
+        fp_barrier(track, a);
         ur.h = a;
+        fp_barrier(track, ur.h);
+        hardfloat_inexact_end(track, status);
         return ur.s;
     }
 
@@ -4520,6 +4684,7 @@ soft_f64_sqrt(float64 a, float_status *status)
 float32 QEMU_FLATTEN float32_sqrt(float32 xa, float_status *s)
 {
     union_float32 ua, ur;
+    bool track;
 
     ua.s = xa;
     if (unlikely(!can_use_fpu(s))) {
@@ -4537,7 +4702,11 @@ float32 QEMU_FLATTEN float32_sqrt(float32 xa, float_status *s)
                         float32_is_neg(ua.s))) {
         goto soft;
     }
+    track = hardfloat_inexact_begin(s);
+    fp_barrier(track, ua.h);
     ur.h = sqrtf(ua.h);
+    fp_barrier(track, ur.h);
+    hardfloat_inexact_end(track, s);
     return ur.s;
 
  soft:
@@ -4547,6 +4716,7 @@ float32 QEMU_FLATTEN float32_sqrt(float32 xa, float_status *s)
 float64 QEMU_FLATTEN float64_sqrt(float64 xa, float_status *s)
 {
     union_float64 ua, ur;
+    bool track;
 
     ua.s = xa;
     if (unlikely(!can_use_fpu(s))) {
@@ -4564,7 +4734,11 @@ float64 QEMU_FLATTEN float64_sqrt(float64 xa, float_status *s)
                         float64_is_neg(ua.s))) {
         goto soft;
     }
+    track = hardfloat_inexact_begin(s);
+    fp_barrier(track, ua.h);
     ur.h = sqrt(ua.h);
+    fp_barrier(track, ur.h);
+    hardfloat_inexact_end(track, s);
     return ur.s;
 
  soft:
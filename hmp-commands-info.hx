@@ -281,6 +281,22 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "count:i?",
+        .params     = "[count]",
+        .help       = "show the most executed translation blocks",
+    },
+#endif
+
+SRST
+  ``info tb-stats`` [*count*]
+    Show execution and translation statistics for the *count* (default
+    10) most executed translation blocks, with their disassembly.
+    Requires ``-accel tcg,tb-stats=on``.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -865,6 +881,19 @@ SRST
     Display the vcpu dirty rate information.
 ERST
 
+    {
+        .name       = "vcpu_dirty_limit",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show dirty page rate limit information",
+        .cmd        = hmp_info_vcpu_dirty_limit,
+    },
+
+SRST
+  ``info vcpu_dirty_limit``
+    Display the dirty page rate limit of the vCPUs.
+ERST
+
 #if defined(TARGET_I386)
     {
         .name       = "sgx",
@@ -1768,3 +1768,31 @@ ERST
                       "\n\t\t\t -b to specify dirty bitmap as method of calculation)",
         .cmd        = hmp_calc_dirty_rate,
     },
+
+SRST
+``set_vcpu_dirty_limit``
+  Limit the dirty page rate of a vCPU, or of all vCPUs if *cpu_index*
+  is not given, to *dirty_rate* MB/s.  Requires the KVM dirty ring.
+ERST
+
+    {
+        .name       = "set_vcpu_dirty_limit",
+        .args_type  = "dirty_rate:l,cpu_index:l?",
+        .params     = "dirty_rate [cpu_index]",
+        .help       = "limit the dirty page rate of a vCPU (MB/s)",
+        .cmd        = hmp_set_vcpu_dirty_limit,
+    },
+
+SRST
+``cancel_vcpu_dirty_limit``
+  Remove the dirty page rate limit of a vCPU, or of all vCPUs if
+  *cpu_index* is not given.
+ERST
+
+    {
+        .name       = "cancel_vcpu_dirty_limit",
+        .args_type  = "cpu_index:l?",
+        .params     = "[cpu_index]",
+        .help       = "remove the dirty page rate limit of a vCPU",
+        .cmd        = hmp_cancel_vcpu_dirty_limit,
+    },
@@ -273,6 +273,20 @@ int page_get_flags(target_ulong address);
 void page_set_flags(target_ulong start, target_ulong end, int flags);
 int page_check_range(target_ulong start, target_ulong len, int flags);
 
+/**
+ * page_find_range_empty(min, max, len, align)
+ * @min: lowest address of the search range
+ * @max: highest address of the search range (inclusive)
+ * @len: size of the free range to find
+ * @align: alignment of the free range, a power of 2
+ *
+ * Return the highest address aligned to @align such that the @len bytes
+ * starting there lie within [@min, @max] and contain no mapped page,
+ * or -1 if there is none.  Must be called with the mmap_lock held.
+ */
+target_ulong page_find_range_empty(target_ulong min, target_ulong max,
+                                   target_ulong len, target_ulong align);
+
 /**
  * page_alloc_target_data(address, size)
  * @address: guest virtual address
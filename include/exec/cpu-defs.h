@@ -76,8 +76,18 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
-#define CPU_VTLB_SIZE 8
+/*
+ * use a 4-way set associative victim tlb of 64 entries, indexed
+ * by the low bits of the virtual page number, followed by a fully
+ * associative overflow area that keeps the entries dropped by a full set
+ */
+#define CPU_VTLB_WAYS 4
+#define CPU_VTLB_SETS 16
+#define CPU_VTLB_OVERFLOW 8
+#define CPU_VTLB_SIZE (CPU_VTLB_WAYS * CPU_VTLB_SETS + CPU_VTLB_OVERFLOW)
+
+/* track up to 4 disjoint regions of large pages per mmu_idx */
+#define CPU_TLB_LARGE_PAGES 4
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -150,27 +160,40 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * A region of the virtual address space covering one or more large
+ * pages.  A virtual address V is within the region if
+ * (V & mask) == addr.  An unused region has both fields set to -1.
+ */
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * Describe regions covering all of the large pages allocated
+     * into the tlb.  When any page within one of these regions is
+     * flushed, we must flush all entries within that region.
      */
-    target_ulong large_page_addr;
-    target_ulong large_page_mask;
+    CPUTLBLargePage large_page[CPU_TLB_LARGE_PAGES];
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
-    /* The next index to use in the tlb victim table.  */
-    size_t vindex;
-    /* The tlb victim table, in two parts.  */
+    /* The next way to use in each set of the tlb victim table.  */
+    uint8_t vindex[CPU_VTLB_SETS];
+    /* The next entry to use in the overflow area of the tlb victim table. */
+    uint8_t voindex;
+    /*
+     * The tlb victim table, in two parts, with the ways of a set adjacent
+     * and the overflow area after the last set.
+     */
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
     /* The iotlb.  */
@@ -208,6 +231,13 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /*
+     * Lookups that missed in the main tlb, how many the victim tlb hit,
+     * and how many of those were in its overflow area
+     */
+    size_t miss_count;
+    size_t victim_hit_count;
+    size_t victim_overflow_hit_count;
 } CPUTLBCommon;
 
 /*
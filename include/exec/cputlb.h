@@ -27,5 +27,7 @@
 void tlb_protect_code(ram_addr_t ram_addr);
 void tlb_unprotect_code(ram_addr_t ram_addr);
 void tlb_flush_counts(size_t *full, size_t *part, size_t *elide);
+void tlb_miss_counts(size_t *miss, size_t *victim_hit,
+                     size_t *victim_overflow_hit);
 #endif
 #endif
@@ -532,6 +532,9 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /* Statistics for this block's pc and flags, see accel/tcg/tb-stats.h */
+    struct TBStatistics *tb_stats;
 };
 
 /* Hide the qatomic_read to make code a little easier on the eyes */
@@ -603,6 +606,24 @@ void mmap_lock(void);
 void mmap_unlock(void);
 bool have_mmap_lock(void);
 
+/**
+ * translate_ahead_init:
+ * @threads: number of worker threads
+ *
+ * Start @threads threads that translate the static successors of
+ * newly translated TBs before the vCPUs get to them.
+ */
+void translate_ahead_init(int threads);
+
+/**
+ * translate_ahead_fork_end:
+ * @child: true in the child process
+ *
+ * Restart the translation workers in a child process, with mmap_lock
+ * still held from before the fork.
+ */
+void translate_ahead_fork_end(int child);
+
 /**
  * get_page_addr_code() - user-mode version
  * @env: CPUArchState
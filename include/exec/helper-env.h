@@ -0,0 +1,46 @@
+/* Helper file for declaring TCG helper functions.
+   This one defines the CPU state accessed by each helper, and is
+   private to tcg.c.  */
+
+#ifndef HELPER_ENV_H
+#define HELPER_ENV_H
+
+#include "exec/helper-head.h"
+
+#define DEF_HELPER_FLAGS_0(NAME, FLAGS, ret)
+#define DEF_HELPER_FLAGS_1(NAME, FLAGS, ret, t1)
+#define DEF_HELPER_FLAGS_2(NAME, FLAGS, ret, t1, t2)
+#define DEF_HELPER_FLAGS_3(NAME, FLAGS, ret, t1, t2, t3)
+#define DEF_HELPER_FLAGS_4(NAME, FLAGS, ret, t1, t2, t3, t4)
+#define DEF_HELPER_FLAGS_5(NAME, FLAGS, ret, t1, t2, t3, t4, t5)
+#define DEF_HELPER_FLAGS_6(NAME, FLAGS, ret, t1, t2, t3, t4, t5, t6)
+#define DEF_HELPER_FLAGS_7(NAME, FLAGS, ret, t1, t2, t3, t4, t5, t6, t7)
+
+#define DEF_HELPER_ENV_RD(NAME, first, last) \
+  { .func = HELPER(NAME), \
+    .rd_start = offsetof(CPUArchState, first), \
+    .rd_end = endof(CPUArchState, last) },
+
+#define DEF_HELPER_ENV_RW(NAME, first, last) \
+  { .func = HELPER(NAME), \
+    .rd_start = offsetof(CPUArchState, first), \
+    .rd_end = endof(CPUArchState, last), \
+    .wr_start = offsetof(CPUArchState, first), \
+    .wr_end = endof(CPUArchState, last) },
+
+#include "helper.h"
+#include "accel/tcg/tcg-runtime.h"
+#include "accel/tcg/plugin-helpers.h"
+
+#undef DEF_HELPER_FLAGS_0
+#undef DEF_HELPER_FLAGS_1
+#undef DEF_HELPER_FLAGS_2
+#undef DEF_HELPER_FLAGS_3
+#undef DEF_HELPER_FLAGS_4
+#undef DEF_HELPER_FLAGS_5
+#undef DEF_HELPER_FLAGS_6
+#undef DEF_HELPER_FLAGS_7
+#undef DEF_HELPER_ENV_RD
+#undef DEF_HELPER_ENV_RW
+
+#endif /* HELPER_ENV_H */
@@ -78,6 +78,9 @@ static inline void glue(gen_helper_, name)(dh_retvar_decl(ret)          \
   tcg_gen_callN(HELPER(name), dh_retvar(ret), 7, args);                 \
 }
 
+#define DEF_HELPER_ENV_RD(name, first, last)
+#define DEF_HELPER_ENV_RW(name, first, last)
+
 #include "helper.h"
 #include "accel/tcg/tcg-runtime.h"
 #include "accel/tcg/plugin-helpers.h"
@@ -90,6 +93,8 @@ static inline void glue(gen_helper_, name)(dh_retvar_decl(ret)          \
 #undef DEF_HELPER_FLAGS_5
 #undef DEF_HELPER_FLAGS_6
 #undef DEF_HELPER_FLAGS_7
+#undef DEF_HELPER_ENV_RD
+#undef DEF_HELPER_ENV_RW
 #undef GEN_HELPER
 
 #endif /* HELPER_GEN_H */
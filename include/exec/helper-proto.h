@@ -37,6 +37,9 @@ dh_ctype(ret) HELPER(name) (dh_ctype(t1), dh_ctype(t2), dh_ctype(t3), \
 
 #define IN_HELPER_PROTO
 
+#define DEF_HELPER_ENV_RD(name, first, last)
+#define DEF_HELPER_ENV_RW(name, first, last)
+
 #include "helper.h"
 #include "accel/tcg/tcg-runtime.h"
 #include "accel/tcg/plugin-helpers.h"
@@ -51,5 +54,7 @@ dh_ctype(ret) HELPER(name) (dh_ctype(t1), dh_ctype(t2), dh_ctype(t3), \
 #undef DEF_HELPER_FLAGS_5
 #undef DEF_HELPER_FLAGS_6
 #undef DEF_HELPER_FLAGS_7
+#undef DEF_HELPER_ENV_RD
+#undef DEF_HELPER_ENV_RW
 
 #endif /* HELPER_PROTO_H */
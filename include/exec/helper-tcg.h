@@ -58,6 +58,9 @@
     | dh_typemask(t2, 2) | dh_typemask(t3, 3) | dh_typemask(t4, 4) \
     | dh_typemask(t5, 5) | dh_typemask(t6, 6) | dh_typemask(t7, 7) },
 
+#define DEF_HELPER_ENV_RD(NAME, first, last)
+#define DEF_HELPER_ENV_RW(NAME, first, last)
+
 #include "helper.h"
 #include "accel/tcg/tcg-runtime.h"
 #include "accel/tcg/plugin-helpers.h"
@@ -71,5 +74,7 @@
 #undef DEF_HELPER_FLAGS_5
 #undef DEF_HELPER_FLAGS_6
 #undef DEF_HELPER_FLAGS_7
+#undef DEF_HELPER_ENV_RD
+#undef DEF_HELPER_ENV_RW
 
 #endif /* HELPER_TCG_H */
@@ -62,6 +62,22 @@ struct RAMBlock {
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
 
+    /*
+     * Pages dirtied since the dirty rate measurement started, see
+     * calc-dirty-rate.  Protected by iothread lock.
+     */
+    uint64_t dirty_rate_pages;
+
+    /*
+     * With the mapped-ram capability, each page has a fixed offset in
+     * the migration file: pages_offset plus its offset in the block.
+     * file_bmap records which pages the file holds, and is stored at
+     * bitmap_offset at the end of migration.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    off_t pages_offset;
+
     /*
      * RAM block length that corresponds to the used_length on the migration
      * source (after RAM block sizes were synchronized). Especially, after
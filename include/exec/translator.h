@@ -152,10 +152,27 @@ void translator_loop_temp_check(DisasContextBase *db);
  * @dest: target pc of the goto
  *
  * Return true if goto_tb is allowed between the current TB
- * and the destination PC.
+ * and the destination PC.  The destination is also recorded as
+ * a static successor of the TB, which user-mode emulation may
+ * translate ahead of time.
  */
 bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest);
 
+/**
+ * translator_follow_jump
+ * @db: Disassembly context
+ * @dest: target pc of an unconditional direct jump
+ *
+ * Return true if translation may continue at @dest within the current TB
+ * instead of ending the TB with a goto_tb.  The caller is then expected
+ * to set up the next instruction at @dest and leave db->is_jmp alone.
+ *
+ * Only forward jumps within the page of the first instruction qualify:
+ * the skipped bytes remain part of the TB as far as page tracking and
+ * self-modifying code detection are concerned.
+ */
+bool translator_follow_jump(DisasContextBase *db, target_ulong dest);
+
 /*
  * Translator Load Functions
  *
@@ -135,6 +135,16 @@ struct QIOChannelClass {
                      off_t offset,
                      int whence,
                      Error **errp);
+    ssize_t (*io_pwritev)(QIOChannel *ioc,
+                          const struct iovec *iov,
+                          size_t niov,
+                          off_t offset,
+                          Error **errp);
+    ssize_t (*io_preadv)(QIOChannel *ioc,
+                         const struct iovec *iov,
+                         size_t niov,
+                         off_t offset,
+                         Error **errp);
     void (*io_set_aio_fd_handler)(QIOChannel *ioc,
                                   AioContext *ctx,
                                   IOHandler *io_read,
@@ -606,6 +616,84 @@ off_t qio_channel_io_seek(QIOChannel *ioc,
                           int whence,
                           Error **errp);
 
+/**
+ * qio_channel_pwritev:
+ * @ioc: the channel object
+ * @iov: the array of memory regions to write data from
+ * @niov: the length of the @iov array
+ * @offset: the position in the channel to write at
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Write data to @ioc at @offset, without moving the current
+ * I/O position of the channel.  Several threads may write
+ * to the same channel at different offsets concurrently.
+ *
+ * Not all implementations will support this facility,
+ * so may report an error.
+ *
+ * Returns: the number of bytes written, or -1 on error
+ */
+ssize_t qio_channel_pwritev(QIOChannel *ioc,
+                            const struct iovec *iov,
+                            size_t niov,
+                            off_t offset,
+                            Error **errp);
+
+/**
+ * qio_channel_pwrite:
+ * @ioc: the channel object
+ * @buf: the memory region to write data from
+ * @buflen: the number of bytes to write
+ * @offset: the position in the channel to write at
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Behaves as qio_channel_pwritev() with a single memory region.
+ */
+ssize_t qio_channel_pwrite(QIOChannel *ioc,
+                           void *buf,
+                           size_t buflen,
+                           off_t offset,
+                           Error **errp);
+
+/**
+ * qio_channel_preadv:
+ * @ioc: the channel object
+ * @iov: the array of memory regions to read data into
+ * @niov: the length of the @iov array
+ * @offset: the position in the channel to read from
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Read data from @ioc at @offset, without moving the current
+ * I/O position of the channel.  Several threads may read
+ * from the same channel at different offsets concurrently.
+ *
+ * Not all implementations will support this facility,
+ * so may report an error.
+ *
+ * Returns: the number of bytes read, or -1 on error
+ */
+ssize_t qio_channel_preadv(QIOChannel *ioc,
+                           const struct iovec *iov,
+                           size_t niov,
+                           off_t offset,
+                           Error **errp);
+
+/**
+ * qio_channel_pread:
+ * @ioc: the channel object
+ * @buf: the memory region to read data into
+ * @buflen: the number of bytes to read
+ * @offset: the position in the channel to read from
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Behaves as qio_channel_preadv() with a single memory region.
+ */
+ssize_t qio_channel_pread(QIOChannel *ioc,
+                          void *buf,
+                          size_t buflen,
+                          off_t offset,
+                          Error **errp);
+
 
 /**
  * qio_channel_create_watch:
@@ -0,0 +1,88 @@
+/*
+ * Interval trees (augmented red-black trees)
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_INTERVAL_TREE_H
+#define QEMU_INTERVAL_TREE_H
+
+/*
+ * Each node covers the closed interval [start, last] and additionally
+ * records the maximum value of 'last' in the subtree rooted at it, which
+ * lets lookups skip subtrees that cannot contain an overlapping interval.
+ * Insertion, removal and lookup are all O(log n).
+ *
+ * Intervals may overlap; it is up to the user to keep them disjoint if
+ * that is what the application requires.  The start and last fields of
+ * a node must not change while the node is in a tree.
+ *
+ * Modifications must be serialized by the caller.  interval_tree_iter_first
+ * may however run concurrently with modifications, inside an RCU read-side
+ * critical section, provided removed nodes are freed only after a grace
+ * period.  Such lockless lookups never return a node that does not
+ * overlap the interval, but may miss one that does; callers that need
+ * a definite negative answer must repeat the lookup with the lock held.
+ */
+
+typedef struct IntervalTreeNode IntervalTreeNode;
+
+struct IntervalTreeNode {
+    IntervalTreeNode *parent;
+    IntervalTreeNode *left;
+    IntervalTreeNode *right;
+    bool red;
+
+    uint64_t start;        /* inclusive */
+    uint64_t last;         /* inclusive */
+    uint64_t subtree_last;
+};
+
+typedef struct IntervalTreeRoot {
+    IntervalTreeNode *root;
+} IntervalTreeRoot;
+
+/**
+ * interval_tree_insert:
+ * @node: node to insert, with start and last already set
+ * @root: tree to insert into
+ */
+void interval_tree_insert(IntervalTreeNode *node, IntervalTreeRoot *root);
+
+/**
+ * interval_tree_remove:
+ * @node: node to remove
+ * @root: tree containing @node
+ *
+ * The node is not freed; with lockless readers, it must stay valid
+ * until the end of the current RCU grace period.
+ */
+void interval_tree_remove(IntervalTreeNode *node, IntervalTreeRoot *root);
+
+/**
+ * interval_tree_iter_first:
+ * @root: tree to search
+ * @start: first value of the interval
+ * @last: last value of the interval
+ *
+ * Return the node with the lowest start that overlaps [@start, @last],
+ * or NULL if there is none.
+ */
+IntervalTreeNode *interval_tree_iter_first(IntervalTreeRoot *root,
+                                           uint64_t start, uint64_t last);
+
+/**
+ * interval_tree_iter_next:
+ * @node: node previously returned for the same interval
+ * @start: first value of the interval
+ * @last: last value of the interval
+ *
+ * Return the next node, in order of start, that overlaps
+ * [@start, @last], or NULL if there is none.  Must not be used
+ * concurrently with modifications of the tree.
+ */
+IntervalTreeNode *interval_tree_iter_next(IntervalTreeNode *node,
+                                          uint64_t start, uint64_t last);
+
+#endif /* QEMU_INTERVAL_TREE_H */
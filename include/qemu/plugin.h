@@ -88,6 +88,8 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_COND,
+    PLUGIN_CB_BATCH,
     PLUGIN_N_CB_SUBTYPES,
 };
 
@@ -105,12 +107,53 @@ struct qemu_plugin_dyn_cb {
     /* fields specific to each dyn_cb type go here */
     union {
         struct {
+            /* @entry.score is NULL for ops on a plain pointer in @userp */
+            qemu_plugin_u64 entry;
             enum qemu_plugin_op op;
             uint64_t imm;
         } inline_insn;
+        struct {
+            qemu_plugin_u64 entry;
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+        } cond;
+        struct {
+            struct qemu_plugin_mem_buffer *buf;
+        } batch;
     };
 };
 
+/*
+ * One element per vCPU, indexed by cpu_index.  @data is resized (and may
+ * move) when a vCPU with a larger index is created; since translated code
+ * embeds the address of the elements, that is done with all vCPUs stopped
+ * and followed by a flush of the code cache.
+ */
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
+/*
+ * The element of a memory trace buffer's scoreboard for one vCPU.  Room for
+ * all the inline accesses of an instruction is made before it starts, so
+ * they must fit in the buffer; no instruction comes close to this many.
+ */
+#define PLUGIN_MEM_BUFFER_MIN_RECORDS 256
+
+struct qemu_plugin_mem_buffer_vcpu {
+    uint64_t n;
+    struct qemu_plugin_mem_record records[];
+};
+
+struct qemu_plugin_mem_buffer {
+    struct qemu_plugin_scoreboard *score;
+    size_t n_records;
+    qemu_plugin_vcpu_mem_batch_cb_t cb;
+    void *userdata;
+    QLIST_ENTRY(qemu_plugin_mem_buffer) entry;
+};
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
@@ -208,6 +251,9 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
 
 void qemu_plugin_flush_cb(void);
 
+/* Return true if at least one plugin is loaded. */
+bool qemu_plugin_loaded(void);
+
 void qemu_plugin_atexit_cb(void);
 
 void qemu_plugin_add_dyn_cb_arr(GArray *arr);
@@ -275,6 +321,11 @@ static inline void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
 static inline void qemu_plugin_flush_cb(void)
 { }
 
+static inline bool qemu_plugin_loaded(void)
+{
+    return false;
+}
+
 static inline void qemu_plugin_atexit_cb(void)
 { }
 
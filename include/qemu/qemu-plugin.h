@@ -51,7 +51,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -274,14 +274,56 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
  * enum qemu_plugin_op - describes an inline op
  *
  * @QEMU_PLUGIN_INLINE_ADD_U64: add an immediate value uint64_t
- *
- * Note: currently only a single inline op is supported.
+ * @QEMU_PLUGIN_INLINE_STORE_U64: store an immediate value uint64_t
  */
 
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
+    QEMU_PLUGIN_INLINE_STORE_U64,
 };
 
+/**
+ * enum qemu_plugin_cond - condition for a conditional callback
+ *
+ * @QEMU_PLUGIN_COND_NEVER: false
+ * @QEMU_PLUGIN_COND_ALWAYS: true
+ * @QEMU_PLUGIN_COND_EQ: is equal?
+ * @QEMU_PLUGIN_COND_NE: is not equal?
+ * @QEMU_PLUGIN_COND_LT: is less than?
+ * @QEMU_PLUGIN_COND_LE: is less than or equal?
+ * @QEMU_PLUGIN_COND_GT: is greater than?
+ * @QEMU_PLUGIN_COND_GE: is greater than or equal?
+ *
+ * All comparisons are unsigned.
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
+};
+
+/** struct qemu_plugin_scoreboard - Opaque handle for a per-vCPU array */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of an entry in a scoreboard
+ * @score: the scoreboard
+ * @offset: offset of the uint64_t within each entry of @score
+ *
+ * Each vCPU has its own copy of the value, so inline ops on it never
+ * race with other vCPUs.  Use qemu_plugin_scoreboard_u64() or
+ * qemu_plugin_scoreboard_u64_in_struct() to build one.
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
 /**
  * qemu_plugin_register_vcpu_tb_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -300,6 +342,47 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to update
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies
+ * to the copy of @entry that belongs to the vCPU executing the block,
+ * which gives exact results in multi-threaded situations.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to check
+ * @entry: entry of a scoreboard to compare
+ * @imm: value to compare the entry with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called every time a translated unit executes
+ * and "@entry @cond @imm" holds for the executing vCPU.  The check is
+ * done inline, so a callback that rarely fires costs little more than
+ * a load and a branch.  Inline ops registered on @tb run before the
+ * check.
+ */
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -328,6 +411,45 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to update
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_inline(), but the op
+ * applies to the copy of @entry that belongs to the executing vCPU.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cond_cb() - conditional insn cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to check
+ * @entry: entry of a scoreboard to compare
+ * @imm: value to compare the entry with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called every time an instruction is executed
+ * and "@entry @cond @imm" holds for the executing vCPU.  Inline ops
+ * registered on @insn run before the check.
+ */
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry,
+    uint64_t imm,
+    void *userdata);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -497,6 +619,100 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - per-vCPU memory inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to update
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_mem_inline(), but the op applies to
+ * the copy of @entry that belongs to the executing vCPU.
+ */
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/** struct qemu_plugin_mem_buffer - Opaque handle for a memory trace buffer */
+struct qemu_plugin_mem_buffer;
+
+/**
+ * struct qemu_plugin_mem_record - memory access stored in a trace buffer
+ * @vaddr: virtual address of the access
+ * @userdata: the @userdata passed to qemu_plugin_register_vcpu_mem_buffer()
+ * @info: memory operation information, see qemu_plugin_mem_size_shift() etc.
+ */
+struct qemu_plugin_mem_record {
+    uint64_t vaddr;
+    void *userdata;
+    qemu_plugin_meminfo_t info;
+};
+
+/**
+ * typedef qemu_plugin_vcpu_mem_batch_cb_t - trace buffer callback
+ * @vcpu_index: the vCPU that performed the accesses
+ * @records: the accesses, oldest first
+ * @n: number of entries in @records
+ * @userdata: the @userdata passed to qemu_plugin_mem_buffer_new()
+ *
+ * @records is only valid until the callback returns.
+ */
+typedef void
+(*qemu_plugin_vcpu_mem_batch_cb_t)(unsigned int vcpu_index,
+                                   const struct qemu_plugin_mem_record *records,
+                                   size_t n, void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_new() - alloc a per-vCPU memory trace buffer
+ * @n_records: capacity of the buffer of each vCPU, at least 256 are used
+ * @cb: callback receiving the buffered accesses
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * Memory accesses registered with qemu_plugin_register_vcpu_mem_buffer()
+ * are appended to the buffer of the vCPU performing them by inline code;
+ * the translated code only calls out to QEMU once per instruction, to make
+ * room for the instruction's records.  @cb is called with the buffered
+ * records when the buffer fills up, when the vCPU goes idle or exits,
+ * and, for the vCPU that exits QEMU and those that have been stopped,
+ * before the atexit callbacks run.  Accesses performed by helpers rather
+ * than by translated code are passed to @cb one at a time.
+ *
+ * Returns a new buffer; free it with qemu_plugin_mem_buffer_free().
+ */
+struct qemu_plugin_mem_buffer *
+qemu_plugin_mem_buffer_new(size_t n_records,
+                           qemu_plugin_vcpu_mem_batch_cb_t cb,
+                           void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_free() - free a memory trace buffer
+ * @buf: buffer to free
+ *
+ * Records still in @buf are dropped.  Like scoreboards, this should
+ * only be called once no more code will execute.
+ */
+void qemu_plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
+/**
+ * qemu_plugin_register_vcpu_mem_buffer() - trace memory accesses into a buffer
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @buf: the buffer to store the accesses in
+ * @userdata: value stored in each record, e.g. to identify @insn
+ *
+ * A batched alternative to qemu_plugin_register_vcpu_mem_cb().  Records
+ * are delivered after the fact, so qemu_plugin_get_hwaddr() cannot be
+ * used on them.
+ */
+void qemu_plugin_register_vcpu_mem_buffer(struct qemu_plugin_insn *insn,
+                                          enum qemu_plugin_mem_rw rw,
+                                          struct qemu_plugin_mem_buffer *buf,
+                                          void *userdata);
+
 
 
 typedef void
@@ -572,6 +788,76 @@ int qemu_plugin_n_vcpus(void);
 /* returns -1 in user-mode */
 int qemu_plugin_n_max_vcpus(void);
 
+/**
+ * qemu_plugin_scoreboard_new() - alloc a new scoreboard
+ * @element_size: size (in bytes) of each element of the scoreboard
+ *
+ * A scoreboard holds one zero-initialised element per vCPU and grows
+ * automatically as vCPUs are created.  Elements may be moved when
+ * that happens, so pointers from qemu_plugin_scoreboard_find() must
+ * not be kept across vCPU creation.
+ *
+ * Returns a pointer to a new scoreboard. It must be freed using
+ * qemu_plugin_scoreboard_free.
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * Translated code may refer to the scoreboard, so this should only be
+ * called once no more code will execute, e.g. from the atexit callback.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get pointer to an entry of a scoreboard
+ * @score: scoreboard to query
+ * @vcpu_index: entry index
+ *
+ * Returns address of the entry of the scoreboard matching @vcpu_index.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/* Macros to define a qemu_plugin_u64 */
+#define qemu_plugin_scoreboard_u64(score) \
+    (qemu_plugin_u64) {score, 0}
+#define qemu_plugin_scoreboard_u64_in_struct(score, type, member) \
+    (qemu_plugin_u64) {score, offsetof(type, member)}
+
+/**
+ * qemu_plugin_u64_add() - add a value to a qemu_plugin_u64 for a given vCPU
+ * @entry: entry to update
+ * @vcpu_index: vCPU whose copy of @entry is updated
+ * @added: value to add
+ */
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+
+/**
+ * qemu_plugin_u64_get() - get the value of a qemu_plugin_u64 for a given vCPU
+ * @entry: entry to query
+ * @vcpu_index: vCPU whose copy of @entry is read
+ */
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_set() - set the value of a qemu_plugin_u64 for a given vCPU
+ * @entry: entry to update
+ * @vcpu_index: vCPU whose copy of @entry is written
+ * @val: new value
+ */
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - return the sum of all vCPU entries in a scoreboard
+ * @entry: entry to sum
+ */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 /**
  * qemu_plugin_outs() - output string via QEMU's logging system
  * @string: a string
@@ -0,0 +1,67 @@
+/*
+ * Dirty page rate limit of vCPUs
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_DIRTYLIMIT_H
+#define SYSEMU_DIRTYLIMIT_H
+
+/*
+ * The dirty page rate of each vCPU is measured from its KVM dirty ring.
+ * A vCPU that dirties memory faster than its limit sleeps every time its
+ * dirty ring fills up, and only that vCPU.
+ */
+
+/* Highest dirty page rate limit that can be set, in MB/s */
+#define DIRTYLIMIT_MAX_RATE     1048576
+
+/**
+ * dirtylimit_vcpu_execute:
+ * @cpu: vCPU whose dirty ring is full
+ *
+ * Called by the vCPU thread without the BQL after its dirty ring was
+ * reaped.  Sleeps as long as needed to keep @cpu under its limit.
+ */
+void dirtylimit_vcpu_execute(CPUState *cpu);
+
+/**
+ * dirtylimit_set_vcpu:
+ * @cpu_index: index of the vCPU to limit
+ * @quota: maximum dirty page rate, in MB/s
+ * @enable: %true to set the limit, %false to remove it
+ *
+ * Called with the BQL held.  Dirty logging runs as long as at least one
+ * vCPU is limited.
+ */
+void dirtylimit_set_vcpu(int cpu_index, uint64_t quota, bool enable);
+
+/**
+ * dirtylimit_set_all:
+ * @quota: maximum dirty page rate, in MB/s
+ * @enable: %true to set the limit, %false to remove it
+ *
+ * Like dirtylimit_set_vcpu(), for all vCPUs.
+ */
+void dirtylimit_set_all(uint64_t quota, bool enable);
+
+/**
+ * dirtylimit_migration_start:
+ * @quota: maximum dirty page rate of each vCPU, in MB/s
+ *
+ * Limit all vCPUs on behalf of migration, instead of auto-converge.
+ * The limits cannot be changed with QMP until dirtylimit_migration_stop().
+ * Called with the BQL held.
+ */
+void dirtylimit_migration_start(uint64_t quota);
+
+/**
+ * dirtylimit_migration_stop:
+ *
+ * Remove the limits set by dirtylimit_migration_start(), if any.
+ * Called with the BQL held.
+ */
+void dirtylimit_migration_stop(void);
+
+#endif /* SYSEMU_DIRTYLIMIT_H */
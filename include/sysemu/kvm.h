@@ -582,4 +582,7 @@ bool kvm_cpu_check_are_resettable(void);
 bool kvm_arch_cpu_check_are_resettable(void);
 
 bool kvm_dirty_ring_enabled(void);
+
+/* Return the number of entries of the per-vCPU dirty rings, or 0 */
+uint32_t kvm_dirty_ring_size(void);
 #endif
@@ -263,6 +263,10 @@ struct TCGLabel {
     unsigned has_value : 1;
     unsigned id : 14;
     unsigned refs : 16;
+    /* Forward branches seen by the register allocator.  */
+    unsigned nb_branches;
+    /* Globals held in each host register at those branches.  */
+    struct TCGTemp **reg_globals;
     union {
         uintptr_t value;
         const tcg_insn_unit *value_ptr;
@@ -622,6 +626,13 @@ struct TCGContext {
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
 
+    /* Number of temporaries spilled to memory by the register allocator. */
+    int nb_spills;
+
+    /* Static branch targets of the TB, see translator_use_goto_tb. */
+    int nb_goto_tb_dest;
+    target_ulong goto_tb_dest[2];
+
     /* Exit to translator on overflow. */
     sigjmp_buf jmp_trans;
 };
@@ -806,6 +817,7 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+size_t tcg_region_evict(void (*evict)(TranslationBlock *tb));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
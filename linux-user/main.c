@@ -82,6 +82,7 @@ bool have_guest_base;
  * -strace, or vice versa.
  */
 static bool enable_strace;
+static int translate_ahead;
 
 /*
  * The last log mask given by the user in an environment variable or argument.
@@ -142,6 +143,7 @@ void fork_start(void)
 
 void fork_end(int child)
 {
+    translate_ahead_fork_end(child);
     mmap_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
@@ -323,6 +325,15 @@ static void handle_arg_pagesize(const char *arg)
     }
 }
 
+static void handle_arg_translate_ahead(const char *arg)
+{
+    translate_ahead = atoi(arg);
+    if (translate_ahead <= 0) {
+        fprintf(stderr, "number of translation threads must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
 static void handle_arg_seed(const char *arg)
 {
     seed_optarg = arg;
@@ -471,6 +482,9 @@ static const struct qemu_argument arg_table[] = {
      "pagesize",   "set the host page size to 'pagesize'"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
+    {"translate-ahead", "QEMU_TRANSLATE_AHEAD", true,
+     handle_arg_translate_ahead,
+     "threads",    "translate branch targets ahead in 'threads' threads"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
@@ -899,6 +913,9 @@ int main(int argc, char **argv, char **envp)
        generating the prologue until now so that the prologue can take
        the real value of GUEST_BASE into account.  */
     tcg_prologue_init(tcg_ctx);
+    if (translate_ahead) {
+        translate_ahead_init(translate_ahead);
+    }
 
     target_cpu_copy_regs(env, regs);
 
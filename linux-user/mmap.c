@@ -199,9 +199,10 @@ static int mmap_frag(abi_ulong real_start,
 
     /* get the protection of the target pages outside the mapping */
     prot1 = 0;
-    for(addr = real_start; addr < real_end; addr++) {
-        if (addr < start || addr >= end)
+    for (addr = real_start; addr < real_end; addr += TARGET_PAGE_SIZE) {
+        if (addr < start || addr >= end) {
             prot1 |= page_get_flags(addr);
+        }
     }
 
     if (prot1 == 0) {
@@ -262,9 +263,7 @@ unsigned long last_brk;
 static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size,
                                         abi_ulong align)
 {
-    abi_ulong addr, end_addr, incr = qemu_host_page_size;
-    int prot;
-    bool looped = false;
+    target_ulong addr = -1;
 
     if (size > reserved_va) {
         return (abi_ulong)-1;
@@ -272,39 +271,25 @@ static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size,
 
     /* Note that start and size have already been aligned by mmap_find_vma. */
 
-    end_addr = start + size;
-    if (start > reserved_va - size) {
-        /* Start at the top of the address space.  */
-        end_addr = ((reserved_va - size) & -align) + size;
-        looped = true;
+    /*
+     * Search downward from START + SIZE, then from the top of the
+     * address space.  Address 0 is never returned.
+     */
+    if (start <= reserved_va - size) {
+        addr = page_find_range_empty(1, start + size - 1, size, align);
     }
-
-    /* Search downward from END_ADDR, checking to see if a page is in use.  */
-    addr = end_addr;
-    while (1) {
-        addr -= incr;
-        if (addr > end_addr) {
-            if (looped) {
-                /* Failure.  The entire address space has been searched.  */
-                return (abi_ulong)-1;
-            }
-            /* Re-start at the top of the address space.  */
-            addr = end_addr = ((reserved_va - size) & -align) + size;
-            looped = true;
-        } else {
-            prot = page_get_flags(addr);
-            if (prot) {
-                /* Page in use.  Restart below this page.  */
-                addr = end_addr = ((addr - size) & -align) + size;
-            } else if (addr && addr + size == end_addr) {
-                /* Success!  All pages between ADDR and END_ADDR are free.  */
-                if (start == mmap_next_start) {
-                    mmap_next_start = addr;
-                }
-                return addr;
-            }
+    if (addr == (target_ulong)-1) {
+        addr = page_find_range_empty(1, reserved_va - 1, size, align);
+        if (addr == (target_ulong)-1) {
+            /* Failure.  The entire address space has been searched.  */
+            return (abi_ulong)-1;
         }
     }
+
+    if (start == mmap_next_start) {
+        mmap_next_start = addr;
+    }
+    return addr;
 }
 
 /*
@@ -637,7 +622,6 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
             qemu_log_unlock(f);
         }
     }
-    tb_invalidate_phys_range(start, start + len);
     mmap_unlock();
     return start;
 fail:
@@ -741,7 +725,6 @@ int target_munmap(abi_ulong start, abi_ulong len)
 
     if (ret == 0) {
         page_set_flags(start, start + len, 0);
-        tb_invalidate_phys_range(start, start + len);
     }
     mmap_unlock();
     return ret;
@@ -831,7 +814,6 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
         page_set_flags(new_addr, new_addr + new_size,
                        prot | PAGE_VALID | PAGE_RESET);
     }
-    tb_invalidate_phys_range(new_addr, new_addr + new_size);
     mmap_unlock();
     return new_addr;
 }
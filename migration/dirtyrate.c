@@ -93,6 +93,7 @@ static struct DirtyRateInfo *query_dirty_rate_info(void)
     int64_t dirty_rate = DirtyStat.dirty_rate;
     struct DirtyRateInfo *info = g_new0(DirtyRateInfo, 1);
     DirtyRateVcpuList *head = NULL, **tail = &head;
+    DirtyRateRamBlockList *blocks = NULL, **blocks_tail = &blocks;
 
     info->status = CalculatingState;
     info->start_time = DirtyStat.start_time;
@@ -122,6 +123,14 @@ static struct DirtyRateInfo *query_dirty_rate_info(void)
 
         if (dirtyrate_mode == DIRTY_RATE_MEASURE_MODE_DIRTY_BITMAP) {
             info->sample_pages = 0;
+            info->has_ramblock_dirty_rate = true;
+            for (i = 0; i < DirtyStat.dirty_bitmap.nblock; i++) {
+                DirtyRateRamBlock *rate = g_new0(DirtyRateRamBlock, 1);
+                rate->id = g_strdup(DirtyStat.dirty_bitmap.rates[i].id);
+                rate->dirty_rate = DirtyStat.dirty_bitmap.rates[i].dirty_rate;
+                QAPI_LIST_APPEND(blocks_tail, rate);
+            }
+            info->ramblock_dirty_rate = blocks;
         }
     }
 
@@ -148,6 +157,10 @@ static void init_dirtyrate_stat(int64_t start_time,
         DirtyStat.dirty_ring.nvcpu = -1;
         DirtyStat.dirty_ring.rates = NULL;
         break;
+    case DIRTY_RATE_MEASURE_MODE_DIRTY_BITMAP:
+        DirtyStat.dirty_bitmap.nblock = 0;
+        DirtyStat.dirty_bitmap.rates = NULL;
+        break;
     default:
         break;
     }
@@ -160,6 +173,17 @@ static void cleanup_dirtyrate_stat(struct DirtyRateConfig config)
         free(DirtyStat.dirty_ring.rates);
         DirtyStat.dirty_ring.rates = NULL;
     }
+
+    /* last calc-dirty-rate qmp use dirty bitmap mode */
+    if (dirtyrate_mode == DIRTY_RATE_MEASURE_MODE_DIRTY_BITMAP) {
+        int i;
+
+        for (i = 0; i < DirtyStat.dirty_bitmap.nblock; i++) {
+            g_free(DirtyStat.dirty_bitmap.rates[i].id);
+        }
+        g_free(DirtyStat.dirty_bitmap.rates);
+        DirtyStat.dirty_bitmap.rates = NULL;
+    }
 }
 
 static void update_dirtyrate_stat(struct RamblockDirtyInfo *info)
@@ -449,6 +473,45 @@ static void do_calculate_dirtyrate_bitmap(DirtyPageRecord dirty_pages)
     DirtyStat.dirty_rate = do_calculate_dirtyrate_vcpu(dirty_pages);
 }
 
+/* Called with the BQL held. */
+static void reset_dirtyrate_ramblock_pages(void)
+{
+    RAMBlock *block;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+            block->dirty_rate_pages = 0;
+        }
+    }
+}
+
+/* Called with the BQL held. */
+static void calculate_dirtyrate_ramblocks(int64_t msec)
+{
+    RAMBlock *block;
+    int nblock = 0;
+    int i = 0;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+            nblock++;
+        }
+
+        DirtyStat.dirty_bitmap.nblock = nblock;
+        DirtyStat.dirty_bitmap.rates = g_new0(DirtyRateRamBlock, nblock);
+
+        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+            DirtyRateRamBlock *rate = &DirtyStat.dirty_bitmap.rates[i++];
+
+            rate->id = g_strdup(block->idstr);
+            rate->dirty_rate = ((block->dirty_rate_pages * TARGET_PAGE_SIZE *
+                                 1000 / msec) >> 20);
+            trace_dirtyrate_do_calculate_ramblock(block->idstr,
+                                                  rate->dirty_rate);
+        }
+    }
+}
+
 static inline void dirtyrate_manual_reset_protect(void)
 {
     RAMBlock *block = NULL;
@@ -484,6 +547,7 @@ static void calculate_dirtyrate_dirty_bitmap(struct DirtyRateConfig config)
      * KVM_DIRTY_LOG_MANUAL_PROTECT_ENABLE cap is enabled.
      */
     dirtyrate_manual_reset_protect();
+    reset_dirtyrate_ramblock_pages();
     qemu_mutex_unlock_iothread();
 
     record_dirtypages_bitmap(&dirty_pages, true);
@@ -505,6 +569,10 @@ static void calculate_dirtyrate_dirty_bitmap(struct DirtyRateConfig config)
     record_dirtypages_bitmap(&dirty_pages, false);
 
     do_calculate_dirtyrate_bitmap(dirty_pages);
+
+    qemu_mutex_lock_iothread();
+    calculate_dirtyrate_ramblocks(msec);
+    qemu_mutex_unlock_iothread();
 }
 
 static void calculate_dirtyrate_dirty_ring(struct DirtyRateConfig config)
@@ -747,12 +815,20 @@ void hmp_info_dirty_rate(Monitor *mon, const QDict *qdict)
                                rate->value->dirty_rate);
             }
         }
+        if (info->has_ramblock_dirty_rate) {
+            DirtyRateRamBlockList *rate;
+
+            for (rate = info->ramblock_dirty_rate; rate; rate = rate->next) {
+                monitor_printf(mon, "ramblock[%s], Dirty rate: %"PRIi64
+                               " (MB/s)\n", rate->value->id,
+                               rate->value->dirty_rate);
+            }
+        }
     } else {
         monitor_printf(mon, "(not ready)\n");
     }
 
-    qapi_free_DirtyRateVcpuList(info->vcpu_dirty_rate);
-    g_free(info);
+    qapi_free_DirtyRateInfo(info);
 }
 
 void hmp_calc_dirty_rate(Monitor *mon, const QDict *qdict)
@@ -70,6 +70,11 @@ typedef struct VcpuStat {
     DirtyRateVcpu *rates; /* array of dirty rate for each vcpu */
 } VcpuStat;
 
+typedef struct RamblockStat {
+    int nblock; /* number of ramblocks */
+    DirtyRateRamBlock *rates; /* array of dirty rate for each ramblock */
+} RamblockStat;
+
 /*
  * Store calculation statistics for each measure.
  */
@@ -81,6 +86,7 @@ struct DirtyRateStat {
     union {
         SampleVMStat page_sampling;
         VcpuStat dirty_ring;
+        RamblockStat dirty_bitmap;
     };
 };
 
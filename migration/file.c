@@ -0,0 +1,135 @@
+/*
+ * QEMU live migration to and from a file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "io/channel-file.h"
+#include "channel.h"
+#include "file.h"
+#include "migration.h"
+#include "trace.h"
+
+/* The migration file, which multifd and RAM loading open again */
+static char *file_path;
+
+QIOChannel *file_new_channel(int flags, Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    if (migrate_direct_io()) {
+#ifdef O_DIRECT
+        flags |= O_DIRECT;
+#else
+        error_setg(errp, "direct-io is not supported on this host");
+        return NULL;
+#endif
+    }
+
+    fioc = qio_channel_file_new_path(file_path, flags, 0, errp);
+    if (!fioc) {
+        return NULL;
+    }
+    return QIO_CHANNEL(fioc);
+}
+
+void file_send_channel_create(QIOTaskFunc f, void *data)
+{
+    QIOChannel *ioc;
+    QIOTask *task;
+    Error *err = NULL;
+
+    ioc = file_new_channel(O_WRONLY, &err);
+    task = qio_task_new(OBJECT(ioc), f, data, NULL);
+    if (!ioc) {
+        qio_task_set_error(task, err);
+    }
+    qio_task_complete(task);
+}
+
+void file_start_outgoing_migration(MigrationState *s, const char *filename,
+                                   Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    if (migrate_use_tls()) {
+        error_setg(errp, "TLS is not supported by file migration");
+        return;
+    }
+    if (migrate_use_multifd()) {
+        if (!migrate_mapped_ram()) {
+            error_setg(errp, "multifd to a file requires mapped-ram");
+            return;
+        }
+        if (migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+            error_setg(errp, "mapped-ram does not support multifd "
+                       "compression");
+            return;
+        }
+    }
+    if (migrate_direct_io() &&
+        !(migrate_mapped_ram() && migrate_use_multifd())) {
+        error_setg(errp, "direct-io requires mapped-ram and multifd");
+        return;
+    }
+
+    trace_migration_file_outgoing(filename);
+    fioc = qio_channel_file_new_path(filename, O_CREAT | O_WRONLY | O_TRUNC,
+                                     0600, errp);
+    if (!fioc) {
+        return;
+    }
+
+    g_free(file_path);
+    file_path = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-outgoing");
+    migration_channel_connect(s, QIO_CHANNEL(fioc), NULL, NULL);
+    object_unref(OBJECT(fioc));
+}
+
+static gboolean file_accept_incoming_migration(QIOChannel *ioc,
+                                               GIOCondition condition,
+                                               gpointer opaque)
+{
+    migration_channel_process_incoming(ioc);
+    object_unref(OBJECT(ioc));
+    return G_SOURCE_REMOVE;
+}
+
+void file_start_incoming_migration(const char *filename, Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    /*
+     * A file has no channels besides the main one; mapped-ram pages are
+     * read by multifd-channels threads without the multifd capability.
+     */
+    if (migrate_use_multifd()) {
+        error_setg(errp, "multifd is not supported when restoring from a "
+                   "file, disable it on the destination");
+        return;
+    }
+    if (migrate_direct_io() && !migrate_mapped_ram()) {
+        error_setg(errp, "direct-io requires mapped-ram");
+        return;
+    }
+
+    trace_migration_file_incoming(filename);
+    fioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
+    if (!fioc) {
+        return;
+    }
+
+    g_free(file_path);
+    file_path = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-incoming");
+    qio_channel_add_watch_full(QIO_CHANNEL(fioc), G_IO_IN,
+                               file_accept_incoming_migration,
+                               NULL, NULL,
+                               g_main_context_get_thread_default());
+}
@@ -0,0 +1,26 @@
+/*
+ * QEMU live migration to and from a file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_FILE_H
+#define QEMU_MIGRATION_FILE_H
+
+#include "io/task.h"
+
+void file_start_incoming_migration(const char *filename, Error **errp);
+
+void file_start_outgoing_migration(MigrationState *s, const char *filename,
+                                   Error **errp);
+
+/*
+ * Open another channel on the file of the current migration, with
+ * O_DIRECT if the direct-io parameter is set.  Used to read and write
+ * RAM pages at fixed offsets, see the mapped-ram capability.
+ */
+QIOChannel *file_new_channel(int flags, Error **errp);
+
+void file_send_channel_create(QIOTaskFunc f, void *data);
+#endif
@@ -20,10 +20,13 @@
 #include "migration/blocker.h"
 #include "exec.h"
 #include "fd.h"
+#include "file.h"
 #include "socket.h"
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/dirtylimit.h"
+#include "sysemu/kvm.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
@@ -106,6 +109,9 @@
  */
 #define DEFAULT_MIGRATE_MAX_POSTCOPY_BANDWIDTH 0
 
+/* Dirty page rate limit of each vCPU for the dirty-limit capability, MB/s */
+#define DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT 1
+
 /*
  * Parameters for self_announce_delay giving a stream of RARP/ARP
  * packets after migration.
@@ -157,6 +163,8 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_MULTIFD,
     MIGRATION_CAPABILITY_PAUSE_BEFORE_SWITCHOVER,
     MIGRATION_CAPABILITY_AUTO_CONVERGE,
+    MIGRATION_CAPABILITY_DIRTY_LIMIT,
+    MIGRATION_CAPABILITY_MAPPED_RAM,
     MIGRATION_CAPABILITY_RELEASE_RAM,
     MIGRATION_CAPABILITY_RDMA_PIN_ALL,
     MIGRATION_CAPABILITY_COMPRESS,
@@ -192,7 +200,8 @@ bool migrate_multi_channels_is_allowed(void)
     return migrate_allow_multi_channels;
 }
 
-static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp)
+static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp,
+                                  gpointer unused)
 {
     uintptr_t a = (uintptr_t) ap, b = (uintptr_t) bp;
 
@@ -219,7 +228,11 @@ void migration_object_init(void)
     qemu_sem_init(&current_incoming->postcopy_pause_sem_dst, 0);
     qemu_sem_init(&current_incoming->postcopy_pause_sem_fault, 0);
     qemu_mutex_init(&current_incoming->page_request_mutex);
-    current_incoming->page_requested = g_tree_new(page_request_addr_cmp);
+    qemu_mutex_init(&current_incoming->postcopy_prio_thread_mutex);
+    qemu_sem_init(&current_incoming->postcopy_qemufile_dst_done, 0);
+    /* The values are the times of the requests, see postcopy_latency_* */
+    current_incoming->page_requested = g_tree_new_full(page_request_addr_cmp,
+                                                       NULL, NULL, g_free);
 
     migration_object_check(current_migration, &error_fatal);
 
@@ -308,6 +321,12 @@ void migration_incoming_state_destroy(void)
         qemu_fclose(mis->from_src_file);
         mis->from_src_file = NULL;
     }
+    if (mis->postcopy_qemufile_dst) {
+        migration_ioc_unregister_yank_from_file(mis->postcopy_qemufile_dst);
+        qemu_fclose(mis->postcopy_qemufile_dst);
+        mis->postcopy_qemufile_dst = NULL;
+    }
+    mis->preempt_thread_cancelled = false;
     if (mis->postcopy_remote_fds) {
         g_array_free(mis->postcopy_remote_fds, TRUE);
         mis->postcopy_remote_fds = NULL;
@@ -425,12 +444,14 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
     WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
         received = ramblock_recv_bitmap_test_byte_offset(rb, start);
         if (!received && !g_tree_lookup(mis->page_requested, aligned)) {
+            int64_t *req_time = g_new(int64_t, 1);
+
             /*
              * The page has not been received, and it's not yet in the page
-             * request list.  Queue it.  Set the value of element to 1, so that
-             * things like g_tree_lookup() will return TRUE (1) when found.
+             * request list.  Queue it, with the time of the request.
              */
-            g_tree_insert(mis->page_requested, aligned, (gpointer)1);
+            *req_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+            g_tree_insert(mis->page_requested, aligned, req_time);
             mis->page_requested_count++;
             trace_postcopy_page_req_add(aligned, mis->page_requested_count);
         }
@@ -482,6 +503,10 @@ static void qemu_start_incoming_migration(const char *uri, Error **errp)
     const char *p = NULL;
 
     migrate_protocol_allow_multi_channels(false); /* reset it anyway */
+    if (migrate_mapped_ram() && !strstart(uri, "file:", NULL)) {
+        error_setg(errp, "mapped-ram requires a file: migration URI");
+        return;
+    }
     qapi_event_send_migration(MIGRATION_STATUS_SETUP);
     if (strstart(uri, "tcp:", &p) ||
         strstart(uri, "unix:", NULL) ||
@@ -496,6 +521,8 @@ static void qemu_start_incoming_migration(const char *uri, Error **errp)
         exec_start_incoming_migration(p, errp);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_incoming_migration(p, errp);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_incoming_migration(p, errp);
     } else {
         error_setg(errp, "unknown migration protocol: %s", uri);
     }
@@ -720,7 +747,29 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
     Error *local_err = NULL;
     bool start_migration;
 
-    if (!mis->from_src_file) {
+    if (migrate_postcopy_preempt()) {
+        /*
+         * The main and preempt channels may connect in any order, so tell
+         * them apart by the header that the preempt channel starts with.
+         * Preempt cannot be used together with multifd.
+         */
+        QEMUFile *f = qemu_file_new_input(ioc);
+
+        if (postcopy_preempt_is_channel(f)) {
+            postcopy_preempt_new_channel(mis, f);
+            return;
+        }
+        if (mis->from_src_file) {
+            error_setg(errp, "Unexpected incoming migration channel");
+            migration_ioc_unregister_yank(ioc);
+            qemu_fclose(f);
+            return;
+        }
+        if (!migration_incoming_setup(f, errp)) {
+            return;
+        }
+        start_migration = true;
+    } else if (!mis->from_src_file) {
         /* The first connection (multifd may have multiple) */
         QEMUFile *f = qemu_file_new_input(ioc);
 
@@ -733,14 +782,18 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
          * right now.  Multifd needs more than one channel, we wait.
          */
         start_migration = !migrate_use_multifd();
-    } else {
+    } else if (migrate_use_multifd()) {
         /* Multiple connections */
-        assert(migrate_use_multifd());
         start_migration = multifd_recv_new_channel(ioc, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
         }
+    } else {
+        /* A single channel is expected */
+        error_setg(errp, "Unexpected incoming migration channel");
+        migration_ioc_unregister_yank(ioc);
+        return;
     }
 
     if (start_migration) {
@@ -765,6 +818,10 @@ bool migration_has_all_channels(void)
 
     all_channels = multifd_recv_all_channels_created();
 
+    if (migrate_postcopy_preempt()) {
+        all_channels = all_channels && mis->postcopy_qemufile_dst != NULL;
+    }
+
     return all_channels && mis->from_src_file != NULL;
 }
 
@@ -914,6 +971,10 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->xbzrle_cache_size = s->parameters.xbzrle_cache_size;
     params->has_max_postcopy_bandwidth = true;
     params->max_postcopy_bandwidth = s->parameters.max_postcopy_bandwidth;
+    params->has_vcpu_dirty_limit = true;
+    params->vcpu_dirty_limit = s->parameters.vcpu_dirty_limit;
+    params->has_direct_io = true;
+    params->direct_io = s->parameters.direct_io;
     params->has_max_cpu_throttle = true;
     params->max_cpu_throttle = s->parameters.max_cpu_throttle;
     params->has_announce_initial = true;
@@ -1288,6 +1349,60 @@ static bool migrate_caps_check(bool *cap_list,
     }
 #endif
 
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Multifd zero page detection requires multifd");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT]) {
+        if (!cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Postcopy preempt requires postcopy-ram");
+            return false;
+        }
+
+        /*
+         * Requested pages must be sent in one piece, by the migration
+         * thread, on the preempt channel.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+            error_setg(errp, "Postcopy preempt is not compatible with "
+                       "compress or multifd");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_DIRTY_LIMIT]) {
+        if (cap_list[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+            error_setg(errp, "dirty-limit is not compatible with "
+                       "auto-converge");
+            return false;
+        }
+        if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+            error_setg(errp, "dirty-limit requires KVM with dirty ring");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        /*
+         * Each page is stored once, at its own offset, and nothing can
+         * come back from a file.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE] ||
+            cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND] ||
+            cap_list[MIGRATION_CAPABILITY_RETURN_PATH] ||
+            cap_list[MIGRATION_CAPABILITY_X_COLO]) {
+            error_setg(errp, "mapped-ram is not compatible with postcopy, "
+                       "xbzrle, compress, multifd-zero-page, zero-copy-send, "
+                       "return-path or COLO");
+            return false;
+        }
+    }
 
     /* incoming side only */
     if (runstate_check(RUN_STATE_INMIGRATE) &&
@@ -1297,6 +1412,14 @@ static bool migrate_caps_check(bool *cap_list,
         return false;
     }
 
+    if (runstate_check(RUN_STATE_INMIGRATE) &&
+        !migrate_multi_channels_is_allowed() &&
+        cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT]) {
+        error_setg(errp, "postcopy preempt is not supported by current "
+                   "protocol");
+        return false;
+    }
+
     return true;
 }
 
@@ -1330,6 +1453,16 @@ static void fill_destination_migration_info(MigrationInfo *info)
         break;
     }
     info->status = mis->state;
+
+    WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
+        if (mis->postcopy_latency_count) {
+            info->has_postcopy_latency = true;
+            info->postcopy_latency = mis->postcopy_latency_total /
+                                     mis->postcopy_latency_count;
+            info->has_postcopy_latency_max = true;
+            info->postcopy_latency_max = mis->postcopy_latency_max;
+        }
+    }
 }
 
 MigrationInfo *qmp_query_migrate(Error **errp)
@@ -1506,6 +1639,15 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
        return false;
     }
 
+    if (params->has_vcpu_dirty_limit &&
+        (params->vcpu_dirty_limit < 1 ||
+         params->vcpu_dirty_limit > DIRTYLIMIT_MAX_RATE)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "vcpu_dirty_limit",
+                   "a value between 1 and " stringify(DIRTYLIMIT_MAX_RATE));
+        return false;
+    }
+
     if (params->has_block_bitmap_mapping &&
         !check_dirty_bitmap_mig_alias_map(params->block_bitmap_mapping, errp)) {
         error_prepend(errp, "Invalid mapping given for block-bitmap-mapping: ");
@@ -1590,6 +1732,12 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_max_postcopy_bandwidth) {
         dest->max_postcopy_bandwidth = params->max_postcopy_bandwidth;
     }
+    if (params->has_vcpu_dirty_limit) {
+        dest->vcpu_dirty_limit = params->vcpu_dirty_limit;
+    }
+    if (params->has_direct_io) {
+        dest->direct_io = params->direct_io;
+    }
     if (params->has_max_cpu_throttle) {
         dest->max_cpu_throttle = params->max_cpu_throttle;
     }
@@ -1707,6 +1855,12 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
                     s->parameters.max_postcopy_bandwidth / XFER_LIMIT_RATIO);
         }
     }
+    if (params->has_vcpu_dirty_limit) {
+        s->parameters.vcpu_dirty_limit = params->vcpu_dirty_limit;
+    }
+    if (params->has_direct_io) {
+        s->parameters.direct_io = params->direct_io;
+    }
     if (params->has_max_cpu_throttle) {
         s->parameters.max_cpu_throttle = params->max_cpu_throttle;
     }
@@ -1855,6 +2009,7 @@ static void migrate_fd_cleanup(MigrationState *s)
         qemu_mutex_lock_iothread();
 
         multifd_save_cleanup();
+        postcopy_preempt_close_channel(s);
         qemu_mutex_lock(&s->qemu_file_lock);
         tmp = s->to_dst_file;
         s->to_dst_file = NULL;
@@ -2330,6 +2485,11 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
     MigrationState *s = migrate_get_current();
     const char *p = NULL;
 
+    if (migrate_mapped_ram() && !strstart(uri, "file:", NULL)) {
+        error_setg(errp, "mapped-ram requires a file: migration URI");
+        return;
+    }
+
     if (!migrate_prepare(s, has_blk && blk, has_inc && inc,
                          has_resume && resume, errp)) {
         /* Error detected, put into errp */
@@ -2356,6 +2516,9 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         exec_start_outgoing_migration(s, p, &local_err);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_outgoing_migration(s, p, &local_err);
+    } else if (strstart(uri, "file:", &p)) {
+        migrate_protocol_allow_multi_channels(true);
+        file_start_outgoing_migration(s, p, &local_err);
     } else {
         if (!(has_resume && resume)) {
             yank_unregister_instance(MIGRATION_YANK_INSTANCE);
@@ -2412,6 +2575,42 @@ bool migrate_postcopy_ram(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_RAM];
 }
 
+bool migrate_postcopy_preempt(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT];
+}
+
+bool migrate_dirty_limit(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
+}
+
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
+bool migrate_direct_io(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.direct_io;
+}
+
 bool migrate_postcopy(void)
 {
     return migrate_postcopy_ram() || migrate_dirty_bitmaps();
@@ -2580,6 +2779,15 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+bool migrate_use_multifd_zero_page(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE];
+}
+
 #ifdef CONFIG_LINUX
 bool migrate_use_zero_copy_send(void)
 {
@@ -3002,6 +3210,13 @@ static int postcopy_start(MigrationState *ms)
     int64_t bandwidth = migrate_max_postcopy_bandwidth();
     bool restart_block = false;
     int cur_state = MIGRATION_STATUS_ACTIVE;
+
+    /*
+     * Wait for the preempt channel while the VM still runs, so that
+     * connecting it does not add to the downtime.
+     */
+    postcopy_preempt_wait_channel(ms);
+
     if (!migrate_pause_before_switchover()) {
         migrate_set_state(&ms->state, MIGRATION_STATUS_ACTIVE,
                           MIGRATION_STATUS_POSTCOPY_ACTIVE);
@@ -3447,6 +3662,9 @@ static MigThrError postcopy_pause(MigrationState *s)
         qemu_file_shutdown(file);
         qemu_fclose(file);
 
+        /* A recovered migration only uses the main channel */
+        postcopy_preempt_close_channel(s);
+
         migrate_set_state(&s->state, s->state,
                           MIGRATION_STATUS_POSTCOPY_PAUSED);
 
@@ -3664,6 +3882,7 @@ static void migration_iteration_finish(MigrationState *s)
     cpu_throttle_stop();
 
     qemu_mutex_lock_iothread();
+    dirtylimit_migration_stop();
     switch (s->state) {
     case MIGRATION_STATUS_COMPLETED:
         migration_calculate_complete(s);
@@ -4149,7 +4368,8 @@ void migrate_fd_connect(MigrationState *s, Error *error_in)
         return;
     }
 
-    if (multifd_save_setup(&local_err) != 0) {
+    if (multifd_save_setup(&local_err) != 0 ||
+        postcopy_preempt_setup(s, &local_err) != 0) {
         error_report_err(local_err);
         migrate_set_state(&s->state, MIGRATION_STATUS_SETUP,
                           MIGRATION_STATUS_FAILED);
@@ -4250,6 +4470,11 @@ static Property migration_properties[] = {
     DEFINE_PROP_SIZE("max-postcopy-bandwidth", MigrationState,
                       parameters.max_postcopy_bandwidth,
                       DEFAULT_MIGRATE_MAX_POSTCOPY_BANDWIDTH),
+    DEFINE_PROP_UINT64("vcpu-dirty-limit", MigrationState,
+                      parameters.vcpu_dirty_limit,
+                      DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT),
+    DEFINE_PROP_BOOL("direct-io", MigrationState,
+                      parameters.direct_io, false),
     DEFINE_PROP_UINT8("max-cpu-throttle", MigrationState,
                       parameters.max_cpu_throttle,
                       DEFAULT_MIGRATE_MAX_CPU_THROTTLE),
@@ -4281,6 +4506,12 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
+    DEFINE_PROP_MIG_CAP("x-multifd-zero-page",
+            MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE),
+    DEFINE_PROP_MIG_CAP("x-postcopy-preempt",
+            MIGRATION_CAPABILITY_POSTCOPY_PREEMPT),
+    DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
 #ifdef CONFIG_LINUX
     DEFINE_PROP_MIG_CAP("x-zero-copy-send",
             MIGRATION_CAPABILITY_ZERO_COPY_SEND),
@@ -4311,6 +4542,7 @@ static void migration_instance_finalize(Object *obj)
     qemu_sem_destroy(&ms->pause_sem);
     qemu_sem_destroy(&ms->postcopy_pause_sem);
     qemu_sem_destroy(&ms->postcopy_pause_rp_sem);
+    qemu_sem_destroy(&ms->postcopy_qemufile_src_sem);
     qemu_sem_destroy(&ms->rp_state.rp_sem);
     error_free(ms->error);
 }
@@ -4347,6 +4579,8 @@ static void migration_instance_init(Object *obj)
     params->has_multifd_zstd_level = true;
     params->has_xbzrle_cache_size = true;
     params->has_max_postcopy_bandwidth = true;
+    params->has_vcpu_dirty_limit = true;
+    params->has_direct_io = true;
     params->has_max_cpu_throttle = true;
     params->has_announce_initial = true;
     params->has_announce_max = true;
@@ -4355,6 +4589,7 @@ static void migration_instance_init(Object *obj)
 
     qemu_sem_init(&ms->postcopy_pause_sem, 0);
     qemu_sem_init(&ms->postcopy_pause_rp_sem, 0);
+    qemu_sem_init(&ms->postcopy_qemufile_src_sem, 0);
     qemu_sem_init(&ms->rp_state.rp_sem, 0);
     qemu_sem_init(&ms->rate_limit_sem, 0);
     qemu_sem_init(&ms->wait_unplug_sem, 0);
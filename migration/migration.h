@@ -45,6 +45,16 @@ struct PostcopyBlocktimeContext;
  */
 #define CLEAR_BITMAP_SHIFT_MAX            31
 
+/*
+ * Channels of the RAM stream.  Only postcopy preemption uses the second
+ * one, for the pages requested by the destination.
+ */
+enum {
+    RAM_CHANNEL_PRECOPY = 0,
+    RAM_CHANNEL_POSTCOPY = 1,
+    RAM_CHANNEL_MAX,
+};
+
 /* This is an abstraction of a "temp huge page" for postcopy's purpose */
 typedef struct {
     /*
@@ -66,8 +76,8 @@ typedef struct {
 /* State for the incoming migration */
 struct MigrationIncomingState {
     QEMUFile *from_src_file;
-    /* Previously received RAM's RAMBlock pointer */
-    RAMBlock *last_recv_block;
+    /* Previously received RAM's RAMBlock pointer, for each channel */
+    RAMBlock *last_recv_block[RAM_CHANNEL_MAX];
     /* A hook to allow cleanup at the end of incoming migration */
     void *transport_data;
     void (*transport_cleanup)(void *data);
@@ -119,6 +129,22 @@ struct MigrationIncomingState {
     PostcopyTmpPage *postcopy_tmp_pages;
     /* This is shared for all postcopy channels */
     void     *postcopy_tmp_zero_page;
+    /*
+     * The postcopy preempt channel.  It may be connected after postcopy
+     * started; postcopy_qemufile_dst_done is posted when it is, or when
+     * the thread loading it must stop.
+     */
+    QEMUFile *postcopy_qemufile_dst;
+    QemuSemaphore postcopy_qemufile_dst_done;
+    /* The thread loading the pages sent on the preempt channel */
+    bool      have_preempt_thread;
+    QemuThread postcopy_prio_thread;
+    /*
+     * Protects postcopy_qemufile_dst and preempt_thread_cancelled, which
+     * is set when the thread must stop without loading the channel.
+     */
+    QemuMutex postcopy_prio_thread_mutex;
+    bool      preempt_thread_cancelled;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
     GArray   *postcopy_remote_fds;
 
@@ -161,6 +187,14 @@ struct MigrationIncomingState {
      * contains valid information.
      */
     QemuMutex page_request_mutex;
+    /*
+     * Time from a page request to the placement of the page, in ns, for
+     * the requests of the current postcopy.  Protected by
+     * page_request_mutex.
+     */
+    uint64_t postcopy_latency_total;
+    uint64_t postcopy_latency_count;
+    uint64_t postcopy_latency_max;
 };
 
 MigrationIncomingState *migration_incoming_get_current(void);
@@ -310,6 +344,13 @@ struct MigrationState {
     /* Needed by postcopy-pause state */
     QemuSemaphore postcopy_pause_sem;
     QemuSemaphore postcopy_pause_rp_sem;
+    /*
+     * The postcopy preempt channel, on which the pages requested by the
+     * destination are sent.  Protected by qemu_file_lock.
+     */
+    QEMUFile *postcopy_qemufile_src;
+    /* Posted once the postcopy preempt channel is connected, or failed to */
+    QemuSemaphore postcopy_qemufile_src_sem;
     /*
      * Whether we abort the migration if decompression errors are
      * detected at the destination. It is left at false for qemu
@@ -362,6 +403,10 @@ bool migrate_postcopy(void);
 
 bool migrate_release_ram(void);
 bool migrate_postcopy_ram(void);
+bool migrate_postcopy_preempt(void);
+bool migrate_dirty_limit(void);
+bool migrate_mapped_ram(void);
+bool migrate_direct_io(void);
 bool migrate_zero_blocks(void);
 bool migrate_dirty_bitmaps(void);
 bool migrate_ignore_shared(void);
@@ -374,6 +419,7 @@ int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
+bool migrate_use_multifd_zero_page(void);
 
 #ifdef CONFIG_LINUX
 bool migrate_use_zero_copy_send(void);
@@ -12,6 +12,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
@@ -20,6 +21,7 @@
 #include "ram.h"
 #include "migration.h"
 #include "socket.h"
+#include "file.h"
 #include "tls.h"
 #include "qemu-file.h"
 #include "trace.h"
@@ -263,6 +265,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->flags = cpu_to_be32(p->flags);
     packet->pages_alloc = cpu_to_be32(p->pages->allocated);
     packet->normal_pages = cpu_to_be32(p->normal_num);
+    packet->zero_pages = cpu_to_be32(p->zero_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
 
@@ -276,6 +279,11 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t temp = p->zero[i];
+
+        packet->offset[p->normal_num + i] = cpu_to_be64(temp);
+    }
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -324,10 +332,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->zero_num > packet->pages_alloc - p->normal_num) {
+        error_setg(errp, "multifd: received packet "
+                   "with %u zero pages and expected maximum pages are %u",
+                   p->zero_num, packet->pages_alloc - p->normal_num) ;
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->normal_num == 0) {
+    if (p->normal_num == 0 && p->zero_num == 0) {
         return 0;
     }
 
@@ -352,6 +368,17 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         }
         p->normal[i] = offset;
     }
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[p->normal_num + i]);
+
+        if (offset > (block->used_length - page_size)) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, block->used_length);
+            return -1;
+        }
+        p->zero[i] = offset;
+    }
 
     return 0;
 }
@@ -392,13 +419,31 @@ struct {
  * false.
  */
 
+/*
+ * Only the channel knows which of the pages it was given are zero and
+ * how many bytes went on the wire for them, so the pages and bytes are
+ * taken into account once the channel is done with a packet: when the
+ * channel is picked again, or at the next sync.
+ * Called with p->mutex held.
+ */
+static void multifd_account_pages(QEMUFile *f, MultiFDSendParams *p)
+{
+    ram_counters.normal += p->normal_pages_unaccounted;
+    ram_counters.duplicate += p->zero_pages_unaccounted;
+    qemu_file_acct_rate_limit(f, p->bytes_unaccounted);
+    ram_counters.multifd_bytes += p->bytes_unaccounted;
+    ram_counters.transferred += p->bytes_unaccounted;
+    p->normal_pages_unaccounted = 0;
+    p->zero_pages_unaccounted = 0;
+    p->bytes_unaccounted = 0;
+}
+
 static int multifd_send_pages(QEMUFile *f)
 {
     int i;
     static int next_channel;
     MultiFDSendParams *p = NULL; /* make happy gcc */
     MultiFDPages_t *pages = multifd_send_state->pages;
-    uint64_t transferred;
 
     if (qatomic_read(&multifd_send_state->exiting)) {
         return -1;
@@ -429,15 +474,11 @@ static int multifd_send_pages(QEMUFile *f)
     }
     assert(!p->pages->num);
     assert(!p->pages->block);
+    multifd_account_pages(f, p);
 
     p->packet_num = multifd_send_state->packet_num++;
     multifd_send_state->pages = p->pages;
     p->pages = pages;
-    transferred = ((uint64_t) pages->num) * qemu_target_page_size()
-                + p->packet_len;
-    qemu_file_acct_rate_limit(f, transferred);
-    ram_counters.multifd_bytes += transferred;
-    ram_counters.transferred += transferred;
     qemu_mutex_unlock(&p->mutex);
     qemu_sem_post(&p->sem);
 
@@ -551,6 +592,8 @@ void multifd_save_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
@@ -610,9 +653,6 @@ int multifd_send_sync_main(QEMUFile *f)
         p->packet_num = multifd_send_state->packet_num++;
         p->flags |= MULTIFD_FLAG_SYNC;
         p->pending_job++;
-        qemu_file_acct_rate_limit(f, p->packet_len);
-        ram_counters.multifd_bytes += p->packet_len;
-        ram_counters.transferred += p->packet_len;
         qemu_mutex_unlock(&p->mutex);
         qemu_sem_post(&p->sem);
 
@@ -632,6 +672,10 @@ int multifd_send_sync_main(QEMUFile *f)
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        qemu_mutex_lock(&p->mutex);
+        multifd_account_pages(f, p);
+        qemu_mutex_unlock(&p->mutex);
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 
@@ -644,11 +688,14 @@ static void *multifd_send_thread(void *opaque)
     Error *local_err = NULL;
     int ret = 0;
     bool use_zero_copy_send = migrate_use_zero_copy_send();
+    bool use_zero_page = migrate_use_multifd_zero_page();
+    bool use_mapped_ram = migrate_mapped_ram();
+    size_t page_size = qemu_target_page_size();
 
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
-    if (multifd_send_initial_packet(p, &local_err) < 0) {
+    if (!use_mapped_ram && multifd_send_initial_packet(p, &local_err) < 0) {
         ret = -1;
         goto out;
     }
@@ -666,7 +713,41 @@ static void *multifd_send_thread(void *opaque)
         if (p->pending_job) {
             uint64_t packet_num = p->packet_num;
             uint32_t flags = p->flags;
+            RAMBlock *rb = p->pages->block;
             p->normal_num = 0;
+            p->zero_num = 0;
+            p->next_packet_size = 0;
+
+            if (use_mapped_ram) {
+                uint32_t num = p->pages->num;
+
+                /* p->pages stays ours until pending_job drops */
+                p->flags = 0;
+                qemu_mutex_unlock(&p->mutex);
+
+                trace_multifd_send(p->id, packet_num, num, 0, flags, 0);
+                ret = ram_block_write_pages(p->c, rb, p->pages->offset, num,
+                                            &local_err);
+                if (ret != 0) {
+                    break;
+                }
+
+                qemu_mutex_lock(&p->mutex);
+                p->num_packets++;
+                p->total_normal_pages += num;
+                p->normal_pages_unaccounted += num;
+                p->bytes_unaccounted += (uint64_t)num * page_size;
+                p->pages->num = 0;
+                p->pages->block = NULL;
+                p->pending_job--;
+                qemu_mutex_unlock(&p->mutex);
+
+                if (flags & MULTIFD_FLAG_SYNC) {
+                    qemu_sem_post(&p->sem_sync);
+                }
+                qemu_sem_post(&multifd_send_state->channels_ready);
+                continue;
+            }
 
             if (use_zero_copy_send) {
                 p->iovs_num = 0;
@@ -675,8 +756,16 @@ static void *multifd_send_thread(void *opaque)
             }
 
             for (int i = 0; i < p->pages->num; i++) {
-                p->normal[p->normal_num] = p->pages->offset[i];
-                p->normal_num++;
+                ram_addr_t offset = p->pages->offset[i];
+
+                if (use_zero_page &&
+                    buffer_is_zero(rb->host + offset, page_size)) {
+                    p->zero[p->zero_num] = offset;
+                    p->zero_num++;
+                } else {
+                    p->normal[p->normal_num] = offset;
+                    p->normal_num++;
+                }
             }
 
             if (p->normal_num) {
@@ -690,12 +779,16 @@ static void *multifd_send_thread(void *opaque)
             p->flags = 0;
             p->num_packets++;
             p->total_normal_pages += p->normal_num;
+            p->total_zero_pages += p->zero_num;
+            p->normal_pages_unaccounted += p->normal_num;
+            p->zero_pages_unaccounted += p->zero_num;
+            p->bytes_unaccounted += p->packet_len + p->next_packet_size;
             p->pages->num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, p->normal_num, flags,
-                               p->next_packet_size);
+            trace_multifd_send(p->id, packet_num, p->normal_num, p->zero_num,
+                               flags, p->next_packet_size);
 
             if (use_zero_copy_send) {
                 /* Send header first, without zerocopy */
@@ -754,7 +847,8 @@ out:
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -930,15 +1024,21 @@ int multifd_save_setup(Error **errp)
         p->pending_job = 0;
         p->id = i;
         p->pages = multifd_pages_init(page_count);
-        p->packet_len = sizeof(MultiFDPacket_t)
-                      + sizeof(uint64_t) * page_count;
-        p->packet = g_malloc0(p->packet_len);
-        p->packet->magic = cpu_to_be32(MULTIFD_MAGIC);
-        p->packet->version = cpu_to_be32(MULTIFD_VERSION);
+        if (migrate_mapped_ram()) {
+            /* Pages go straight to their offset in the file */
+            p->packet_len = 0;
+        } else {
+            p->packet_len = sizeof(MultiFDPacket_t)
+                          + sizeof(uint64_t) * page_count;
+            p->packet = g_malloc0(p->packet_len);
+            p->packet->magic = cpu_to_be32(MULTIFD_MAGIC);
+            p->packet->version = cpu_to_be32(MULTIFD_VERSION);
+        }
         p->name = g_strdup_printf("multifdsend_%d", i);
         /* We need one extra place for the packet header */
         p->iov = g_new0(struct iovec, page_count + 1);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
 
         if (migrate_use_zero_copy_send()) {
             p->write_flags = QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
@@ -946,7 +1046,11 @@ int multifd_save_setup(Error **errp)
             p->write_flags = 0;
         }
 
-        socket_send_channel_create(multifd_new_send_channel_async, p);
+        if (migrate_mapped_ram()) {
+            file_send_channel_create(multifd_new_send_channel_async, p);
+        } else {
+            socket_send_channel_create(multifd_new_send_channel_async, p);
+        }
     }
 
     for (i = 0; i < thread_count; i++) {
@@ -1047,6 +1151,8 @@ int multifd_load_cleanup(Error **errp)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
@@ -1089,6 +1195,7 @@ static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
     Error *local_err = NULL;
+    size_t page_size = qemu_target_page_size();
     int ret;
 
     trace_multifd_recv_thread_start(p->id);
@@ -1120,10 +1227,11 @@ static void *multifd_recv_thread(void *opaque)
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, p->normal_num, flags,
-                           p->next_packet_size);
+        trace_multifd_recv(p->id, p->packet_num, p->normal_num, p->zero_num,
+                           flags, p->next_packet_size);
         p->num_packets++;
         p->total_normal_pages += p->normal_num;
+        p->total_zero_pages += p->zero_num;
         qemu_mutex_unlock(&p->mutex);
 
         if (p->normal_num) {
@@ -1133,6 +1241,15 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        for (int i = 0; i < p->zero_num; i++) {
+            void *page = p->host + p->zero[i];
+
+            /* Avoid touching pages that are still unallocated. */
+            if (!buffer_is_zero(page, page_size)) {
+                memset(page, 0, page_size);
+            }
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1148,7 +1265,8 @@ static void *multifd_recv_thread(void *opaque)
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -1186,6 +1304,7 @@ int multifd_load_setup(Error **errp)
         p->name = g_strdup_printf("multifdrecv_%d", i);
         p->iov = g_new0(struct iovec, page_count);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
     }
 
     for (i = 0; i < thread_count; i++) {
@@ -19,6 +19,8 @@
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
 #include "qemu/madvise.h"
+#include "qemu/bswap.h"
+#include "qemu/lockable.h"
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
@@ -33,6 +35,8 @@
 #include "trace.h"
 #include "hw/boards.h"
 #include "exec/ramblock.h"
+#include "socket.h"
+#include "yank_functions.h"
 
 /* Arbitrary limit on size of each discard command,
  * keeps them around ~200 bytes
@@ -567,6 +571,13 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
 {
     trace_postcopy_ram_incoming_cleanup_entry();
 
+    /*
+     * After a successful postcopy, the preempt thread stops at the EOS
+     * that ends the channel; otherwise, make it fail.
+     */
+    postcopy_preempt_stop_thread(
+        mis, mis->state != MIGRATION_STATUS_POSTCOPY_ACTIVE);
+
     if (mis->have_fault_thread) {
         Error *local_err = NULL;
 
@@ -1096,14 +1107,60 @@ retry:
     return NULL;
 }
 
+/*
+ * Load the pages sent on the preempt channel, until the source ends it
+ * with an EOS at the end of the migration.
+ */
+static void *postcopy_preempt_thread(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+    QEMUFile *file = NULL;
+    int ret = 0;
+
+    trace_postcopy_preempt_thread_entry();
+    rcu_register_thread();
+    qemu_sem_post(&mis->thread_sync_sem);
+
+    /* The channel may connect after postcopy started listening */
+    qemu_sem_wait(&mis->postcopy_qemufile_dst_done);
+    WITH_QEMU_LOCK_GUARD(&mis->postcopy_prio_thread_mutex) {
+        if (!mis->preempt_thread_cancelled) {
+            file = mis->postcopy_qemufile_dst;
+        }
+    }
+    if (file) {
+        WITH_RCU_READ_LOCK_GUARD() {
+            ret = ram_load_postcopy(file, RAM_CHANNEL_POSTCOPY);
+        }
+    }
+
+    /*
+     * Pages may be lost in the channel; let the main channel fail too,
+     * so that postcopy pauses and the pages are requested again.  The
+     * main channel is only closed or replaced after this thread has been
+     * cancelled and joined, see postcopy_preempt_stop_thread().
+     */
+    WITH_QEMU_LOCK_GUARD(&mis->postcopy_prio_thread_mutex) {
+        if (ret < 0 && !mis->preempt_thread_cancelled &&
+            mis->state == MIGRATION_STATUS_POSTCOPY_ACTIVE) {
+            error_report("%s: failed to load pages: %d", __func__, ret);
+            qemu_file_shutdown(mis->from_src_file);
+        }
+    }
+
+    rcu_unregister_thread();
+    trace_postcopy_preempt_thread_exit(ret);
+    return NULL;
+}
+
 static int postcopy_temp_pages_setup(MigrationIncomingState *mis)
 {
     PostcopyTmpPage *tmp_page;
     int err, i, channels;
     void *temp_page;
 
-    /* TODO: will be boosted when enable postcopy preemption */
-    mis->postcopy_channels = 1;
+    /* The preempt channel places pages concurrently with the main one */
+    mis->postcopy_channels = migrate_postcopy_preempt() ? RAM_CHANNEL_MAX : 1;
 
     channels = mis->postcopy_channels;
     mis->postcopy_tmp_pages = g_malloc0_n(sizeof(PostcopyTmpPage), channels);
@@ -1185,6 +1242,19 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
         return -1;
     }
 
+    WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
+        mis->postcopy_latency_total = 0;
+        mis->postcopy_latency_count = 0;
+        mis->postcopy_latency_max = 0;
+    }
+
+    if (migrate_postcopy_preempt()) {
+        postcopy_thread_create(mis, &mis->postcopy_prio_thread,
+                               "postcopy/preempt", postcopy_preempt_thread,
+                               QEMU_THREAD_JOINABLE);
+        mis->have_preempt_thread = true;
+    }
+
     trace_postcopy_ram_enable_notify();
 
     return 0;
@@ -1211,6 +1281,8 @@ static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
         ret = ioctl(userfault_fd, UFFDIO_ZEROPAGE, &zero_struct);
     }
     if (!ret) {
+        int64_t *req_time;
+
         qemu_mutex_lock(&mis->page_request_mutex);
         ramblock_recv_bitmap_set_range(rb, host_addr,
                                        pagesize / qemu_target_page_size());
@@ -1218,10 +1290,19 @@ static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
          * If this page resolves a page fault for a previous recorded faulted
          * address, take a special note to maintain the requested page list.
          */
-        if (g_tree_lookup(mis->page_requested, host_addr)) {
+        req_time = g_tree_lookup(mis->page_requested, host_addr);
+        if (req_time) {
+            uint64_t latency = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                               *req_time;
+
+            mis->postcopy_latency_total += latency;
+            mis->postcopy_latency_count++;
+            mis->postcopy_latency_max = MAX(mis->postcopy_latency_max,
+                                            latency);
             g_tree_remove(mis->page_requested, host_addr);
             mis->page_requested_count--;
-            trace_postcopy_page_req_del(host_addr, mis->page_requested_count);
+            trace_postcopy_page_req_del(host_addr, mis->page_requested_count,
+                                        latency);
         }
         qemu_mutex_unlock(&mis->page_request_mutex);
         mark_postcopy_blocktime_end((uintptr_t)host_addr);
@@ -1394,6 +1475,135 @@ void postcopy_fault_thread_notify(MigrationIncomingState *mis)
     }
 }
 
+bool postcopy_preempt_is_channel(QEMUFile *file)
+{
+    uint8_t *buf;
+
+    /* The main channel starts with QEMU_VM_FILE_MAGIC, or a command */
+    if (qemu_peek_buffer(file, &buf, 4, 0) != 4 ||
+        ldl_be_p(buf) != POSTCOPY_PREEMPT_MAGIC) {
+        return false;
+    }
+    qemu_file_skip(file, 4);
+    return true;
+}
+
+void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file)
+{
+    /* The channel is read by a thread of its own */
+    qemu_file_set_blocking(file, true);
+    WITH_QEMU_LOCK_GUARD(&mis->postcopy_prio_thread_mutex) {
+        if (mis->postcopy_qemufile_dst) {
+            /* Only one preempt channel is ever connected */
+            warn_report("Ignoring a second postcopy preempt channel");
+            migration_ioc_unregister_yank_from_file(file);
+            qemu_fclose(file);
+            return;
+        }
+        mis->postcopy_qemufile_dst = file;
+    }
+    qemu_sem_post(&mis->postcopy_qemufile_dst_done);
+    trace_postcopy_preempt_new_channel();
+}
+
+void postcopy_preempt_stop_thread(MigrationIncomingState *mis, bool cancel)
+{
+    if (!mis->have_preempt_thread) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&mis->postcopy_prio_thread_mutex) {
+        if (cancel) {
+            mis->preempt_thread_cancelled = true;
+            if (mis->postcopy_qemufile_dst) {
+                qemu_file_shutdown(mis->postcopy_qemufile_dst);
+            }
+        }
+    }
+    /* Wake the thread up in case the channel never connected */
+    qemu_sem_post(&mis->postcopy_qemufile_dst_done);
+    qemu_thread_join(&mis->postcopy_prio_thread);
+    mis->have_preempt_thread = false;
+}
+
+static void postcopy_preempt_send_channel_new(QIOTask *task, gpointer opaque)
+{
+    MigrationState *s = opaque;
+    QIOChannel *ioc = QIO_CHANNEL(qio_task_get_source(task));
+    Error *local_err = NULL;
+    QEMUFile *file;
+
+    if (qio_task_propagate_error(task, &local_err)) {
+        /* Requested pages will go on the main channel */
+        trace_postcopy_preempt_send_channel_error(
+            error_get_pretty(local_err));
+        warn_report_err(local_err);
+    } else {
+        migration_ioc_register_yank(ioc);
+        file = qemu_file_new_output(ioc);
+        /* Let the destination tell this channel from the main one */
+        qemu_put_be32(file, POSTCOPY_PREEMPT_MAGIC);
+        qemu_fflush(file);
+        if (qemu_file_get_error(file)) {
+            trace_postcopy_preempt_send_channel_error("cannot send magic");
+            warn_report("Cannot send the postcopy preempt channel header");
+            migration_ioc_unregister_yank(ioc);
+            qemu_fclose(file);
+        } else {
+            qemu_mutex_lock(&s->qemu_file_lock);
+            s->postcopy_qemufile_src = file;
+            qemu_mutex_unlock(&s->qemu_file_lock);
+            trace_postcopy_preempt_send_channel_connected();
+        }
+    }
+    qemu_sem_post(&s->postcopy_qemufile_src_sem);
+    object_unref(OBJECT(ioc));
+}
+
+int postcopy_preempt_setup(MigrationState *s, Error **errp)
+{
+    if (!migrate_postcopy_preempt()) {
+        return 0;
+    }
+
+    if (!migrate_multi_channels_is_allowed()) {
+        error_setg(errp, "Postcopy preempt is not supported by current "
+                   "protocol");
+        return -1;
+    }
+    if (migrate_use_tls()) {
+        error_setg(errp, "Postcopy preempt is not supported with TLS");
+        return -1;
+    }
+
+    /* Connect while precopy runs, postcopy_start waits for it */
+    socket_send_channel_create(postcopy_preempt_send_channel_new, s);
+    return 0;
+}
+
+void postcopy_preempt_wait_channel(MigrationState *s)
+{
+    if (migrate_postcopy_preempt()) {
+        qemu_sem_wait(&s->postcopy_qemufile_src_sem);
+    }
+}
+
+void postcopy_preempt_close_channel(MigrationState *s)
+{
+    QEMUFile *file;
+
+    qemu_mutex_lock(&s->qemu_file_lock);
+    file = s->postcopy_qemufile_src;
+    s->postcopy_qemufile_src = NULL;
+    qemu_mutex_unlock(&s->qemu_file_lock);
+
+    if (file) {
+        migration_ioc_unregister_yank_from_file(file);
+        qemu_file_shutdown(file);
+        qemu_fclose(file);
+    }
+}
+
 /**
  * postcopy_discard_send_init: Called at the start of each RAMBlock before
  *   asking to discard individual ranges.
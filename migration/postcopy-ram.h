@@ -135,6 +135,40 @@ void postcopy_remove_notifier(NotifierWithReturn *n);
 /* Call the notifier list set by postcopy_add_start_notifier */
 int postcopy_notify(enum PostcopyNotifyReason reason, Error **errp);
 
+/*
+ * Postcopy preemption: the pages requested by the destination are sent on
+ * a channel of their own, so that they do not wait behind the background
+ * stream.
+ */
+
+/*
+ * Sent first on the preempt channel, so that the destination can tell it
+ * from the main channel whatever order they connect in
+ */
+#define POSTCOPY_PREEMPT_MAGIC 0x51505245U
+
+/*
+ * Destination side: return true if @file is the preempt channel, after
+ * reading its magic.  Blocks until the first bytes of @file arrive.
+ */
+bool postcopy_preempt_is_channel(QEMUFile *file);
+/* Destination side: @file is the preempt channel */
+void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file);
+/*
+ * Destination side: stop the preempt thread.  Unless @cancel, it first
+ * loads the channel up to the EOS that ends it.
+ */
+void postcopy_preempt_stop_thread(MigrationIncomingState *mis, bool cancel);
+/* Source side: start connecting the preempt channel, if enabled */
+int postcopy_preempt_setup(MigrationState *s, Error **errp);
+/* Source side: wait until the preempt channel connected, or failed to */
+void postcopy_preempt_wait_channel(MigrationState *s);
+/*
+ * Source side: close the preempt channel, if any; requested pages are sent
+ * on the main channel from then on
+ */
+void postcopy_preempt_close_channel(MigrationState *s);
+
 void postcopy_thread_create(MigrationIncomingState *mis,
                             QemuThread *thread, const char *name,
                             void *(*fn)(void *), int joinable);
@@ -894,3 +894,53 @@ QIOChannel *qemu_file_get_ioc(QEMUFile *file)
 {
     return file->ioc;
 }
+
+/*
+ * qemu_get_offset:
+ *
+ * Get the position of the next byte to be read from or written to
+ * @f in its channel, which must support random access.
+ *
+ * Returns: the position, or -1 on error
+ */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    Error *local_error = NULL;
+    off_t pos;
+
+    qemu_fflush(f);
+    pos = qio_channel_io_seek(f->ioc, 0, SEEK_CUR, &local_error);
+    if (pos < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_error);
+        return -1;
+    }
+
+    /* Data buffered for reading comes before the channel position */
+    if (!qemu_file_is_writable(f)) {
+        pos -= f->buf_size - f->buf_index;
+    }
+    return pos;
+}
+
+/*
+ * qemu_set_offset:
+ *
+ * Move @f to position @pos in its channel, which must support
+ * random access.  Errors are reported through the file's error.
+ */
+void qemu_set_offset(QEMUFile *f, off_t pos)
+{
+    Error *local_error = NULL;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        /* Drop the buffered data, it is not at the new position */
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    if (qio_channel_io_seek(f->ioc, pos, SEEK_SET, &local_error) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_error);
+    }
+}
@@ -166,5 +166,7 @@ size_t ram_control_save_page(QEMUFile *f, ram_addr_t block_offset,
                              ram_addr_t offset, size_t size,
                              uint64_t *bytes_sent);
 QIOChannel *qemu_file_get_ioc(QEMUFile *file);
+off_t qemu_get_offset(QEMUFile *f);
+void qemu_set_offset(QEMUFile *f, off_t pos);
 
 #endif
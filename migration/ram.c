@@ -32,6 +32,7 @@
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
 #include "io/channel-null.h"
 #include "xbzrle.h"
 #include "ram.h"
@@ -53,9 +54,11 @@
 #include "migration/colo.h"
 #include "block.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/dirtylimit.h"
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "file.h"
 #include "sysemu/runstate.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
@@ -83,6 +86,16 @@
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
 
+/*
+ * Layout of a RAMBlock in a mapped-ram file, after its name and length
+ * in the RAM_SAVE_FLAG_MEM_SIZE record: a header, the bitmap of the
+ * pages present in the file, then the pages at their offset in the
+ * block, aligned so that they can be accessed with O_DIRECT.
+ */
+#define MAPPED_RAM_VERSION     1
+#define MAPPED_RAM_HEADER_SIZE (sizeof(uint32_t) + 3 * sizeof(uint64_t))
+#define MAPPED_RAM_ALIGN       (1 * MiB)
+
 XBZRLECacheStats xbzrle_counters;
 
 /* struct contains XBZRLE cache and a static page
@@ -306,6 +319,8 @@ struct RAMState {
     RAMBlock *last_seen_block;
     /* Last block from where we have sent data */
     RAMBlock *last_sent_block;
+    /* Last block sent on the postcopy preempt channel */
+    RAMBlock *postcopy_last_sent_block;
     /* Last dirty target page we have sent */
     ram_addr_t last_page;
     /* last ram version we have seen */
@@ -1096,7 +1111,8 @@ static void migration_trigger_throttle(RAMState *rs)
     /* During block migration the auto-converge logic incorrectly detects
      * that ram migration makes no progress. Avoid this by disabling the
      * throttling logic during the bulk phase of block migration. */
-    if (migrate_auto_converge() && !blk_mig_bulk_active()) {
+    if ((migrate_auto_converge() || migrate_dirty_limit()) &&
+        !blk_mig_bulk_active()) {
         /* The following detection logic can be refined later. For now:
            Check to see if the ratio between dirtied bytes and the approx.
            amount of bytes that just got transferred since the last time
@@ -1107,8 +1123,13 @@ static void migration_trigger_throttle(RAMState *rs)
             (++rs->dirty_rate_high_cnt >= 2)) {
             trace_migration_throttle();
             rs->dirty_rate_high_cnt = 0;
-            mig_throttle_guest_down(bytes_dirty_period,
-                                    bytes_dirty_threshold);
+            if (migrate_dirty_limit()) {
+                /* Only slow down the vCPUs that dirty memory too fast */
+                dirtylimit_migration_start(s->parameters.vcpu_dirty_limit);
+            } else {
+                mig_throttle_guest_down(bytes_dirty_period,
+                                        bytes_dirty_threshold);
+            }
         }
     }
 }
@@ -1353,7 +1374,115 @@ static int ram_save_multifd_page(RAMState *rs, RAMBlock *block,
     if (multifd_queue_page(rs->f, block, offset) < 0) {
         return -1;
     }
+
+    return 1;
+}
+
+/* Read or write exactly @len bytes of @buf at @offset of @ioc */
+static int ram_file_io_all(QIOChannel *ioc, uint8_t *buf, size_t len,
+                           off_t offset, bool write, Error **errp)
+{
+    while (len) {
+        ssize_t ret;
+
+        if (write) {
+            ret = qio_channel_pwrite(ioc, buf, len, offset, errp);
+        } else {
+            ret = qio_channel_pread(ioc, buf, len, offset, errp);
+        }
+        if (ret == -1) {
+            return -1;
+        }
+        if (ret <= 0) {
+            error_setg(errp, "Unexpected end of migration file");
+            return -1;
+        }
+        buf += ret;
+        offset += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/* Size in bytes of the bitmap of a mapped-ram block, see bitmap_to_le() */
+static size_t ram_file_bitmap_size(unsigned long nbits)
+{
+    return ROUND_UP(DIV_ROUND_UP(nbits, 8), 8);
+}
+
+/**
+ * ram_block_write_pages: write pages of a RAMBlock to a mapped-ram file
+ *
+ * Each run of contiguous pages is written with a single call.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @ioc: channel of the migration file
+ * @block: block that the pages belong to
+ * @offsets: offsets of the pages in the block, in increasing order
+ * @num: number of pages
+ * @errp: pointer to a NULL-initialized error object
+ */
+int ram_block_write_pages(QIOChannel *ioc, RAMBlock *block,
+                          ram_addr_t *offsets, uint32_t num, Error **errp)
+{
+    size_t page_size = qemu_target_page_size();
+    uint32_t i, j;
+
+    for (i = 0; i < num; i = j) {
+        for (j = i + 1; j < num; j++) {
+            if (offsets[j] != offsets[j - 1] + page_size) {
+                break;
+            }
+        }
+        if (ram_file_io_all(ioc, block->host + offsets[i],
+                            (j - i) * page_size,
+                            block->pages_offset + offsets[i],
+                            true, errp) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * ram_save_mapped_page: save a page at its offset in a mapped-ram file
+ *
+ * Returns the number of pages written, or -1 for error
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page
+ * @offset: offset inside the block for the page
+ */
+static int ram_save_mapped_page(RAMState *rs, RAMBlock *block,
+                                ram_addr_t offset)
+{
+    unsigned long page = offset >> TARGET_PAGE_BITS;
+    Error *local_err = NULL;
+
+    /*
+     * The destination RAM starts zeroed, so a zero page only has to be
+     * dropped from the file bitmap; a copy written earlier is ignored.
+     */
+    if (buffer_is_zero(block->host + offset, TARGET_PAGE_SIZE)) {
+        clear_bit(page, block->file_bmap);
+        ram_counters.duplicate++;
+        return 1;
+    }
+    set_bit(page, block->file_bmap);
+
+    if (migrate_use_multifd()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
+    if (ram_block_write_pages(qemu_file_get_ioc(rs->f), block, &offset, 1,
+                              &local_err) < 0) {
+        qemu_file_set_error_obj(rs->f, -EIO, local_err);
+        return -1;
+    }
     ram_counters.normal++;
+    ram_transferred_add(TARGET_PAGE_SIZE);
+    qemu_file_acct_rate_limit(rs->f, TARGET_PAGE_SIZE);
 
     return 1;
 }
@@ -2131,6 +2260,18 @@ static bool save_compress_page(RAMState *rs, RAMBlock *block, ram_addr_t offset)
     return false;
 }
 
+static bool save_page_use_multifd(RAMState *rs)
+{
+    /*
+     * Do not use multifd for:
+     * 1. Compression as the first page in the new block should be posted out
+     *    before sending the compressed page
+     * 2. In postcopy as one whole host page should be placed
+     */
+    return !save_page_use_compression(rs) && migrate_use_multifd()
+        && !migration_in_postcopy();
+}
+
 /**
  * ram_save_target_page: save one target page
  *
@@ -2145,6 +2286,10 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
     int res;
 
+    if (migrate_mapped_ram()) {
+        return ram_save_mapped_page(rs, block, offset);
+    }
+
     if (control_save_page(rs, block, offset, &res)) {
         return res;
     }
@@ -2153,6 +2298,11 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
         return 1;
     }
 
+    /* The multifd channels look for zero pages themselves. */
+    if (save_page_use_multifd(rs) && migrate_use_multifd_zero_page()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -2166,14 +2316,7 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
         return res;
     }
 
-    /*
-     * Do not use multifd for:
-     * 1. Compression as the first page in the new block should be posted out
-     *    before sending the compressed page
-     * 2. In postcopy as one whole host page should be placed
-     */
-    if (!save_page_use_compression(rs) && migrate_use_multifd()
-        && !migration_in_postcopy()) {
+    if (save_page_use_multifd(rs)) {
         return ram_save_multifd_page(rs, block, offset);
     }
 
@@ -2222,9 +2365,11 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
             pages += tmppages;
             /*
              * Allow rate limiting to happen in the middle of huge pages if
-             * something is sent in the current iteration.
+             * something is sent in the current iteration.  Pages requested
+             * by the destination are not rate limited.
              */
-            if (pagesize_bits > 1 && tmppages > 0) {
+            if (pagesize_bits > 1 && tmppages > 0 &&
+                !pss->postcopy_requested) {
                 migration_rate_limit();
             }
         }
@@ -2239,6 +2384,51 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
     return (res < 0 ? res : pages);
 }
 
+/**
+ * ram_save_urgent_host_page: save a host page requested by the destination
+ *
+ * With postcopy preemption, the page is sent on the preempt channel and
+ * flushed at once, rather than queued behind the background stream on the
+ * main channel.  The main channel is always left at a host page boundary,
+ * since postcopy only sends whole host pages.
+ *
+ * Returns the number of pages written or negative on error
+ *
+ * @rs: current RAM state
+ * @pss: data about the page we want to send
+ */
+static int ram_save_urgent_host_page(RAMState *rs, PageSearchStatus *pss)
+{
+    QEMUFile *preempt_f = migrate_get_current()->postcopy_qemufile_src;
+    QEMUFile *main_f = rs->f;
+    RAMBlock *main_block = rs->last_sent_block;
+    int pages, ret;
+
+    if (!preempt_f || !migration_in_postcopy()) {
+        return ram_save_host_page(rs, pss);
+    }
+
+    /* Each channel has its own RAM_SAVE_FLAG_CONTINUE state */
+    rs->f = preempt_f;
+    rs->last_sent_block = rs->postcopy_last_sent_block;
+    pages = ram_save_host_page(rs, pss);
+    qemu_fflush(preempt_f);
+    rs->postcopy_last_sent_block = rs->last_sent_block;
+    rs->f = main_f;
+    rs->last_sent_block = main_block;
+
+    /*
+     * The destination may never get the page; fail the main channel too,
+     * so that postcopy pauses and can be recovered.
+     */
+    ret = qemu_file_get_error(preempt_f);
+    if (ret < 0) {
+        qemu_file_set_error(main_f, ret);
+        return ret;
+    }
+    return pages;
+}
+
 /**
  * ram_find_and_save_block: finds a dirty page and sends it to f
  *
@@ -2281,7 +2471,11 @@ static int ram_find_and_save_block(RAMState *rs)
         }
 
         if (found) {
-            pages = ram_save_host_page(rs, &pss);
+            if (pss.postcopy_requested && migrate_postcopy_preempt()) {
+                pages = ram_save_urgent_host_page(rs, &pss);
+            } else {
+                pages = ram_save_host_page(rs, &pss);
+            }
         }
     } while (!pages && again);
 
@@ -2391,6 +2585,8 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
     xbzrle_cleanup();
@@ -2402,6 +2598,7 @@ static void ram_state_reset(RAMState *rs)
 {
     rs->last_seen_block = NULL;
     rs->last_sent_block = NULL;
+    rs->postcopy_last_sent_block = NULL;
     rs->last_page = 0;
     rs->last_version = ram_list.version;
     rs->xbzrle_enabled = false;
@@ -2595,6 +2792,7 @@ void ram_postcopy_send_discard_bitmap(MigrationState *ms)
     /* Easiest way to make sure we don't resume in the middle of a host-page */
     rs->last_seen_block = NULL;
     rs->last_sent_block = NULL;
+    rs->postcopy_last_sent_block = NULL;
     rs->last_page = 0;
 
     postcopy_each_ram_send_discard(ms);
@@ -2897,6 +3095,59 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
  * granularity of these critical sections.
  */
 
+/*
+ * Reserve the bitmap and the pages of @block in a mapped-ram file, and
+ * describe them in the stream.
+ */
+static void ram_save_mapped_header(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long npages = block->used_length >> TARGET_PAGE_BITS;
+
+    block->bitmap_offset = qemu_get_offset(f) + MAPPED_RAM_HEADER_SIZE;
+    block->pages_offset = ROUND_UP(block->bitmap_offset +
+                                   ram_file_bitmap_size(npages),
+                                   MAPPED_RAM_ALIGN);
+
+    qemu_put_be32(f, MAPPED_RAM_VERSION);
+    qemu_put_be64(f, TARGET_PAGE_SIZE);
+    qemu_put_be64(f, block->bitmap_offset);
+    qemu_put_be64(f, block->pages_offset);
+
+    /* The stream goes on after the pages */
+    qemu_set_offset(f, block->pages_offset + block->used_length);
+
+    g_free(block->file_bmap);
+    block->file_bmap = bitmap_new(npages);
+}
+
+/* Store the bitmap of the pages of each block in a mapped-ram file */
+static int ram_save_mapped_bitmaps(QEMUFile *f)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    Error *local_err = NULL;
+    RAMBlock *block;
+    int ret = 0;
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        unsigned long nbits = block->used_length >> TARGET_PAGE_BITS;
+        size_t size = ram_file_bitmap_size(nbits);
+        unsigned long *le_bitmap = bitmap_new(nbits + BITS_PER_LONG);
+
+        /* The file may be restored on a host of another endianness */
+        bitmap_to_le(le_bitmap, block->file_bmap, nbits);
+        ret = ram_file_io_all(ioc, (uint8_t *)le_bitmap, size,
+                              block->bitmap_offset, true, &local_err);
+        g_free(le_bitmap);
+        if (ret < 0) {
+            qemu_file_set_error_obj(f, -EIO, local_err);
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
 /**
  * ram_save_setup: Setup RAM for migration
  *
@@ -2938,9 +3189,17 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_mapped_ram()) {
+                ram_save_mapped_header(f, block);
+            }
         }
     }
 
+    ret = qemu_file_get_error(f);
+    if (ret < 0) {
+        return ret;
+    }
+
     ram_control_before_iterate(f, RAM_CONTROL_SETUP);
     ram_control_after_iterate(f, RAM_CONTROL_SETUP);
 
@@ -3130,6 +3389,24 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         return ret;
     }
 
+    /* All pages are in the file now */
+    if (migrate_mapped_ram()) {
+        ret = ram_save_mapped_bitmaps(f);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (migration_in_postcopy()) {
+        QEMUFile *preempt_f = migrate_get_current()->postcopy_qemufile_src;
+
+        /* Let the preempt thread of the destination finish */
+        if (preempt_f) {
+            qemu_put_be64(preempt_f, RAM_SAVE_FLAG_EOS);
+            qemu_fflush(preempt_f);
+        }
+    }
+
     qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
     qemu_fflush(f);
 
@@ -3209,11 +3486,13 @@ static int load_xbzrle(QEMUFile *f, ram_addr_t addr, void *host)
  * @mis: the migration incoming state pointer
  * @f: QEMUFile where to read the data from
  * @flags: Page flags (mostly to see if it's a continuation of previous block)
+ * @channel: the channel we're using
  */
 static inline RAMBlock *ram_block_from_stream(MigrationIncomingState *mis,
-                                              QEMUFile *f, int flags)
+                                              QEMUFile *f, int flags,
+                                              int channel)
 {
-    RAMBlock *block = mis->last_recv_block;
+    RAMBlock *block = mis->last_recv_block[channel];
     char id[256];
     uint8_t len;
 
@@ -3240,7 +3519,7 @@ static inline RAMBlock *ram_block_from_stream(MigrationIncomingState *mis,
         return NULL;
     }
 
-    mis->last_recv_block = block;
+    mis->last_recv_block[channel] = block;
 
     return block;
 }
@@ -3655,19 +3934,20 @@ int ram_postcopy_incoming_init(MigrationIncomingState *mis)
  *
  * Returns 0 for success or -errno in case of error
  *
- * Called in postcopy mode by ram_load().
+ * Called in postcopy mode by ram_load(), and by the postcopy preempt
+ * thread for the preempt channel.
  * rcu_read_lock is taken prior to this being called.
  *
  * @f: QEMUFile where to send the data
+ * @channel: the channel to use for loading
  */
-int ram_load_postcopy(QEMUFile *f)
+int ram_load_postcopy(QEMUFile *f, int channel)
 {
     int flags = 0, ret = 0;
     bool place_needed = false;
     bool matches_target_page_size = false;
     MigrationIncomingState *mis = migration_incoming_get_current();
-    /* Currently we only use channel 0.  TODO: use all the channels */
-    PostcopyTmpPage *tmp_page = &mis->postcopy_tmp_pages[0];
+    PostcopyTmpPage *tmp_page = &mis->postcopy_tmp_pages[channel];
 
     while (!ret && !(flags & RAM_SAVE_FLAG_EOS)) {
         ram_addr_t addr;
@@ -3694,7 +3974,7 @@ int ram_load_postcopy(QEMUFile *f)
         trace_ram_load_postcopy_loop((uint64_t)addr, flags);
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE)) {
-            block = ram_block_from_stream(mis, f, flags);
+            block = ram_block_from_stream(mis, f, flags, channel);
             if (!block) {
                 ret = -EINVAL;
                 break;
@@ -3799,7 +4079,9 @@ int ram_load_postcopy(QEMUFile *f)
 
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
-            multifd_recv_sync_main();
+            if (channel == RAM_CHANNEL_PRECOPY) {
+                multifd_recv_sync_main();
+            }
             break;
         default:
             error_report("Unknown combination of migration flags: 0x%x"
@@ -3894,6 +4176,150 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+typedef struct MappedRamLoadParams {
+    QemuThread thread;
+    QIOChannel *ioc;
+    RAMBlock *block;
+    /* Pages [start, end) of the block are loaded by this thread */
+    unsigned long start;
+    unsigned long end;
+    Error *err;
+} MappedRamLoadParams;
+
+static void *ram_load_mapped_thread(void *opaque)
+{
+    MappedRamLoadParams *p = opaque;
+    RAMBlock *block = p->block;
+    unsigned long run_start, run_end = p->start;
+
+    while (true) {
+        ram_addr_t offset;
+
+        run_start = find_next_bit(block->file_bmap, p->end, run_end);
+        if (run_start >= p->end) {
+            break;
+        }
+        run_end = find_next_zero_bit(block->file_bmap, p->end, run_start);
+
+        offset = (ram_addr_t)run_start << TARGET_PAGE_BITS;
+        if (ram_file_io_all(p->ioc, block->host + offset,
+                            (run_end - run_start) << TARGET_PAGE_BITS,
+                            block->pages_offset + offset,
+                            false, &p->err) < 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Read the pages of @block present in a mapped-ram file, with one
+ * thread per multifd channel each reading a slice of the block.
+ */
+static int ram_load_mapped_pages(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long npages = block->used_length >> TARGET_PAGE_BITS;
+    int nthreads = MAX(migrate_multifd_channels(), 1);
+    unsigned long slice = DIV_ROUND_UP(npages, nthreads);
+    MappedRamLoadParams *params = g_new0(MappedRamLoadParams, nthreads);
+    Error *local_err = NULL;
+    int i, ret = 0;
+
+    for (i = 0; i < nthreads; i++) {
+        MappedRamLoadParams *p = &params[i];
+
+        p->block = block;
+        p->start = MIN(i * slice, npages);
+        p->end = MIN(p->start + slice, npages);
+        if (migrate_direct_io()) {
+            p->ioc = file_new_channel(O_RDONLY, &p->err);
+            if (!p->ioc) {
+                continue;
+            }
+        } else {
+            p->ioc = qemu_file_get_ioc(f);
+            object_ref(OBJECT(p->ioc));
+        }
+        qemu_thread_create(&p->thread, "mapped-ram-load",
+                           ram_load_mapped_thread, p, QEMU_THREAD_JOINABLE);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        MappedRamLoadParams *p = &params[i];
+
+        if (p->ioc) {
+            qemu_thread_join(&p->thread);
+            object_unref(OBJECT(p->ioc));
+        }
+        if (p->err) {
+            if (!local_err) {
+                local_err = p->err;
+            } else {
+                error_free(p->err);
+            }
+        }
+    }
+    g_free(params);
+
+    if (local_err) {
+        error_report_err(local_err);
+        ret = -EIO;
+    }
+    return ret;
+}
+
+/*
+ * Load @block from a mapped-ram file.  The stream is positioned after
+ * the name and length of the block, and is moved past its pages.
+ */
+static int ram_load_mapped_block(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long nbits = block->used_length >> TARGET_PAGE_BITS;
+    size_t size = ram_file_bitmap_size(nbits);
+    unsigned long *le_bitmap;
+    Error *local_err = NULL;
+    uint32_t version;
+    uint64_t page_size;
+    int ret;
+
+    version = qemu_get_be32(f);
+    page_size = qemu_get_be64(f);
+    block->bitmap_offset = qemu_get_be64(f);
+    block->pages_offset = qemu_get_be64(f);
+    ret = qemu_file_get_error(f);
+    if (ret < 0) {
+        return ret;
+    }
+    if (version != MAPPED_RAM_VERSION || page_size != TARGET_PAGE_SIZE) {
+        error_report("Unsupported mapped-ram block %s: version %" PRIu32
+                     ", page size %" PRIu64, block->idstr, version,
+                     page_size);
+        return -EINVAL;
+    }
+
+    le_bitmap = bitmap_new(nbits + BITS_PER_LONG);
+    if (ram_file_io_all(qemu_file_get_ioc(f), (uint8_t *)le_bitmap, size,
+                        block->bitmap_offset, false, &local_err) < 0) {
+        error_report_err(local_err);
+        g_free(le_bitmap);
+        return -EIO;
+    }
+    block->file_bmap = bitmap_new(nbits);
+    bitmap_from_le(block->file_bmap, le_bitmap, nbits);
+    g_free(le_bitmap);
+
+    ret = ram_load_mapped_pages(f, block);
+
+    g_free(block->file_bmap);
+    block->file_bmap = NULL;
+    if (ret < 0) {
+        return ret;
+    }
+
+    qemu_set_offset(f, block->pages_offset + block->used_length);
+    return qemu_file_get_error(f);
+}
+
 /**
  * ram_load_precopy: load pages in precopy case
  *
@@ -3945,7 +4371,8 @@ static int ram_load_precopy(QEMUFile *f)
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
-            RAMBlock *block = ram_block_from_stream(mis, f, flags);
+            RAMBlock *block = ram_block_from_stream(mis, f, flags,
+                                                    RAM_CHANNEL_PRECOPY);
 
             host = host_from_ram_block_offset(block, addr);
             /*
@@ -4034,6 +4461,9 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_mapped_ram()) {
+                        ret = ram_load_mapped_block(f, block);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -4122,7 +4552,7 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
      */
     WITH_RCU_READ_LOCK_GUARD() {
         if (postcopy_running) {
-            ret = ram_load_postcopy(f);
+            ret = ram_load_postcopy(f, RAM_CHANNEL_PRECOPY);
         } else {
             ret = ram_load_precopy(f);
         }
@@ -2540,6 +2540,13 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
 {
     int i;
 
+    /*
+     * A recovered postcopy only uses the main channel.  Stop the preempt
+     * thread first, so that it neither touches the temp pages reset below
+     * nor from_src_file once it is closed.
+     */
+    postcopy_preempt_stop_thread(mis, true);
+
     /*
      * If network is interrupted, any temp page we received will be useless
      * because we didn't mark them as "received" in receivedmap.  After a
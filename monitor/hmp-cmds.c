@@ -369,6 +369,12 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+    if (info->has_postcopy_latency) {
+        monitor_printf(mon, "postcopy request latency: %" PRIu64
+                       " us (max %" PRIu64 " us)\n",
+                       info->postcopy_latency / 1000,
+                       info->postcopy_latency_max / 1000);
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -498,6 +504,13 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %" PRIu64 "\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MAX_POSTCOPY_BANDWIDTH),
             params->max_postcopy_bandwidth);
+        monitor_printf(mon, "%s: %" PRIu64 " MB/s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT),
+            params->vcpu_dirty_limit);
+        assert(params->has_direct_io);
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRECT_IO),
+            params->direct_io ? "on" : "off");
         monitor_printf(mon, "%s: '%s'\n",
             MigrationParameter_str(MIGRATION_PARAMETER_TLS_AUTHZ),
             params->tls_authz);
@@ -1326,6 +1339,14 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_max_postcopy_bandwidth = true;
         visit_type_size(v, param, &p->max_postcopy_bandwidth, &err);
         break;
+    case MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT:
+        p->has_vcpu_dirty_limit = true;
+        visit_type_uint64(v, param, &p->vcpu_dirty_limit, &err);
+        break;
+    case MIGRATION_PARAMETER_DIRECT_IO:
+        p->has_direct_io = true;
+        visit_type_bool(v, param, &p->direct_io, &err);
+        break;
     case MIGRATION_PARAMETER_ANNOUNCE_INITIAL:
         p->has_announce_initial = true;
         visit_type_size(v, param, &p->announce_initial, &err);
@@ -20,6 +20,7 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
 #include "qemu/rcu.h"
+#include "qemu/main-loop.h"
 #include "hw/core/cpu.h"
 #include "exec/cpu-common.h"
 
@@ -210,10 +211,231 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/* Called with plugin.lock held; returns true if the elements moved */
+static bool plugin_resize_scoreboards__locked(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    int max_vcpus = qemu_plugin_n_max_vcpus();
+    size_t new_size;
+
+    if (cpu->cpu_index < plugin.scoreboard_alloc_size) {
+        return false;
+    }
+
+    new_size = MAX(cpu->cpu_index + 1, plugin.scoreboard_alloc_size * 2);
+    /* in system mode, size for hotpluggable vCPUs as well */
+    if (max_vcpus > 0) {
+        new_size = MAX(new_size, max_vcpus);
+    }
+    plugin.scoreboard_alloc_size = new_size;
+
+    QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+        g_array_set_size(score->data, new_size);
+    }
+    return !QLIST_EMPTY(&plugin.scoreboards);
+}
+
+/*
+ * Make room for @cpu in all scoreboards.  Translated code embeds the
+ * address of the elements, so if other vCPUs may be running (in user-mode
+ * threads are created by a running vCPU) they must be stopped while the
+ * arrays move, and the code that refers to the old arrays dropped.
+ *
+ * plugin.lock is not held across start_exclusive(): a running vCPU may be
+ * waiting for it, e.g. to allocate a scoreboard from a translation
+ * callback, and would never reach the exclusive section.
+ */
+static void plugin_grow_scoreboards(CPUState *cpu)
+{
+    bool moved;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    if (cpu->cpu_index < plugin.scoreboard_alloc_size) {
+        qemu_rec_mutex_unlock(&plugin.lock);
+        return;
+    }
+    if (!current_cpu || QLIST_EMPTY(&plugin.scoreboards)) {
+        plugin_resize_scoreboards__locked(cpu);
+        qemu_rec_mutex_unlock(&plugin.lock);
+        return;
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    start_exclusive();
+    /* the scoreboards may have been grown or created in the meantime */
+    qemu_rec_mutex_lock(&plugin.lock);
+    moved = plugin_resize_scoreboards__locked(cpu);
+    qemu_rec_mutex_unlock(&plugin.lock);
+    if (moved) {
+        tb_flush(current_cpu);
+    }
+    end_exclusive();
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    score = g_new0(struct qemu_plugin_scoreboard, 1);
+    score->data = g_array_new(false, true, element_size);
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    g_array_set_size(score->data, plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_array_free(score->data, true);
+    g_free(score);
+}
+
+uint64_t *plugin_u64_address(qemu_plugin_u64 entry, unsigned int vcpu_index)
+{
+    char *base = qemu_plugin_scoreboard_find(entry.score, vcpu_index);
+
+    return (uint64_t *)(base + entry.offset);
+}
+
+struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_new(size_t n_records, qemu_plugin_vcpu_mem_batch_cb_t cb,
+                      void *userdata)
+{
+    struct qemu_plugin_mem_buffer *buf;
+    size_t size;
+
+    n_records = MAX(n_records, PLUGIN_MEM_BUFFER_MIN_RECORDS);
+    size = sizeof(struct qemu_plugin_mem_buffer_vcpu) +
+           n_records * sizeof(struct qemu_plugin_mem_record);
+    buf = g_new0(struct qemu_plugin_mem_buffer, 1);
+    buf->score = plugin_scoreboard_new(size);
+    buf->n_records = n_records;
+    buf->cb = cb;
+    buf->userdata = userdata;
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    QLIST_INSERT_HEAD_RCU(&plugin.mem_buffers, buf, entry);
+    return buf;
+}
+
+void plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE_RCU(buf, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    plugin_scoreboard_free(buf->score);
+    g_free(buf);
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+static void plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                                    unsigned int cpu_index)
+{
+    struct qemu_plugin_mem_buffer_vcpu *vbuf;
+
+    vbuf = qemu_plugin_scoreboard_find(buf->score, cpu_index);
+    if (vbuf->n) {
+        buf->cb(cpu_index, vbuf->records, vbuf->n, buf->userdata);
+        vbuf->n = 0;
+    }
+}
+
+/*
+ * called from translated code before an instruction appends @n_accesses
+ * records to the buffer of @cpu_index
+ */
+void HELPER(plugin_mem_buffer_reserve)(uint32_t cpu_index, void *buf,
+                                       uint32_t n_accesses)
+{
+    struct qemu_plugin_mem_buffer *b = buf;
+    struct qemu_plugin_mem_buffer_vcpu *vbuf;
+
+    vbuf = qemu_plugin_scoreboard_find(b->score, cpu_index);
+    if (vbuf->n > b->n_records - n_accesses) {
+        plugin_mem_buffer_flush(b, cpu_index);
+    }
+}
+
+/*
+ * Translated code only makes room in the buffer at the start of each
+ * instruction, for the accesses that the instruction performs inline.
+ * Accesses from helpers must not use up that room, so they are delivered
+ * right away, after whatever is already buffered.
+ */
+QEMU_DISABLE_CFI
+static void plugin_mem_buffer_deliver(struct qemu_plugin_mem_buffer *buf,
+                                      unsigned int cpu_index, uint64_t vaddr,
+                                      qemu_plugin_meminfo_t info, void *udata)
+{
+    struct qemu_plugin_mem_record rec = {
+        .vaddr = vaddr,
+        .userdata = udata,
+        .info = info,
+    };
+
+    plugin_mem_buffer_flush(buf, cpu_index);
+    buf->cb(cpu_index, &rec, 1, buf->userdata);
+}
+
+/*
+ * The buffers of a vCPU must only be flushed by the vCPU itself, or while
+ * it cannot append to them.  Like the callback lists, the list of buffers
+ * is walked without plugin.lock so that the callbacks do not run with it.
+ */
+static void plugin_mem_buffers_flush_vcpu(unsigned int cpu_index)
+{
+    struct qemu_plugin_mem_buffer *buf;
+
+    QLIST_FOREACH_RCU(buf, &plugin.mem_buffers, entry) {
+        plugin_mem_buffer_flush(buf, cpu_index);
+    }
+}
+
+/*
+ * At exit, flush the buffers of the exiting vCPU, which may be the one
+ * that called exit(), e.g. for semihosting, without the BQL.  In system
+ * mode the buffers of vCPUs that are stopped are flushed as well, but
+ * that needs the BQL to be sure that they stay stopped.  Those of vCPUs
+ * that may still run are left alone.
+ */
+static void plugin_mem_buffers_flush_at_exit(void)
+{
+#ifndef CONFIG_USER_ONLY
+    CPUState *cpu;
+#endif
+
+    if (current_cpu) {
+        plugin_mem_buffers_flush_vcpu(current_cpu->cpu_index);
+    }
+#ifndef CONFIG_USER_ONLY
+    if (!qemu_mutex_iothread_locked()) {
+        return;
+    }
+    CPU_FOREACH(cpu) {
+        if (cpu != current_cpu && cpu_is_stopped(cpu)) {
+            plugin_mem_buffers_flush_vcpu(cpu->cpu_index);
+        }
+    }
+#endif
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_grow_scoreboards(cpu);
+
     qemu_rec_mutex_lock(&plugin.lock);
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
@@ -228,6 +450,7 @@ void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_mem_buffers_flush_vcpu(cpu->cpu_index);
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
 
     qemu_rec_mutex_lock(&plugin.lock);
@@ -290,6 +513,25 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->userp = ptr;
     dyn_cb->type = PLUGIN_CB_INLINE;
     dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry.score = NULL;
+    dyn_cb->inline_insn.entry.offset = 0;
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry = entry;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
 }
@@ -307,6 +549,25 @@ void plugin_register_dyn_cb__udata(GArray **arr,
     dyn_cb->type = PLUGIN_CB_REGULAR;
 }
 
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.entry = entry;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.imm = imm;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -323,6 +584,20 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->f.generic = cb;
 }
 
+void plugin_register_vcpu_mem_buffer(GArray **arr,
+                                     enum qemu_plugin_mem_rw rw,
+                                     struct qemu_plugin_mem_buffer *buf,
+                                     void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = udata;
+    dyn_cb->type = PLUGIN_CB_BATCH;
+    dyn_cb->rw = rw;
+    dyn_cb->batch.buf = buf;
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -392,6 +667,7 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
 
 void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
+    plugin_mem_buffers_flush_vcpu(cpu->cpu_index);
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
 }
 
@@ -432,14 +708,27 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+bool qemu_plugin_loaded(void)
+{
+    /* Plugins are only loaded at startup */
+    return !QTAILQ_EMPTY(&plugin.ctxs);
+}
+
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
     uint64_t *val = cb->userp;
 
+    if (cb->inline_insn.entry.score) {
+        val = plugin_u64_address(cb->inline_insn.entry, cpu_index);
+    }
+
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
@@ -459,7 +748,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
             &g_array_index(arr, struct qemu_plugin_dyn_cb, i);
 
         if (!(rw & cb->rw)) {
-                break;
+            continue;
         }
         switch (cb->type) {
         case PLUGIN_CB_REGULAR:
@@ -467,7 +756,11 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
+            break;
+        case PLUGIN_CB_BATCH:
+            plugin_mem_buffer_deliver(cb->batch.buf, cpu->cpu_index, vaddr,
+                                      make_plugin_meminfo(oi, rw), cb->userp);
             break;
         default:
             g_assert_not_reached();
@@ -477,6 +770,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
 
 void qemu_plugin_atexit_cb(void)
 {
+    plugin_mem_buffers_flush_at_exit();
     plugin_cb__udata(QEMU_PLUGIN_EV_ATEXIT);
 }
 
@@ -500,7 +794,7 @@ void qemu_plugin_user_exit(void)
     enum qemu_plugin_event ev;
     CPUState *cpu;
 
-    QEMU_LOCK_GUARD(&plugin.lock);
+    qemu_rec_mutex_lock(&plugin.lock);
 
     start_exclusive();
 
@@ -520,6 +814,13 @@ void qemu_plugin_user_exit(void)
         qemu_plugin_disable_mem_helpers(cpu);
     }
 
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    /* the other vCPUs are stopped, so their buffers can be flushed */
+    CPU_FOREACH(cpu) {
+        plugin_mem_buffers_flush_vcpu(cpu->cpu_index);
+    }
+
     end_exclusive();
 
     /* now it's safe to handle the exit case */
@@ -552,6 +853,8 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QTAILQ_INIT(&plugin.ctxs);
+    QLIST_INIT(&plugin.scoreboards);
+    QLIST_INIT(&plugin.mem_buffers);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
     atexit(qemu_plugin_atexit_cb);
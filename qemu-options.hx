@@ -181,9 +181,11 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                select accelerator (kvm, xen, hax, hvf, nvmm, whpx or tcg; use 'help' for a list)\n"
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
+    "                jmp-cache-size=n (TCG jump cache entries per vCPU)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-stats=on|off (collect TCG translation block statistics)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -206,6 +208,13 @@ SRST
         non-MSI interrupts. Disabling the in-kernel irqchip completely
         is not recommended except for debugging purposes.
 
+    ``jmp-cache-size=n``
+        Controls the number of entries of the per-vCPU cache that maps
+        the guest program counter to a translation block. It must be a
+        power of two between 256 and 1048576; the default is 4096.
+        Guests that execute a lot of different code may benefit from a
+        larger cache; ``info jit`` reports its hit rate.
+
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
@@ -218,6 +227,12 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-stats=on|off``
+        Collects execution counts and translation statistics for each
+        translation block, for use by the ``info tb-stats`` monitor
+        command. Blocks are slightly slower when enabled. The default
+        is off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -4450,6 +4465,8 @@ DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming exec:cmdline\n" \
     "                accept incoming migration on given file descriptor\n" \
     "                or from given external command\n" \
+    "-incoming file:filename\n" \
+    "                restore a migration saved to the given file\n" \
     "-incoming defer\n" \
     "                wait for the URI to be specified via migrate_incoming\n",
     QEMU_ARCH_ALL)
@@ -4469,6 +4486,12 @@ SRST
     Accept incoming migration as an output from specified external
     command.
 
+``-incoming file:filename``
+    Restore a migration that the source saved to the given file with
+    ``migrate file:filename``.  With the ``mapped-ram`` capability, the
+    pages are read in parallel by as many threads as ``multifd-channels``;
+    the ``multifd`` capability itself is only used by the source.
+
 ``-incoming defer``
     Wait for the URI to be specified via migrate\_incoming. The monitor
     can be used to change settings (such as migration parameters) prior
@@ -0,0 +1,330 @@
+/*
+ * Dirty page rate limit of vCPUs
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "exec/memory.h"
+#include "exec/target_page.h"
+#include "hw/boards.h"
+#include "hw/core/cpu.h"
+#include "monitor/hmp.h"
+#include "monitor/monitor.h"
+#include "sysemu/dirtylimit.h"
+#include "sysemu/kvm.h"
+#include "trace.h"
+
+/*
+ * Every vCPU exits to QEMU when its dirty ring is full, that is after it
+ * dirtied ring_size pages; this is where it sleeps.  Once per period, the
+ * dirty rate R of each limited vCPU is measured from the pages reaped from
+ * its ring, and the sleep time s per ring full is adjusted so that the
+ * time to fill the ring becomes ring_bytes / quota:
+ *
+ *     s' = s + ring_bytes / quota - ring_bytes / R
+ *
+ * The new value is averaged with the old one to damp oscillations.
+ */
+#define DIRTYLIMIT_PERIOD_MS        1000
+#define DIRTYLIMIT_MAX_THROTTLE_US  (1000 * 1000)
+#define DIRTYLIMIT_SLICE_US         (10 * 1000)
+
+typedef struct VcpuDirtyLimitState {
+    bool enabled;
+    uint64_t quota;          /* MB/s */
+    uint64_t current_rate;   /* MB/s, over the last period */
+    uint64_t last_pages;
+    int64_t throttle_us;     /* read by the vCPU thread */
+} VcpuDirtyLimitState;
+
+/*
+ * Protected by the BQL, except for throttle_us.  The array is allocated
+ * once, for the maximum number of vCPUs, and never freed.
+ */
+static VcpuDirtyLimitState *dirtylimit_state;
+static int dirtylimit_nvcpus;
+static int dirtylimit_enabled_count;
+static QEMUTimer *dirtylimit_timer;
+static int64_t dirtylimit_last_ms;
+/* The limits were set by migration and QMP may not change them */
+static bool dirtylimit_migration;
+
+static VcpuDirtyLimitState *dirtylimit_vcpu_state(CPUState *cpu)
+{
+    VcpuDirtyLimitState *state = qatomic_read(&dirtylimit_state);
+
+    if (!state || cpu->cpu_index >= dirtylimit_nvcpus) {
+        return NULL;
+    }
+    return &state[cpu->cpu_index];
+}
+
+static void dirtylimit_adjust(CPUState *cpu, VcpuDirtyLimitState *s,
+                              int64_t period_ms)
+{
+    uint64_t ring_bytes = (uint64_t)kvm_dirty_ring_size() *
+                          qemu_target_page_size();
+    /* At most DIRTYLIMIT_MAX_RATE MiB, this cannot overflow */
+    uint64_t quota_bytes = s->quota * MiB;
+    uint64_t pages = cpu->dirty_pages - s->last_pages;
+    uint64_t bytes_per_sec;
+    int64_t throttle_us = s->throttle_us;
+
+    s->last_pages = cpu->dirty_pages;
+    bytes_per_sec = pages * qemu_target_page_size() * 1000 / period_ms;
+    s->current_rate = bytes_per_sec >> 20;
+
+    if (!bytes_per_sec) {
+        /* The vCPU does not fill its ring anymore, release it slowly. */
+        throttle_us /= 2;
+    } else {
+        int64_t target = throttle_us +
+            (int64_t)(ring_bytes * 1000000 / quota_bytes) -
+            (int64_t)(ring_bytes * 1000000 / bytes_per_sec);
+
+        throttle_us = (throttle_us + target) / 2;
+    }
+    throttle_us = MIN(MAX(throttle_us, 0), DIRTYLIMIT_MAX_THROTTLE_US);
+
+    qatomic_set(&s->throttle_us, throttle_us);
+    trace_dirtylimit_adjust(cpu->cpu_index, s->current_rate, s->quota,
+                            throttle_us);
+}
+
+static void dirtylimit_timer_tick(void *opaque)
+{
+    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int64_t period_ms = MAX(now - dirtylimit_last_ms, 1);
+    CPUState *cpu;
+
+    /* Reap the dirty rings, so that cpu->dirty_pages is up to date */
+    memory_global_dirty_log_sync();
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *s = dirtylimit_vcpu_state(cpu);
+
+        if (s && s->enabled) {
+            dirtylimit_adjust(cpu, s, period_ms);
+        }
+    }
+
+    dirtylimit_last_ms = now;
+    timer_mod(dirtylimit_timer, now + DIRTYLIMIT_PERIOD_MS);
+}
+
+static void dirtylimit_start(void)
+{
+    CPUState *cpu;
+
+    memory_global_dirty_log_start(GLOBAL_DIRTY_LIMIT);
+    if (!dirtylimit_timer) {
+        dirtylimit_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                        dirtylimit_timer_tick, NULL);
+    }
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *s = dirtylimit_vcpu_state(cpu);
+
+        if (s) {
+            s->last_pages = cpu->dirty_pages;
+        }
+    }
+    dirtylimit_last_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    timer_mod(dirtylimit_timer, dirtylimit_last_ms + DIRTYLIMIT_PERIOD_MS);
+}
+
+static void dirtylimit_stop(void)
+{
+    timer_del(dirtylimit_timer);
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_LIMIT);
+}
+
+void dirtylimit_set_vcpu(int cpu_index, uint64_t quota, bool enable)
+{
+    VcpuDirtyLimitState *s;
+
+    if (!dirtylimit_state) {
+        dirtylimit_nvcpus = current_machine->smp.max_cpus;
+        qatomic_set(&dirtylimit_state,
+                    g_new0(VcpuDirtyLimitState, dirtylimit_nvcpus));
+    }
+    assert(cpu_index < dirtylimit_nvcpus);
+    s = &dirtylimit_state[cpu_index];
+
+    if (enable) {
+        s->quota = quota;
+        if (!s->enabled) {
+            s->enabled = true;
+            s->current_rate = 0;
+            if (dirtylimit_enabled_count++ == 0) {
+                dirtylimit_start();
+            }
+        }
+    } else if (s->enabled) {
+        s->enabled = false;
+        qatomic_set(&s->throttle_us, 0);
+        if (--dirtylimit_enabled_count == 0) {
+            dirtylimit_stop();
+        }
+    }
+}
+
+void dirtylimit_set_all(uint64_t quota, bool enable)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        dirtylimit_set_vcpu(cpu->cpu_index, quota, enable);
+    }
+}
+
+void dirtylimit_vcpu_execute(CPUState *cpu)
+{
+    VcpuDirtyLimitState *s = dirtylimit_vcpu_state(cpu);
+    int64_t sleep_us;
+
+    if (!s) {
+        return;
+    }
+
+    sleep_us = qatomic_read(&s->throttle_us);
+    if (sleep_us) {
+        trace_dirtylimit_vcpu_execute(cpu->cpu_index, sleep_us);
+    }
+    /* Sleep in slices, so that stopping the vCPU is not delayed */
+    while (sleep_us > 0 && !qatomic_read(&cpu->stop)) {
+        g_usleep(MIN(sleep_us, DIRTYLIMIT_SLICE_US));
+        sleep_us -= DIRTYLIMIT_SLICE_US;
+    }
+}
+
+void dirtylimit_migration_start(uint64_t quota)
+{
+    dirtylimit_set_all(quota, true);
+    dirtylimit_migration = true;
+}
+
+void dirtylimit_migration_stop(void)
+{
+    if (dirtylimit_migration) {
+        dirtylimit_migration = false;
+        dirtylimit_set_all(0, false);
+    }
+}
+
+static bool dirtylimit_check(bool has_cpu_index, int64_t cpu_index,
+                             Error **errp)
+{
+    if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+        error_setg(errp, "dirty page rate limit requires KVM with dirty ring");
+        return false;
+    }
+    if (dirtylimit_migration) {
+        error_setg(errp, "dirty page rate limit is in use by migration");
+        return false;
+    }
+    if (has_cpu_index && !qemu_get_cpu(cpu_index)) {
+        error_setg(errp, "incorrect cpu index specified");
+        return false;
+    }
+    return true;
+}
+
+void qmp_set_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                              uint64_t dirty_rate, Error **errp)
+{
+    if (!dirty_rate || dirty_rate > DIRTYLIMIT_MAX_RATE) {
+        error_setg(errp, "dirty-rate must be between 1 and %d",
+                   DIRTYLIMIT_MAX_RATE);
+        return;
+    }
+    if (!dirtylimit_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    if (has_cpu_index) {
+        dirtylimit_set_vcpu(cpu_index, dirty_rate, true);
+    } else {
+        dirtylimit_set_all(dirty_rate, true);
+    }
+}
+
+void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                                 Error **errp)
+{
+    if (!dirtylimit_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    if (has_cpu_index) {
+        dirtylimit_set_vcpu(cpu_index, 0, false);
+    } else {
+        dirtylimit_set_all(0, false);
+    }
+}
+
+DirtyLimitInfoList *qmp_query_vcpu_dirty_limit(Error **errp)
+{
+    DirtyLimitInfoList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *s = dirtylimit_vcpu_state(cpu);
+        DirtyLimitInfo *info;
+
+        if (!s || !s->enabled) {
+            continue;
+        }
+        info = g_new0(DirtyLimitInfo, 1);
+        info->cpu_index = cpu->cpu_index;
+        info->limit_rate = s->quota;
+        info->current_rate = s->current_rate;
+        QAPI_LIST_APPEND(tail, info);
+    }
+    return head;
+}
+
+void hmp_set_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    int64_t dirty_rate = qdict_get_int(qdict, "dirty_rate");
+    int64_t cpu_index = qdict_get_try_int(qdict, "cpu_index", -1);
+    Error *err = NULL;
+
+    qmp_set_vcpu_dirty_limit(cpu_index != -1, cpu_index, dirty_rate, &err);
+    hmp_handle_error(mon, err);
+}
+
+void hmp_cancel_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    int64_t cpu_index = qdict_get_try_int(qdict, "cpu_index", -1);
+    Error *err = NULL;
+
+    qmp_cancel_vcpu_dirty_limit(cpu_index != -1, cpu_index, &err);
+    hmp_handle_error(mon, err);
+}
+
+void hmp_info_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    DirtyLimitInfoList *list, *info;
+
+    list = qmp_query_vcpu_dirty_limit(NULL);
+    if (!list) {
+        monitor_printf(mon, "No vCPU dirty page rate limit\n");
+        return;
+    }
+    for (info = list; info; info = info->next) {
+        monitor_printf(mon, "vcpu[%" PRIi64 "], limit rate %" PRIu64 " (MB/s),"
+                       " current rate %" PRIu64 " (MB/s)\n",
+                       info->value->cpu_index, info->value->limit_rate,
+                       info->value->current_rate);
+    }
+    qapi_free_DirtyLimitInfoList(list);
+}
@@ -1079,6 +1079,17 @@ bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
     return dirty;
 }
 
+void cpu_physical_memory_account_dirty_rate(ram_addr_t start, uint64_t pages)
+{
+    RAMBlock *block;
+
+    total_dirty_pages += pages;
+
+    RCU_READ_LOCK_GUARD();
+    block = qemu_get_ram_block(start);
+    block->dirty_rate_pages += pages;
+}
+
 DirtyBitmapSnapshot *cpu_physical_memory_snapshot_and_clear_dirty
     (MemoryRegion *mr, hwaddr offset, hwaddr length, unsigned client)
 {
@@ -104,6 +104,8 @@ DEF_HELPER_FLAGS_5(probe_access, TCG_CALL_NO_WG, void, env, tl, i32, i32, i32)
 
 DEF_HELPER_1(vfp_get_fpscr, i32, env)
 DEF_HELPER_2(vfp_set_fpscr, void, env, i32)
+DEF_HELPER_ENV_RD(vfp_get_fpscr, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_set_fpscr, vfp, vfp)
 
 DEF_HELPER_3(vfp_addh, f16, f16, f16, ptr)
 DEF_HELPER_3(vfp_adds, f32, f32, f32, ptr)
@@ -243,6 +245,130 @@ DEF_HELPER_4(vfp_muladdd, f64, f64, f64, f64, ptr)
 DEF_HELPER_4(vfp_muladds, f32, f32, f32, f32, ptr)
 DEF_HELPER_4(vfp_muladdh, f16, f16, f16, f16, ptr)
 
+/* The VFP helpers above only touch the FP status and FPSCR.  */
+DEF_HELPER_ENV_RW(vfp_addh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_adds, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_addd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_subh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_subs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_subd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_mulh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_muls, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_muld, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_divh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_divs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_divd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_maxh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_maxs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_maxd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_minh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_mins, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_mind, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_maxnumh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_maxnums, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_maxnumd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_minnumh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_minnums, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_minnumd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_negh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_negs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_negd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_absh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_abss, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_absd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sqrth, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sqrts, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sqrtd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_cmph, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_cmps, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_cmpd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_cmpeh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_cmpes, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_cmped, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_fcvtds, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_fcvtsd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uitoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uitos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uitod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sitoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sitos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sitod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touih, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touis, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touid, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touizh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touizs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touizd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosih, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosis, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosid, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosizh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosizs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosizd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toshh_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toslh_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touhh_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toulh_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toshs_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosls_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touhs_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touls_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toshd_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosld_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touhd_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tould_round_to_zero, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touhh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toshh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toulh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toslh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touqh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosqh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toshs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosls, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosqs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touhs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touls, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touqs, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_toshd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosld, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tosqd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touhd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_tould, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_touqd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_shtos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sltos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sqtos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uhtos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_ultos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uqtos, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_shtod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sltod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sqtod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uhtod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_ultod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uqtod, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_shtoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uhtoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sltoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_ultoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sqtoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uqtoh, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_shtos_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sltos_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uhtos_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_ultos_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_shtod_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sltod_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uhtod_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_ultod_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_shtoh_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_uhtoh_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_sltoh_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_ultoh_round_to_nearest, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_muladdd, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_muladds, vfp, vfp)
+DEF_HELPER_ENV_RW(vfp_muladdh, vfp, vfp)
+
 DEF_HELPER_FLAGS_2(recpe_f16, TCG_CALL_NO_RWG, f16, f16, ptr)
 DEF_HELPER_FLAGS_2(recpe_f32, TCG_CALL_NO_RWG, f32, f32, ptr)
 DEF_HELPER_FLAGS_2(recpe_f64, TCG_CALL_NO_RWG, f64, f64, ptr)
@@ -203,6 +203,87 @@ DEF_HELPER_FLAGS_3(xsetbv, TCG_CALL_NO_WG, void, env, i32, i64)
 DEF_HELPER_FLAGS_2(rdpkru, TCG_CALL_NO_WG, i64, env, i32)
 DEF_HELPER_FLAGS_3(wrpkru, TCG_CALL_NO_WG, void, env, i32, i64)
 
+/*
+ * The x87 helpers that neither access guest memory, nor EFLAGS, nor
+ * raise exceptions only touch the FPU state.
+ */
+DEF_HELPER_ENV_RW(flds_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldl_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fildl_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(flds_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldl_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fildl_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fildll_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsts_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fstl_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fist_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fistl_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fistll_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fistt_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fisttl_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fisttll_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fpush, fpstt, ft0)
+DEF_HELPER_ENV_RW(fpop, fpstt, ft0)
+DEF_HELPER_ENV_RW(fdecstp, fpstt, ft0)
+DEF_HELPER_ENV_RW(fincstp, fpstt, ft0)
+DEF_HELPER_ENV_RW(ffree_STN, fpstt, ft0)
+DEF_HELPER_ENV_RW(fmov_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fmov_FT0_STN, fpstt, ft0)
+DEF_HELPER_ENV_RW(fmov_ST0_STN, fpstt, ft0)
+DEF_HELPER_ENV_RW(fmov_STN_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fxchg_ST0_STN, fpstt, ft0)
+DEF_HELPER_ENV_RW(fcom_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fucom_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fadd_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fmul_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsub_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsubr_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fdiv_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fdivr_ST0_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fadd_STN_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fmul_STN_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsub_STN_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsubr_STN_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fdiv_STN_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fdivr_STN_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fchs_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fabs_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fxam_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fld1_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldl2t_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldl2e_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldpi_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldlg2_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldln2_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldz_ST0, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldz_FT0, fpstt, ft0)
+DEF_HELPER_ENV_RD(fnstsw, fpstt, ft0)
+DEF_HELPER_ENV_RD(fnstcw, fpstt, ft0)
+DEF_HELPER_ENV_RW(fldcw, fpstt, ft0)
+DEF_HELPER_ENV_RW(fclex, fpstt, ft0)
+DEF_HELPER_ENV_RW(fninit, fpstt, ft0)
+DEF_HELPER_ENV_RW(f2xm1, fpstt, ft0)
+DEF_HELPER_ENV_RW(fyl2x, fpstt, ft0)
+DEF_HELPER_ENV_RW(fptan, fpstt, ft0)
+DEF_HELPER_ENV_RW(fpatan, fpstt, ft0)
+DEF_HELPER_ENV_RW(fxtract, fpstt, ft0)
+DEF_HELPER_ENV_RW(fprem1, fpstt, ft0)
+DEF_HELPER_ENV_RW(fprem, fpstt, ft0)
+DEF_HELPER_ENV_RW(fyl2xp1, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsqrt, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsincos, fpstt, ft0)
+DEF_HELPER_ENV_RW(frndint, fpstt, ft0)
+DEF_HELPER_ENV_RW(fscale, fpstt, ft0)
+DEF_HELPER_ENV_RW(fsin, fpstt, ft0)
+DEF_HELPER_ENV_RW(fcos, fpstt, ft0)
+
+/*
+ * fcomi and fucomi also compute EFLAGS from, and store them back to, the
+ * condition code globals.  The FPU state is not covered by any global.
+ */
+DEF_HELPER_ENV_RW(fcomi_ST0_FT0, cc_dst, cc_op)
+DEF_HELPER_ENV_RW(fucomi_ST0_FT0, cc_dst, cc_op)
+
 DEF_HELPER_FLAGS_2(pdep, TCG_CALL_NO_RWG_SE, tl, tl, tl)
 DEF_HELPER_FLAGS_2(pext, TCG_CALL_NO_RWG_SE, tl, tl, tl)
 
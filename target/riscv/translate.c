@@ -532,7 +532,12 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     }
 
     gen_set_gpri(ctx, rd, ctx->pc_succ_insn);
-    gen_goto_tb(ctx, 0, ctx->base.pc_next + imm); /* must use this for safety */
+    if (translator_follow_jump(&ctx->base, next_pc)) {
+        /* Keep translating at the destination within this TB. */
+        ctx->pc_succ_insn = next_pc;
+        return;
+    }
+    gen_goto_tb(ctx, 0, next_pc); /* must use this for safety */
     ctx->base.is_jmp = DISAS_NORETURN;
 }
 
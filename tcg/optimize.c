@@ -686,6 +686,29 @@ static void copy_propagate(OptContext *ctx, TCGOp *op,
     }
 }
 
+/*
+ * Normal temps are dead across a conditional branch, see la_bb_sync.
+ * Forget about them so that they are not used as copies afterward;
+ * everything else keeps its value on the fall-through path.
+ */
+static void finish_cond_branch(OptContext *ctx)
+{
+    TCGContext *s = ctx->tcg;
+    int nb_temps = s->nb_temps;
+    int i;
+
+    for (i = find_first_bit(ctx->temps_used.l, nb_temps);
+         i < nb_temps;
+         i = find_next_bit(ctx->temps_used.l, nb_temps, i + 1)) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (ts->kind == TEMP_NORMAL) {
+            reset_ts(ts);
+            clear_bit(i, ctx->temps_used.l);
+        }
+    }
+}
+
 static void finish_folding(OptContext *ctx, TCGOp *op)
 {
     const TCGOpDef *def = &tcg_op_defs[op->opc];
@@ -693,10 +716,16 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
 
     /*
      * For an opcode that ends a BB, reset all temp data.
-     * We do no cross-BB optimization.
+     * The exception is a conditional branch: the fall-through path can
+     * only be reached from here, so what we know about the temps that
+     * survive the branch remains valid for the rest of the extended BB.
      */
     if (def->flags & TCG_OPF_BB_END) {
-        memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        if (def->flags & TCG_OPF_COND_BRANCH) {
+            finish_cond_branch(ctx);
+        } else {
+            memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        }
         ctx->prev_mb = NULL;
         return;
     }
@@ -1205,19 +1234,21 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
     TCGContext *s = ctx->tcg;
     int nb_oargs = TCGOP_CALLO(op);
     int nb_iargs = TCGOP_CALLI(op);
+    const TCGHelperInfo *info = tcg_call_info(op);
     int flags, i;
 
     init_arguments(ctx, op, nb_oargs + nb_iargs);
     copy_propagate(ctx, op, nb_oargs, nb_iargs);
 
-    /* If the function reads or writes globals, reset temp data. */
-    flags = tcg_call_flags(op);
+    /* If the function writes globals, reset temp data. */
+    flags = info->flags;
     if (!(flags & (TCG_CALL_NO_READ_GLOBALS | TCG_CALL_NO_WRITE_GLOBALS))) {
         int nb_globals = s->nb_globals;
 
         for (i = 0; i < nb_globals; i++) {
-            if (test_bit(i, ctx->temps_used.l)) {
-                reset_ts(&ctx->tcg->temps[i]);
+            if (test_bit(i, ctx->temps_used.l)
+                && tcg_call_writes_global(info, &s->temps[i])) {
+                reset_ts(&s->temps[i]);
             }
         }
     }
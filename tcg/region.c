@@ -24,6 +24,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/mprotect.h"
 #include "qemu/memalign.h"
@@ -34,6 +35,12 @@
 #include "tcg-internal.h"
 
 
+/*
+ * When the buffer fills up, evict one in this many of the full regions
+ * (rounded up) rather than flushing all of them.
+ */
+#define TCG_REGION_EVICT_DIV 4
+
 struct tcg_region_tree {
     QemuMutex lock;
     GTree *tree;
@@ -45,6 +52,10 @@ struct tcg_region_tree {
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * The pages of a region are faulted in by the first thread that generates
+ * code into it, and thus end up on that thread's NUMA node.  Across code
+ * flushes, each context gets back the regions it used first if possible.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -58,7 +69,11 @@ struct tcg_region_state {
     size_t total_size; /* size of entire buffer, >= n * stride */
 
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    unsigned long *inuse; /* regions allocated since the last reset */
+    const TCGContext **first_user; /* first context to use each region */
+    uint64_t *alloc_seq; /* value of .n_allocs when each region was taken */
+    uint64_t n_allocs; /* region allocations so far */
+    size_t *size_full; /* contribution of each region to .agg_size_full */
     size_t agg_size_full; /* aggregate size of full regions */
 };
 
@@ -167,10 +182,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* @p must be a rw pointer into code_gen_buffer */
+static size_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -181,19 +209,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tc_ptr_to_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -333,13 +349,43 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
 
+/*
+ * Pick a free region for @s: preferably one that @s has used before,
+ * then one that nobody has used yet.  Returns region.n if all regions
+ * are in use.
+ */
+static size_t tcg_region_pick__locked(TCGContext *s)
+{
+    size_t i, pick = region.n;
+
+    for (i = 0; i < region.n; i++) {
+        if (test_bit(i, region.inuse)) {
+            continue;
+        }
+        if (region.first_user[i] == s) {
+            return i;
+        }
+        if (pick == region.n ||
+            (region.first_user[pick] && !region.first_user[i])) {
+            pick = i;
+        }
+    }
+    return pick;
+}
+
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i = tcg_region_pick__locked(s);
+
+    if (i == region.n) {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    set_bit(i, region.inuse);
+    if (!region.first_user[i]) {
+        region.first_user[i] = s;
+    }
+    region.alloc_seq[i] = region.n_allocs++;
+    tcg_region_assign(s, i);
     return false;
 }
 
@@ -350,13 +396,18 @@ static bool tcg_region_alloc__locked(TCGContext *s)
 bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
-    /* read the region size now; alloc__locked will overwrite it on success */
+    /*
+     * Read the region index and size now; alloc__locked will overwrite
+     * them on success.
+     */
+    size_t full = tc_ptr_to_region_idx(s->code_gen_buffer);
     size_t size_full = s->code_gen_buffer_size;
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
-        region.agg_size_full += size_full - TCG_HIGHWATER;
+        region.size_full[full] = size_full - TCG_HIGHWATER;
+        region.agg_size_full += region.size_full[full];
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -386,7 +437,8 @@ void tcg_region_reset_all(void)
     unsigned int i;
 
     qemu_mutex_lock(&region.lock);
-    region.current = 0;
+    bitmap_zero(region.inuse, region.n);
+    memset(region.size_full, 0, region.n * sizeof(*region.size_full));
     region.agg_size_full = 0;
 
     for (i = 0; i < n_ctxs; i++) {
@@ -398,6 +450,105 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static gboolean tcg_region_tree_collect(gpointer key, gpointer value,
+                                        gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/*
+ * Pick the full regions, i.e. those that no context is generating code
+ * into, that were allocated the longest time ago.  Returns the number
+ * of regions set in @victims.
+ */
+static size_t tcg_region_pick_victims__locked(unsigned long *victims)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    unsigned long *full = bitmap_new(region.n);
+    size_t i, n_full, n_victims;
+
+    bitmap_copy(full, region.inuse, region.n);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        clear_bit(tc_ptr_to_region_idx(s->code_gen_buffer), full);
+    }
+
+    n_full = bitmap_count_one(full, region.n);
+    n_victims = DIV_ROUND_UP(n_full, TCG_REGION_EVICT_DIV);
+    for (i = 0; i < n_victims; i++) {
+        size_t j, oldest = region.n;
+
+        for (j = find_first_bit(full, region.n); j < region.n;
+             j = find_next_bit(full, region.n, j + 1)) {
+            if (oldest == region.n ||
+                region.alloc_seq[j] < region.alloc_seq[oldest]) {
+                oldest = j;
+            }
+        }
+        clear_bit(oldest, full);
+        set_bit(oldest, victims);
+    }
+    g_free(full);
+    return n_victims;
+}
+
+/*
+ * Evict the oldest full regions instead of resetting the whole buffer.
+ * @evict is called on every TB in those regions and must unlink it from
+ * the rest of the translation state; afterwards the regions can be
+ * allocated again.  Returns the number of regions evicted, which is 0
+ * if there was nothing to evict and a full reset is required.
+ *
+ * Call from a safe-work context.
+ */
+size_t tcg_region_evict(void (*evict)(TranslationBlock *tb))
+{
+    unsigned long *victims = bitmap_new(region.n);
+    GPtrArray *tbs = g_ptr_array_new();
+    size_t i, n_victims;
+
+    qemu_mutex_lock(&region.lock);
+    n_victims = tcg_region_pick_victims__locked(victims);
+    qemu_mutex_unlock(&region.lock);
+
+    for (i = find_first_bit(victims, region.n); i < region.n;
+         i = find_next_bit(victims, region.n, i + 1)) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+        guint j;
+
+        /*
+         * Do not hold the tree lock while evicting: the page locks taken
+         * by @evict nest outside of it.
+         */
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, tcg_region_tree_collect, tbs);
+        qemu_mutex_unlock(&rt->lock);
+
+        for (j = 0; j < tbs->len; j++) {
+            evict(g_ptr_array_index(tbs, j));
+        }
+        g_ptr_array_set_size(tbs, 0);
+
+        qemu_mutex_lock(&rt->lock);
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        qemu_mutex_lock(&region.lock);
+        clear_bit(i, region.inuse);
+        region.agg_size_full -= region.size_full[i];
+        region.size_full[i] = 0;
+        qemu_mutex_unlock(&region.lock);
+    }
+
+    g_ptr_array_free(tbs, true);
+    g_free(victims);
+    return n_victims;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -411,9 +562,13 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      */
-    /* Use a single region if all we have is one vCPU thread */
+    /*
+     * A single vCPU thread only ever fills one region at a time, but
+     * splitting the buffer still lets it evict the oldest regions
+     * instead of flushing everything.
+     */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        return MAX(1, MIN(tb_size / (2 * MiB), 8));
     }
 
     /*
@@ -786,6 +941,10 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.inuse = bitmap_new(region.n);
+    region.first_user = g_new0(const TCGContext *, region.n);
+    region.alloc_seq = g_new0(uint64_t, region.n);
+    region.size_full = g_new0(size_t, region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
@@ -830,8 +989,13 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * Leave the initial context initialized to the first region.
      * This will be the context into which we generate the prologue.
      * It is also the only context for CONFIG_USER_ONLY.
+     *
+     * Do not record tcg_init_ctx as the first user: in system mode the
+     * region is inherited by the first vCPU thread, which is the one
+     * that will actually fill it.
      */
-    tcg_region_initial_alloc__locked(&tcg_init_ctx);
+    set_bit(0, region.inuse);
+    tcg_region_assign(&tcg_init_ctx, 0);
 }
 
 void tcg_region_prologue_set(TCGContext *s)
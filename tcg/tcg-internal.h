@@ -27,11 +27,20 @@
 
 #define TCG_HIGHWATER 1024
 
+/* Byte ranges of CPUArchState holding the globals that a helper reads
+   and writes, from DEF_HELPER_ENV_*.  */
+typedef struct TCGHelperEnv {
+    void *func;
+    int rd_start, rd_end;
+    int wr_start, wr_end;
+} TCGHelperEnv;
+
 typedef struct TCGHelperInfo {
     void *func;
     const char *name;
     unsigned flags;
     unsigned typemask;
+    const TCGHelperEnv *env;
 } TCGHelperInfo;
 
 extern TCGContext tcg_init_ctx;
@@ -59,4 +68,36 @@ static inline unsigned tcg_call_flags(TCGOp *op)
     return tcg_call_info(op)->flags;
 }
 
+/* Return true if global TS lies outside [START, END) of the CPU state.  */
+static inline bool tcg_global_outside(const TCGTemp *ts, int start, int end)
+{
+    int size = ts->type == TCG_TYPE_I32 ? 4 : 8;
+
+    return (ts->kind == TEMP_GLOBAL && !ts->indirect_reg
+            && ts->mem_base == tcgv_ptr_temp(cpu_env)
+            && (ts->mem_offset >= end || ts->mem_offset + size <= start));
+}
+
+/* Return true if calling the helper described by INFO may read TS.  */
+static inline bool tcg_call_reads_global(const TCGHelperInfo *info,
+                                         const TCGTemp *ts)
+{
+    if (info->flags & TCG_CALL_NO_READ_GLOBALS) {
+        return false;
+    }
+    return !info->env
+        || !tcg_global_outside(ts, info->env->rd_start, info->env->rd_end);
+}
+
+/* Return true if calling the helper described by INFO may write TS.  */
+static inline bool tcg_call_writes_global(const TCGHelperInfo *info,
+                                          const TCGTemp *ts)
+{
+    if (info->flags & (TCG_CALL_NO_READ_GLOBALS | TCG_CALL_NO_WRITE_GLOBALS)) {
+        return false;
+    }
+    return !info->env
+        || !tcg_global_outside(ts, info->env->wr_start, info->env->wr_end);
+}
+
 #endif /* TCG_INTERNAL_H */
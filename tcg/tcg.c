@@ -546,9 +546,13 @@ void tcg_pool_reset(TCGContext *s)
 
 #include "exec/helper-proto.h"
 
-static const TCGHelperInfo all_helpers[] = {
+static TCGHelperInfo all_helpers[] = {
 #include "exec/helper-tcg.h"
 };
+static const TCGHelperEnv all_helper_env[] = {
+#include "exec/helper-env.h"
+    { }
+};
 static GHashTable *helper_table;
 
 #ifdef CONFIG_TCG_INTERPRETER
@@ -606,6 +610,13 @@ static void tcg_context_init(unsigned max_cpus)
         g_hash_table_insert(helper_table, (gpointer)all_helpers[i].func,
                             (gpointer)&all_helpers[i]);
     }
+    for (i = 0; all_helper_env[i].func; ++i) {
+        TCGHelperInfo *info = g_hash_table_lookup(helper_table,
+                                                  all_helper_env[i].func);
+        /* DEF_HELPER_ENV_* must follow the helper's DEF_HELPER_* line.  */
+        g_assert(info != NULL);
+        info->env = &all_helper_env[i];
+    }
 
 #ifdef CONFIG_TCG_INTERPRETER
     /* g_direct_hash/equal for direct comparisons on uint32_t.  */
@@ -818,6 +829,7 @@ void tcg_func_start(TCGContext *s)
 
     s->nb_ops = 0;
     s->nb_labels = 0;
+    s->nb_spills = 0;
     s->current_frame_offset = s->frame_start;
 
 #ifdef CONFIG_DEBUG_TCG
@@ -2373,7 +2385,9 @@ static void la_func_end(TCGContext *s, int ng, int nt)
 }
 
 /* liveness analysis: end of basic block: all temps are dead, globals
-   and local temps should be in memory. */
+   and local temps should be in memory.  Direct globals are only synced,
+   so that the register allocator may keep them in host registers across
+   the label (see tcg_reg_alloc_label).  */
 static void la_bb_end(TCGContext *s, int ng, int nt)
 {
     int i;
@@ -2383,8 +2397,17 @@ static void la_bb_end(TCGContext *s, int ng, int nt)
         int state;
 
         switch (ts->kind) {
-        case TEMP_FIXED:
         case TEMP_GLOBAL:
+            if (!ts->indirect_reg) {
+                state = ts->state;
+                ts->state = state | TS_MEM;
+                if (state == TS_DEAD) {
+                    la_reset_pref(ts);
+                }
+                continue;
+            }
+            /* fall through */
+        case TEMP_FIXED:
         case TEMP_LOCAL:
             state = TS_DEAD | TS_MEM;
             break;
@@ -2461,6 +2484,30 @@ static void la_global_kill(TCGContext *s, int ng)
     }
 }
 
+/* liveness analysis: sync back to memory the globals that a helper may
+   read, and kill those that it may write.  */
+static void la_call_env(TCGContext *s, int ng, const TCGHelperInfo *info)
+{
+    int i;
+
+    for (i = 0; i < ng; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int state = ts->state;
+
+        if (tcg_call_writes_global(info, ts)) {
+            ts->state = TS_DEAD | TS_MEM;
+        } else if (tcg_call_reads_global(info, ts)) {
+            ts->state = state | TS_MEM;
+            if (state != TS_DEAD) {
+                continue;
+            }
+        } else {
+            continue;
+        }
+        la_reset_pref(ts);
+    }
+}
+
 /* liveness analysis: note live globals crossing calls.  */
 static void la_cross_call(TCGContext *s, int nt)
 {
@@ -2549,8 +2596,10 @@ static void liveness_pass_1(TCGContext *s)
                     op->output_pref[i] = 0;
                 }
 
-                if (!(call_flags & (TCG_CALL_NO_WRITE_GLOBALS |
-                                    TCG_CALL_NO_READ_GLOBALS))) {
+                if (tcg_call_info(op)->env) {
+                    la_call_env(s, nb_globals, tcg_call_info(op));
+                } else if (!(call_flags & (TCG_CALL_NO_WRITE_GLOBALS |
+                                           TCG_CALL_NO_READ_GLOBALS))) {
                     la_global_kill(s, nb_globals);
                 } else if (!(call_flags & TCG_CALL_NO_READ_GLOBALS)) {
                     la_global_sync(s, nb_globals);
@@ -3192,6 +3241,9 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
 {
     TCGTemp *ts = s->reg_to_temp[reg];
     if (ts != NULL) {
+        if (!temp_readonly(ts) && !ts->mem_coherent) {
+            s->nb_spills++;
+        }
         temp_sync(s, ts, allocated_regs, 0, -1);
     }
 }
@@ -3324,8 +3376,11 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
 static void temp_save(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs)
 {
     /* The liveness analysis already ensures that globals are back
-       in memory. Keep an tcg_debug_assert for safety. */
-    tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || temp_readonly(ts));
+       in memory, though at the end of a basic block they may still be
+       cached in a register. Keep an tcg_debug_assert for safety. */
+    tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || temp_readonly(ts)
+                     || ts->mem_coherent);
+    temp_free_or_dead(s, ts, -1);
 }
 
 /* save globals to their canonical location and assume they can be
@@ -3386,6 +3441,115 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
     save_globals(s, allocated_regs);
 }
 
+/*
+ * At a forward branch, record which globals are cached in host registers.
+ * A label is entered with the intersection of the registers recorded by
+ * all of its branches and of the state of the fall-through path.
+ */
+static void tcg_reg_alloc_branch(TCGContext *s, TCGLabel *l)
+{
+    TCGTemp **globals = l->reg_globals;
+    int i;
+
+    /* The label of a backward branch has already been emitted.  */
+    if (l->has_value) {
+        return;
+    }
+
+    if (l->nb_branches++ == 0) {
+        globals = tcg_malloc(sizeof(TCGTemp *) * TCG_TARGET_NB_REGS);
+        l->reg_globals = globals;
+        for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
+            TCGTemp *ts = s->reg_to_temp[i];
+
+            if (ts && ts->kind == TEMP_GLOBAL) {
+                tcg_debug_assert(ts->mem_coherent);
+                globals[i] = ts;
+            } else {
+                globals[i] = NULL;
+            }
+        }
+    } else {
+        for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
+            if (globals[i] != s->reg_to_temp[i]) {
+                globals[i] = NULL;
+            }
+        }
+    }
+}
+
+/* Return true if the code before OP can fall through into it.  */
+static bool tcg_op_is_fallthrough(TCGOp *op)
+{
+    do {
+        op = QTAILQ_PREV(op, link);
+    } while (op && op->opc == INDEX_op_insn_start);
+
+    if (op == NULL) {
+        return true;
+    }
+    switch (op->opc) {
+    case INDEX_op_br:
+    case INDEX_op_exit_tb:
+    case INDEX_op_goto_ptr:
+        return false;
+    case INDEX_op_call:
+        return !(tcg_call_flags(op) & TCG_CALL_NO_RETURN);
+    default:
+        return true;
+    }
+}
+
+/*
+ * At a label, the liveness analysis ensures that all globals are synced
+ * to memory.  If all the branches to the label have been seen, globals
+ * that every predecessor holds in the same host register stay there.
+ */
+static void tcg_reg_alloc_label(TCGContext *s, TCGOp *op, TCGLabel *l)
+{
+    TCGTemp *keep[TCG_TARGET_NB_REGS];
+    bool fallthrough;
+    int i;
+
+    /* There are backward branches to this label.  */
+    if (l->nb_branches != l->refs) {
+        tcg_reg_alloc_bb_end(s, s->reserved_regs);
+        return;
+    }
+
+    fallthrough = tcg_op_is_fallthrough(op);
+    for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
+        TCGTemp *ts = NULL;
+
+        if (fallthrough) {
+            ts = s->reg_to_temp[i];
+            if (ts && ts->kind != TEMP_GLOBAL) {
+                ts = NULL;
+            }
+            if (l->nb_branches && l->reg_globals[i] != ts) {
+                ts = NULL;
+            }
+        } else if (l->nb_branches) {
+            ts = l->reg_globals[i];
+        }
+        keep[i] = ts;
+    }
+
+    tcg_reg_alloc_bb_end(s, s->reserved_regs);
+
+    for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
+        TCGTemp *ts = keep[i];
+
+        if (ts) {
+            tcg_debug_assert(ts->val_type == TEMP_VAL_MEM);
+            ts->val_type = TEMP_VAL_REG;
+            ts->reg = i;
+            ts->mem_coherent = 1;
+            s->reg_to_temp[i] = ts;
+        }
+    }
+}
+
 /*
  * At a conditional branch, we assume all temporaries are dead unless
  * explicitly live-across-conditional-branch; all globals and local
@@ -3759,7 +3923,12 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
 
     if (def->flags & TCG_OPF_COND_BRANCH) {
         tcg_reg_alloc_cbranch(s, i_allocated_regs);
+        tcg_reg_alloc_branch(s, arg_label(op->args[nb_oargs + nb_iargs
+                                                   + def->nb_cargs - 1]));
     } else if (def->flags & TCG_OPF_BB_END) {
+        if (op->opc == INDEX_op_br) {
+            tcg_reg_alloc_branch(s, arg_label(op->args[0]));
+        }
         tcg_reg_alloc_bb_end(s, i_allocated_regs);
     } else {
         if (def->flags & TCG_OPF_CALL_CLOBBER) {
@@ -4035,7 +4204,18 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
 
     /* Save globals if they might be written by the helper, sync them if
        they might be read. */
-    if (flags & TCG_CALL_NO_READ_GLOBALS) {
+    if (info->env) {
+        for (i = 0; i < s->nb_globals; i++) {
+            ts = &s->temps[i];
+            if (tcg_call_writes_global(info, ts)) {
+                temp_save(s, ts, allocated_regs);
+            } else if (tcg_call_reads_global(info, ts)) {
+                tcg_debug_assert(ts->val_type != TEMP_VAL_REG
+                                 || ts->kind == TEMP_FIXED
+                                 || ts->mem_coherent);
+            }
+        }
+    } else if (flags & TCG_CALL_NO_READ_GLOBALS) {
         /* Nothing to do */
     } else if (flags & TCG_CALL_NO_WRITE_GLOBALS) {
         sync_globals(s, allocated_regs);
@@ -4355,7 +4535,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             temp_dead(s, arg_temp(op->args[0]));
             break;
         case INDEX_op_set_label:
-            tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            tcg_reg_alloc_label(s, op, arg_label(op->args[0]));
             tcg_out_label(s, arg_label(op->args[0]));
             break;
         case INDEX_op_call:
@@ -65,6 +65,10 @@ static uint64_t tci_uint64(uint32_t high, uint32_t low)
  *   n = immediate (call return length)
  *   r = register
  *   s = signed ldst offset
+ *
+ * Conditional branches compare two values and branch in a single
+ * instruction; since the registers and the condition leave too few
+ * bits for the displacement, the label follows in the next word.
  */
 
 static void tci_args_l(uint32_t insn, const void *tb_ptr, void **l0)
@@ -204,6 +208,29 @@ static void tci_args_rrrrrr(uint32_t insn, TCGReg *r0, TCGReg *r1,
     *r5 = extract32(insn, 28, 4);
 }
 
+static void tci_args_rrcl(uint32_t insn, const uint32_t *tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = sextract32(*tb_ptr, 12, 20) + (void *)(tb_ptr + 1);
+}
+
+#if TCG_TARGET_REG_BITS == 32
+static void tci_args_rrrrcl(uint32_t insn, const uint32_t *tb_ptr,
+                            TCGReg *r0, TCGReg *r1, TCGReg *r2, TCGReg *r3,
+                            TCGCond *c4, void **l5)
+{
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *r2 = extract32(insn, 16, 4);
+    *r3 = extract32(insn, 20, 4);
+    *c4 = extract32(insn, 24, 4);
+    *l5 = sextract32(*tb_ptr, 12, 20) + (void *)(tb_ptr + 1);
+}
+#endif
+
 static bool tci_compare32(uint32_t u0, uint32_t u1, TCGCond condition)
 {
     bool result = false;
@@ -458,6 +485,23 @@ static void tci_qemu_st(CPUArchState *env, target_ulong taddr, uint64_t val,
 # define CASE_64(x)
 #endif
 
+/*
+ * The most frequent opcodes are entered through a table of label
+ * addresses rather than through the switch statement.  The fetch and
+ * indirect jump at the top of the loop are small enough for the compiler
+ * to duplicate at the end of each handler, so that every opcode gets its
+ * own indirect branch and branch predictor history (threaded code).
+ * Opcodes without an entry in the table still go through the switch.
+ */
+#define TCI_LABEL(x)        glue(tci_op_, x):
+#define TCI_ENTRY(op, x)    [glue(INDEX_op_, op)] = &&glue(tci_op_, x),
+#if TCG_TARGET_REG_BITS == 64
+# define TCI_ENTRY_32_64(x) \
+    TCI_ENTRY(glue(x, _i32), x) TCI_ENTRY(glue(x, _i64), x)
+#else
+# define TCI_ENTRY_32_64(x) TCI_ENTRY(glue(x, _i32), x)
+#endif
+
 /* Interpret pseudo code in tb. */
 /*
  * Disable CFI checks.
@@ -472,6 +516,49 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
     uint64_t stack[(TCG_STATIC_CALL_ARGS_SIZE + TCG_STATIC_FRAME_SIZE)
                    / sizeof(uint64_t)];
     void *call_slots[TCG_STATIC_CALL_ARGS_SIZE / sizeof(uint64_t)];
+    static const void * const dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&tci_op_switch,
+        TCI_ENTRY(call, call)
+        TCI_ENTRY(br, br)
+        TCI_ENTRY(exit_tb, exit_tb)
+        TCI_ENTRY(goto_tb, goto_tb)
+        TCI_ENTRY(goto_ptr, goto_ptr)
+        TCI_ENTRY(tci_movi, tci_movi)
+        TCI_ENTRY(tci_movl, tci_movl)
+        TCI_ENTRY_32_64(mov)
+        TCI_ENTRY_32_64(ld8u)
+        TCI_ENTRY_32_64(ld16u)
+        TCI_ENTRY(ld_i32, ld32u)
+        TCI_ENTRY_32_64(st8)
+        TCI_ENTRY(st_i32, st32)
+        TCI_ENTRY_32_64(add)
+        TCI_ENTRY_32_64(sub)
+        TCI_ENTRY_32_64(and)
+        TCI_ENTRY_32_64(or)
+        TCI_ENTRY_32_64(xor)
+        TCI_ENTRY(shl_i32, shl_i32)
+        TCI_ENTRY(shr_i32, shr_i32)
+        TCI_ENTRY(setcond_i32, setcond_i32)
+        TCI_ENTRY(brcond_i32, brcond_i32)
+        TCI_ENTRY(qemu_ld_i32, qemu_ld_i32)
+        TCI_ENTRY(qemu_ld_i64, qemu_ld_i64)
+        TCI_ENTRY(qemu_st_i32, qemu_st_i32)
+        TCI_ENTRY(qemu_st_i64, qemu_st_i64)
+#if TCG_TARGET_REG_BITS == 64
+        TCI_ENTRY(ld32u_i64, ld32u)
+        TCI_ENTRY(ld_i64, ld_i64)
+        TCI_ENTRY(st32_i64, st32)
+        TCI_ENTRY(st_i64, st_i64)
+        TCI_ENTRY(shl_i64, shl_i64)
+        TCI_ENTRY(shr_i64, shr_i64)
+        TCI_ENTRY(setcond_i64, setcond_i64)
+        TCI_ENTRY(brcond_i64, brcond_i64)
+        TCI_ENTRY(ext32s_i64, ext32s_i64)
+        TCI_ENTRY(ext_i32_i64, ext32s_i64)
+        TCI_ENTRY(ext32u_i64, ext32u_i64)
+        TCI_ENTRY(extu_i32_i64, ext32u_i64)
+#endif
+    };
 
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = (uintptr_t)stack;
@@ -496,9 +583,12 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
 
         insn = *tb_ptr++;
         opc = extract32(insn, 0, 8);
+        goto *dispatch[opc];
 
+    tci_op_switch:
         switch (opc) {
         case INDEX_op_call:
+        TCI_LABEL(call)
             /*
              * Set up the ffi_avalue array once, delayed until now
              * because many TB's do not make any calls. In tcg_gen_callN,
@@ -548,10 +638,12 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_br:
+        TCI_LABEL(br)
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = ptr;
             continue;
         case INDEX_op_setcond_i32:
+        TCI_LABEL(setcond_i32)
             tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
             regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
             break;
@@ -569,6 +661,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #elif TCG_TARGET_REG_BITS == 64
         case INDEX_op_setcond_i64:
+        TCI_LABEL(setcond_i64)
             tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
             regs[r0] = tci_compare64(regs[r1], regs[r2], condition);
             break;
@@ -579,14 +672,17 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         CASE_32_64(mov)
+        TCI_LABEL(mov)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = regs[r1];
             break;
         case INDEX_op_tci_movi:
+        TCI_LABEL(tci_movi)
             tci_args_ri(insn, &r0, &t1);
             regs[r0] = t1;
             break;
         case INDEX_op_tci_movl:
+        TCI_LABEL(tci_movl)
             tci_args_rl(insn, tb_ptr, &r0, &ptr);
             regs[r0] = *(tcg_target_ulong *)ptr;
             break;
@@ -594,6 +690,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             /* Load/store operations (32 bit). */
 
         CASE_32_64(ld8u)
+        TCI_LABEL(ld8u)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint8_t *)ptr;
@@ -604,6 +701,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             regs[r0] = *(int8_t *)ptr;
             break;
         CASE_32_64(ld16u)
+        TCI_LABEL(ld16u)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint16_t *)ptr;
@@ -615,11 +713,13 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
         case INDEX_op_ld_i32:
         CASE_64(ld32u)
+        TCI_LABEL(ld32u)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint32_t *)ptr;
             break;
         CASE_32_64(st8)
+        TCI_LABEL(st8)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint8_t *)ptr = regs[r0];
@@ -631,6 +731,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
         case INDEX_op_st_i32:
         CASE_64(st32)
+        TCI_LABEL(st32)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint32_t *)ptr = regs[r0];
@@ -639,10 +740,12 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             /* Arithmetic operations (mixed 32/64 bit). */
 
         CASE_32_64(add)
+        TCI_LABEL(add)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] + regs[r2];
             break;
         CASE_32_64(sub)
+        TCI_LABEL(sub)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] - regs[r2];
             break;
@@ -651,14 +754,17 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             regs[r0] = regs[r1] * regs[r2];
             break;
         CASE_32_64(and)
+        TCI_LABEL(and)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] & regs[r2];
             break;
         CASE_32_64(or)
+        TCI_LABEL(or)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] | regs[r2];
             break;
         CASE_32_64(xor)
+        TCI_LABEL(xor)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] ^ regs[r2];
             break;
@@ -735,10 +841,12 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             /* Shift/rotate operations (32 bit). */
 
         case INDEX_op_shl_i32:
+        TCI_LABEL(shl_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint32_t)regs[r1] << (regs[r2] & 31);
             break;
         case INDEX_op_shr_i32:
+        TCI_LABEL(shr_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint32_t)regs[r1] >> (regs[r2] & 31);
             break;
@@ -775,11 +883,27 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         case INDEX_op_brcond_i32:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if ((uint32_t)regs[r0]) {
+        TCI_LABEL(brcond_i32)
+            tci_args_rrcl(insn, tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            } else {
+                tb_ptr++;
+            }
+            break;
+#if TCG_TARGET_REG_BITS == 32
+        case INDEX_op_brcond2_i32:
+            tci_args_rrrrcl(insn, tb_ptr, &r0, &r1, &r2, &r3,
+                            &condition, &ptr);
+            T1 = tci_uint64(regs[r1], regs[r0]);
+            T2 = tci_uint64(regs[r3], regs[r2]);
+            if (tci_compare64(T1, T2, condition)) {
                 tb_ptr = ptr;
+            } else {
+                tb_ptr++;
             }
             break;
+#endif
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_add2_i32
         case INDEX_op_add2_i32:
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
@@ -868,11 +992,13 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             regs[r0] = *(int32_t *)ptr;
             break;
         case INDEX_op_ld_i64:
+        TCI_LABEL(ld_i64)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint64_t *)ptr;
             break;
         case INDEX_op_st_i64:
+        TCI_LABEL(st_i64)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint64_t *)ptr = regs[r0];
@@ -948,10 +1074,12 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             /* Shift/rotate operations (64 bit). */
 
         case INDEX_op_shl_i64:
+        TCI_LABEL(shl_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] << (regs[r2] & 63);
             break;
         case INDEX_op_shr_i64:
+        TCI_LABEL(shr_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] >> (regs[r2] & 63);
             break;
@@ -988,18 +1116,23 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         case INDEX_op_brcond_i64:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if (regs[r0]) {
+        TCI_LABEL(brcond_i64)
+            tci_args_rrcl(insn, tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
                 tb_ptr = ptr;
+            } else {
+                tb_ptr++;
             }
             break;
         case INDEX_op_ext32s_i64:
         case INDEX_op_ext_i32_i64:
+        TCI_LABEL(ext32s_i64)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (int32_t)regs[r1];
             break;
         case INDEX_op_ext32u_i64:
         case INDEX_op_extu_i32_i64:
+        TCI_LABEL(ext32u_i64)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (uint32_t)regs[r1];
             break;
@@ -1014,15 +1147,18 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             /* QEMU specific operations. */
 
         case INDEX_op_exit_tb:
+        TCI_LABEL(exit_tb)
             tci_args_l(insn, tb_ptr, &ptr);
             return (uintptr_t)ptr;
 
         case INDEX_op_goto_tb:
+        TCI_LABEL(goto_tb)
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = *(void **)ptr;
             break;
 
         case INDEX_op_goto_ptr:
+        TCI_LABEL(goto_ptr)
             tci_args_r(insn, &r0);
             ptr = (void *)regs[r0];
             if (!ptr) {
@@ -1032,6 +1168,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_qemu_ld_i32:
+        TCI_LABEL(qemu_ld_i32)
             if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1044,6 +1181,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_qemu_ld_i64:
+        TCI_LABEL(qemu_ld_i64)
             if (TCG_TARGET_REG_BITS == 64) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1064,6 +1202,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_qemu_st_i32:
+        TCI_LABEL(qemu_st_i32)
             if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1076,6 +1215,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_qemu_st_i64:
+        TCI_LABEL(qemu_st_i64)
             if (TCG_TARGET_REG_BITS == 64) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1189,10 +1329,19 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
 
     case INDEX_op_brcond_i32:
     case INDEX_op_brcond_i64:
-        tci_args_rl(insn, tb_ptr, &r0, &ptr);
-        info->fprintf_func(info->stream, "%-12s  %s, 0, ne, %p",
-                           op_name, str_r(r0), ptr);
-        break;
+        tci_args_rrcl(insn, tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        return 2 * sizeof(insn);
+
+#if TCG_TARGET_REG_BITS == 32
+    case INDEX_op_brcond2_i32:
+        tci_args_rrrrcl(insn, tb_ptr, &r0, &r1, &r2, &r3, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_r(r2),
+                           str_r(r3), str_c(c), ptr);
+        return 2 * sizeof(insn);
+#endif
 
     case INDEX_op_setcond_i32:
     case INDEX_op_setcond_i64:
@@ -0,0 +1,233 @@
+/*
+ * Compare victim TLB layouts on a synthetic stream of page accesses.
+ *
+ * This models the softmmu TLB of accel/tcg/cputlb.c for a single mmu_idx:
+ * a direct mapped main TLB of a fixed size, backed by a victim TLB that
+ * receives the entries evicted from it and swaps them back on a hit.
+ * Three victim TLB layouts are compared: the former fully associative one
+ * with 8 entries, a 4-way set associative one with 16 sets indexed by the
+ * low bits of the page number, and the current one, which adds to the
+ * sets a fully associative overflow area of 8 entries that receives the
+ * entries dropped by a full set.  Lookups that miss in both TLBs would
+ * call tlb_fill().  The main TLB is not resized during the run.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+
+#define EMPTY_PAGE UINT64_MAX
+
+struct layout {
+    const char *name;
+    unsigned int sets;
+    unsigned int ways;
+    unsigned int overflow;
+};
+
+static const struct layout layouts[] = {
+    { "8 entries, fully associative", 1, 8, 0 },
+    { "64 entries, 16 sets x 4 ways", 16, 4, 0 },
+    { "72 entries, 16 sets x 4 ways + 8 overflow", 16, 4, 8 },
+};
+
+struct tlb {
+    const struct layout *layout;
+    uint64_t *main;
+    uint64_t *victim;
+    uint8_t *vindex;
+    uint8_t voindex;
+    uint64_t main_mask;
+    uint64_t misses;
+    uint64_t victim_hits;
+};
+
+static unsigned int main_bits = 8;
+static uint64_t n_pages = 4096;
+static uint64_t stride = 1;
+static uint64_t n_accesses = 10000000;
+static bool sequential;
+
+static const char commands_string[] =
+    " -b = log2 of the number of main TLB entries (default: 8, min: 6)\n"
+    " -n = number of accesses (default: 10000000)\n"
+    " -p = number of distinct pages accessed (default: 4096)\n"
+    " -s = distance between accessed pages, in pages (default: 1)\n"
+    " -S = access the pages in order instead of at random\n"
+    " -h = show this help message";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+/* See atomic64-bench.c */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static void tlb_init(struct tlb *t, const struct layout *layout)
+{
+    size_t n_main = (size_t)1 << main_bits;
+    size_t n_victim = layout->sets * layout->ways + layout->overflow;
+    size_t i;
+
+    memset(t, 0, sizeof(*t));
+    t->layout = layout;
+    t->main_mask = n_main - 1;
+    t->main = g_new(uint64_t, n_main);
+    t->victim = g_new(uint64_t, n_victim);
+    t->vindex = g_new0(uint8_t, layout->sets);
+    for (i = 0; i < n_main; i++) {
+        t->main[i] = EMPTY_PAGE;
+    }
+    for (i = 0; i < n_victim; i++) {
+        t->victim[i] = EMPTY_PAGE;
+    }
+}
+
+static void tlb_destroy(struct tlb *t)
+{
+    g_free(t->main);
+    g_free(t->victim);
+    g_free(t->vindex);
+}
+
+/* Mirrors victim_tlb_hit() and the eviction in tlb_set_page_with_attrs() */
+static void tlb_access(struct tlb *t, uint64_t page)
+{
+    uint64_t *entry = &t->main[page & t->main_mask];
+    unsigned int set = page & (t->layout->sets - 1);
+    uint64_t *ways = &t->victim[set * t->layout->ways];
+    uint64_t *overflow = &t->victim[t->layout->sets * t->layout->ways];
+    unsigned int k;
+
+    if (likely(*entry == page)) {
+        return;
+    }
+    t->misses++;
+
+    for (k = 0; k < t->layout->ways; k++) {
+        if (ways[k] == page) {
+            ways[k] = *entry;
+            *entry = page;
+            t->victim_hits++;
+            return;
+        }
+    }
+    for (k = 0; k < t->layout->overflow; k++) {
+        if (overflow[k] == page) {
+            overflow[k] = *entry;
+            *entry = page;
+            t->victim_hits++;
+            return;
+        }
+    }
+
+    if (*entry != EMPTY_PAGE) {
+        uint64_t *way = &ways[t->vindex[set]++ % t->layout->ways];
+
+        if (t->layout->overflow && *way != EMPTY_PAGE) {
+            overflow[t->voindex++ % t->layout->overflow] = *way;
+        }
+        *way = *entry;
+    }
+    *entry = page;
+}
+
+static void run_layout(const struct layout *layout)
+{
+    struct tlb t;
+    uint64_t r = 1;
+    uint64_t i;
+    int64_t start, ns;
+    uint64_t fills;
+
+    tlb_init(&t, layout);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < n_accesses; i++) {
+        uint64_t n;
+
+        if (sequential) {
+            n = i % n_pages;
+        } else {
+            r = xorshift64star(r);
+            n = r % n_pages;
+        }
+        tlb_access(&t, n * stride);
+    }
+    ns = (g_get_monotonic_time() - start) * 1000;
+
+    fills = t.misses - t.victim_hits;
+    printf("%s:\n", layout->name);
+    printf(" main TLB misses:   %" PRIu64 " (%.2f%% of accesses)\n",
+           t.misses, 100.0 * t.misses / n_accesses);
+    printf(" victim TLB hits:   %" PRIu64 " (%.2f%% of misses)\n",
+           t.victim_hits, t.misses ? 100.0 * t.victim_hits / t.misses : 0);
+    printf(" tlb_fill calls:    %" PRIu64 " (%.2f%% of accesses)\n",
+           fills, 100.0 * fills / n_accesses);
+    printf(" time per access:   %.2f ns\n", (double)ns / n_accesses);
+
+    tlb_destroy(&t);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "b:n:p:s:Sh");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'b':
+            main_bits = atoi(optarg);
+            break;
+        case 'n':
+            n_accesses = atoll(optarg);
+            break;
+        case 'p':
+            n_pages = atoll(optarg);
+            break;
+        case 's':
+            stride = atoll(optarg);
+            break;
+        case 'S':
+            sequential = true;
+            break;
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        default:
+            usage_complete(argv);
+            exit(1);
+        }
+    }
+    if (main_bits < 6 || main_bits > 30 || !n_accesses || !n_pages ||
+        !stride) {
+        usage_complete(argv);
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t i;
+
+    parse_args(argc, argv);
+    printf("%u main TLB entries, %" PRIu64 " %s accesses to %" PRIu64
+           " pages with a stride of %" PRIu64 "\n",
+           1u << main_bits, n_accesses, sequential ? "sequential" : "random",
+           n_pages, stride);
+    for (i = 0; i < ARRAY_SIZE(layouts); i++) {
+        run_layout(&layouts[i]);
+    }
+    return 0;
+}
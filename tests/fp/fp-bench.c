@@ -34,6 +34,7 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_CVT,
     OP_MAX_NR,
 };
 
@@ -45,6 +46,7 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_CVT] = "cvt",
     [OP_MAX_NR] = NULL,
 };
 
@@ -126,6 +128,7 @@ static enum precision precision;
 static enum op operation;
 static enum tester tester;
 static uint64_t n_completed_ops;
+static bool clear_flags;
 static unsigned int duration = DEFAULT_DURATION_SECS;
 static int64_t ns_elapsed;
 /* disable optimizations with volatile */
@@ -270,6 +273,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_CVT:
+                    res.f = (int32_t)ops[0].f32;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -305,6 +311,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_CVT:
+                    res.d = (int64_t)ops[0].u64;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -318,6 +327,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 float32 b = ops[1].f32;
                 float32 c = ops[2].f32;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f32 = float32_add(a, b, &soft_status);
@@ -340,6 +352,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f32 = int32_to_float32(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -353,6 +368,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 float64 b = ops[1].f64;
                 float64 c = ops[2].f64;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f64 = float64_add(a, b, &soft_status);
@@ -375,6 +393,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f64 = int64_to_float64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -388,6 +409,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 float128 b = ops[1].f128;
                 float128 c = ops[2].f128;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f128 = float128_add(a, b, &soft_status);
@@ -410,6 +434,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f128 = int64_to_float128(a.low, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -448,6 +475,7 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(cvt, OP_CVT, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -480,6 +508,7 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(cvt, OP_CVT),
 };
 
 #undef GEN_BENCH_FUNCS
@@ -513,11 +542,14 @@ static void usage_complete(int argc, char *argv[])
 
     fprintf(stderr, "Usage: %s [options]\n", argv[0]);
     fprintf(stderr, "options:\n");
+    fprintf(stderr, " -c = clear exception flags before each operation "
+            "(soft tester only). Default: disabled\n");
     fprintf(stderr, " -d = duration, in seconds. Default: %d\n",
             DEFAULT_DURATION_SECS);
     fprintf(stderr, " -h = show this help message.\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
+    fprintf(stderr, "      cvt converts from a same-sized signed integer.\n");
     fprintf(stderr, " -p = floating point precision (single, double, quad[soft only]). "
             "Default: single\n");
     fprintf(stderr, " -r = rounding mode (even, zero, down, up, tieaway). "
@@ -615,11 +647,14 @@ static void parse_args(int argc, char *argv[])
     int rounding = ROUND_EVEN;
 
     for (;;) {
-        c = getopt(argc, argv, "d:ho:p:r:t:zZ");
+        c = getopt(argc, argv, "cd:ho:p:r:t:zZ");
         if (c < 0) {
             break;
         }
         switch (c) {
+        case 'c':
+            clear_flags = true;
+            break;
         case 'd':
             duration = atoi(optarg);
             break;
@@ -18,8 +18,10 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
 
 static uint64_t inline_mem_count;
 static uint64_t cb_mem_count;
+static uint64_t batch_mem_count;
 static uint64_t io_count;
-static bool do_inline, do_callback;
+static bool do_inline, do_callback, do_batch;
+static struct qemu_plugin_mem_buffer *batch_buf;
 static bool do_haddr;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 
@@ -33,10 +35,26 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     if (do_callback) {
         g_string_append_printf(out, "callback mem accesses: %" PRIu64 "\n", cb_mem_count);
     }
+    if (do_batch) {
+        g_string_append_printf(out, "batch mem accesses: %" PRIu64 "\n",
+                               batch_mem_count);
+    }
     if (do_haddr) {
         g_string_append_printf(out, "io accesses: %" PRIu64 "\n", io_count);
     }
     qemu_plugin_outs(out->str);
+
+    /* The buffers must not lose or duplicate any access */
+    if (do_callback && do_batch && !do_haddr) {
+        g_assert(batch_mem_count == cb_mem_count);
+    }
+}
+
+static void vcpu_mem_batch(unsigned int cpu_index,
+                           const struct qemu_plugin_mem_record *records,
+                           size_t n, void *udata)
+{
+    __atomic_fetch_add(&batch_mem_count, n, __ATOMIC_RELAXED);
 }
 
 static void vcpu_mem(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
@@ -73,6 +91,9 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
                                              QEMU_PLUGIN_CB_NO_REGS,
                                              rw, NULL);
         }
+        if (do_batch) {
+            qemu_plugin_register_vcpu_mem_buffer(insn, rw, batch_buf, NULL);
+        }
     }
 }
 
@@ -111,12 +132,21 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "batch") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &do_batch)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
         }
     }
 
+    if (do_batch) {
+        batch_buf = qemu_plugin_mem_buffer_new(4096, vcpu_mem_batch, NULL);
+    }
+
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
     return 0;
@@ -0,0 +1,101 @@
+/*
+ * Allocate scoreboards while the guest runs.
+ *
+ * A new scoreboard is created every few translations and whenever a vCPU
+ * is initialised, so that with a multi-threaded guest the scoreboards
+ * grow for a new vCPU while other vCPUs allocate more of them.  Each TB
+ * counts its executions both in a long-lived scoreboard and in the most
+ * recent one; the totals must match at exit.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define TRANS_PER_SCOREBOARD 16
+
+static GMutex lock;
+static GPtrArray *scores;
+static uint64_t n_trans;
+static struct qemu_plugin_scoreboard *total_score;
+
+/* Called with lock held */
+static struct qemu_plugin_scoreboard *add_scoreboard(void)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    score = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    g_ptr_array_add(scores, score);
+    return score;
+}
+
+static void vcpu_init(qemu_plugin_id_t id, unsigned int cpu_index)
+{
+    g_mutex_lock(&lock);
+    add_scoreboard();
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    g_mutex_lock(&lock);
+    if (n_trans++ % TRANS_PER_SCOREBOARD == 0) {
+        score = add_scoreboard();
+    } else {
+        score = g_ptr_array_index(scores, scores->len - 1);
+    }
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64,
+        qemu_plugin_scoreboard_u64(total_score), 1);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64,
+        qemu_plugin_scoreboard_u64(score), 1);
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+    uint64_t total = qemu_plugin_u64_sum(
+        qemu_plugin_scoreboard_u64(total_score));
+    uint64_t sum = 0;
+    guint i;
+
+    for (i = 0; i < scores->len; i++) {
+        struct qemu_plugin_scoreboard *score = g_ptr_array_index(scores, i);
+
+        sum += qemu_plugin_u64_sum(qemu_plugin_scoreboard_u64(score));
+        qemu_plugin_scoreboard_free(score);
+    }
+    qemu_plugin_scoreboard_free(total_score);
+
+    g_string_printf(report, "scoreboards: %u, tb execs: %" PRIu64
+                    ", counted: %" PRIu64 "\n", scores->len, total, sum);
+    qemu_plugin_outs(report->str);
+    g_assert(sum == total);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    scores = g_ptr_array_new();
+    total_score = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    g_mutex_lock(&lock);
+    add_scoreboard();
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_register_vcpu_init_cb(id, vcpu_init);
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * QTest testcase for the vCPU dirty page rate limit commands
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+static void assert_error(const char *desc, QDict *rsp)
+{
+    QDict *error;
+
+    g_assert(rsp);
+    error = qdict_get_qdict(rsp, "error");
+    g_assert(error);
+    g_assert_cmpstr(qdict_get_try_str(error, "desc"), ==, desc);
+    qobject_unref(rsp);
+}
+
+static void test_set_vcpu_dirty_limit(void)
+{
+    QTestState *qts = qtest_init("-machine none");
+
+    assert_error("dirty-rate must be between 1 and 1048576",
+                 qtest_qmp(qts, "{ 'execute': 'set-vcpu-dirty-limit',"
+                                "  'arguments': { 'dirty-rate': 0 } }"));
+    /* Used to divide by zero when computing the sleep time */
+    assert_error("dirty-rate must be between 1 and 1048576",
+                 qtest_qmp(qts, "{ 'execute': 'set-vcpu-dirty-limit',"
+                                "  'arguments': { 'dirty-rate': %" PRIu64
+                                " } }", UINT64_C(1) << 44));
+
+    /* Valid arguments, but the qtest accelerator has no dirty ring */
+    assert_error("dirty page rate limit requires KVM with dirty ring",
+                 qtest_qmp(qts, "{ 'execute': 'set-vcpu-dirty-limit',"
+                                "  'arguments': { 'dirty-rate': 200,"
+                                "                 'cpu-index': 0 } }"));
+    assert_error("dirty page rate limit requires KVM with dirty ring",
+                 qtest_qmp(qts, "{ 'execute': 'cancel-vcpu-dirty-limit' }"));
+
+    qtest_quit(qts);
+}
+
+static void test_query_vcpu_dirty_limit(void)
+{
+    QTestState *qts = qtest_init("-machine none");
+    QDict *rsp;
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'query-vcpu-dirty-limit' }");
+    g_assert(rsp);
+    g_assert(!qdict_haskey(rsp, "error"));
+    g_assert(qlist_empty(qdict_get_qlist(rsp, "return")));
+    qobject_unref(rsp);
+
+    qtest_quit(qts);
+}
+
+static void test_migration_dirty_limit(void)
+{
+    QTestState *qts = qtest_init("-machine none");
+
+    assert_error("Parameter 'vcpu_dirty_limit' expects "
+                 "a value between 1 and 1048576",
+                 qtest_qmp(qts, "{ 'execute': 'migrate-set-parameters',"
+                                "  'arguments': { 'vcpu-dirty-limit': 0 } }"));
+    assert_error("Parameter 'vcpu_dirty_limit' expects "
+                 "a value between 1 and 1048576",
+                 qtest_qmp(qts, "{ 'execute': 'migrate-set-parameters',"
+                                "  'arguments': { 'vcpu-dirty-limit': %"
+                                PRIu64 " } }", UINT64_C(1) << 44));
+    qtest_qmp_assert_success(qts, "{ 'execute': 'migrate-set-parameters',"
+                                  "  'arguments': { 'vcpu-dirty-limit': 50 }"
+                                  "}");
+
+    assert_error("dirty-limit requires KVM with dirty ring",
+                 qtest_qmp(qts, "{ 'execute': 'migrate-set-capabilities',"
+                                "  'arguments': { 'capabilities': ["
+                                "    { 'capability': 'dirty-limit',"
+                                "      'state': true } ] } }"));
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/dirtylimit/set", test_set_vcpu_dirty_limit);
+    qtest_add_func("/dirtylimit/query", test_query_vcpu_dirty_limit);
+    qtest_add_func("/dirtylimit/migration", test_migration_dirty_limit);
+
+    return g_test_run();
+}
@@ -492,6 +492,8 @@ typedef struct {
     bool only_target;
     /* Use dirty ring if true; dirty logging otherwise */
     bool use_dirty_ring;
+    /* Enable the postcopy preempt channel, for the postcopy tests */
+    bool postcopy_preempt;
     const char *opts_source;
     const char *opts_target;
 } MigrateStart;
@@ -654,6 +656,7 @@ static void test_migrate_end(QTestState *from, QTestState *to, bool test_dest)
 
     cleanup("bootsect");
     cleanup("migsocket");
+    cleanup("migfile");
     cleanup("src_serial");
     cleanup("dest_serial");
 }
@@ -995,6 +998,11 @@ static int migrate_postcopy_prepare(QTestState **from_ptr,
     migrate_set_capability(to, "postcopy-ram", true);
     migrate_set_capability(to, "postcopy-blocktime", true);
 
+    if (args->postcopy_preempt) {
+        migrate_set_capability(from, "postcopy-preempt", true);
+        migrate_set_capability(to, "postcopy-preempt", true);
+    }
+
     migrate_ensure_non_converge(from);
 
     /* Wait for the first serial output from the source */
@@ -1024,27 +1032,39 @@ static void migrate_postcopy_complete(QTestState *from, QTestState *to)
     test_migrate_end(from, to, true);
 }
 
-static void test_postcopy(void)
+static void test_postcopy_common(MigrateStart *args)
 {
-    MigrateStart args = {};
     QTestState *from, *to;
 
-    if (migrate_postcopy_prepare(&from, &to, &args)) {
+    if (migrate_postcopy_prepare(&from, &to, args)) {
         return;
     }
     migrate_postcopy_start(from, to);
     migrate_postcopy_complete(from, to);
 }
 
-static void test_postcopy_recovery(void)
+static void test_postcopy(void)
+{
+    MigrateStart args = {};
+
+    test_postcopy_common(&args);
+}
+
+static void test_postcopy_preempt(void)
 {
     MigrateStart args = {
-        .hide_stderr = true,
+        .postcopy_preempt = true,
     };
+
+    test_postcopy_common(&args);
+}
+
+static void test_postcopy_recovery_common(MigrateStart *args)
+{
     QTestState *from, *to;
     g_autofree char *uri = NULL;
 
-    if (migrate_postcopy_prepare(&from, &to, &args)) {
+    if (migrate_postcopy_prepare(&from, &to, args)) {
         return;
     }
 
@@ -1098,6 +1118,26 @@ static void test_postcopy_recovery(void)
     migrate_postcopy_complete(from, to);
 }
 
+static void test_postcopy_recovery(void)
+{
+    MigrateStart args = {
+        .hide_stderr = true,
+    };
+
+    test_postcopy_recovery_common(&args);
+}
+
+/* The recovered migration goes on with the main channel alone */
+static void test_postcopy_preempt_recovery(void)
+{
+    MigrateStart args = {
+        .hide_stderr = true,
+        .postcopy_preempt = true,
+    };
+
+    test_postcopy_recovery_common(&args);
+}
+
 static void test_baddest(void)
 {
     MigrateStart args = {
@@ -1573,6 +1613,71 @@ static void test_migrate_fd_finish_hook(QTestState *from,
     qobject_unref(rsp);
 }
 
+/*
+ * Save the source to a file with mapped-ram, then restore the file on
+ * the destination once the source has finished.
+ */
+static void test_file_mapped_ram_common(bool multifd)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/migfile", tmpfs);
+    MigrateStart args = {};
+    QTestState *from, *to;
+    QDict *rsp;
+
+    if (test_migrate_start(&from, &to, "defer", &args)) {
+        return;
+    }
+
+    migrate_set_capability(from, "mapped-ram", true);
+    migrate_set_capability(to, "mapped-ram", true);
+    if (multifd) {
+        migrate_set_parameter_int(from, "multifd-channels", 4);
+        migrate_set_parameter_int(to, "multifd-channels", 4);
+        migrate_set_capability(from, "multifd", true);
+        migrate_set_capability(to, "multifd", true);
+    }
+    migrate_ensure_converge(from);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, uri, "{}");
+    wait_for_migration_complete(from);
+
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+
+    if (multifd) {
+        /* A file has no multifd channels; the restore must not wait */
+        rsp = qtest_qmp(to, "{ 'execute': 'migrate-incoming',"
+                            "  'arguments': { 'uri': %s }}", uri);
+        g_assert_true(qdict_haskey(rsp, "error"));
+        qobject_unref(rsp);
+        migrate_set_capability(to, "multifd", false);
+    }
+
+    rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
+                           "  'arguments': { 'uri': %s }}", uri);
+    qobject_unref(rsp);
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+
+    test_migrate_end(from, to, true);
+}
+
+static void test_file_mapped_ram(void)
+{
+    test_file_mapped_ram_common(false);
+}
+
+static void test_file_mapped_ram_multifd(void)
+{
+    test_file_mapped_ram_common(true);
+}
+
 static void test_migrate_fd_proto(void)
 {
     MigrateCommon args = {
@@ -1778,6 +1883,16 @@ test_migrate_precopy_tcp_multifd_zlib_start(QTestState *from,
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "zlib");
 }
 
+static void *
+test_migrate_precopy_tcp_multifd_zero_page_start(QTestState *from,
+                                                 QTestState *to)
+{
+    migrate_set_capability(from, "multifd-zero-page", true);
+    migrate_set_capability(to, "multifd-zero-page", true);
+
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
+}
+
 #ifdef CONFIG_ZSTD
 static void *
 test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
@@ -1796,6 +1911,33 @@ static void test_multifd_tcp_none(void)
     test_precopy_common(&args);
 }
 
+/*
+ * The channels find the zero pages; they must end up as duplicate pages
+ * and must not be charged as full pages to the bytes transferred.
+ */
+static void test_multifd_zero_page_finish(QTestState *from,
+                                          QTestState *to,
+                                          void *opaque)
+{
+    int64_t page_size = read_ram_property_int(from, "page-size");
+    int64_t normal = read_ram_property_int(from, "normal");
+    int64_t duplicate = read_ram_property_int(from, "duplicate");
+
+    g_assert_cmpint(duplicate, >, 0);
+    g_assert_cmpint(read_ram_property_int(from, "multifd-bytes"), <,
+                    (normal + duplicate) * page_size);
+}
+
+static void test_multifd_tcp_zero_page(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_zero_page_start,
+        .finish_hook = test_multifd_zero_page_finish,
+    };
+    test_precopy_common(&args);
+}
+
 static void test_multifd_tcp_zlib(void)
 {
     MigrateCommon args = {
@@ -2124,6 +2266,9 @@ int main(int argc, char **argv)
 
     qtest_add_func("/migration/postcopy/unix", test_postcopy);
     qtest_add_func("/migration/postcopy/recovery", test_postcopy_recovery);
+    qtest_add_func("/migration/postcopy/preempt/unix", test_postcopy_preempt);
+    qtest_add_func("/migration/postcopy/preempt/recovery",
+                   test_postcopy_preempt_recovery);
     qtest_add_func("/migration/bad_dest", test_baddest);
     qtest_add_func("/migration/precopy/unix/plain", test_precopy_unix_plain);
     qtest_add_func("/migration/precopy/unix/xbzrle", test_precopy_unix_xbzrle);
@@ -2164,6 +2309,9 @@ int main(int argc, char **argv)
 
     /* qtest_add_func("/migration/ignore_shared", test_ignore_shared); */
     qtest_add_func("/migration/fd_proto", test_migrate_fd_proto);
+    qtest_add_func("/migration/file/mapped-ram", test_file_mapped_ram);
+    qtest_add_func("/migration/file/mapped-ram/multifd",
+                   test_file_mapped_ram_multifd);
     qtest_add_func("/migration/validate_uuid", test_validate_uuid);
     qtest_add_func("/migration/validate_uuid_error", test_validate_uuid_error);
     qtest_add_func("/migration/validate_uuid_src_not_set",
@@ -2176,6 +2324,8 @@ int main(int argc, char **argv)
                    test_multifd_tcp_none);
     qtest_add_func("/migration/multifd/tcp/plain/cancel",
                    test_multifd_tcp_cancel);
+    qtest_add_func("/migration/multifd/tcp/plain/zero-page",
+                   test_multifd_tcp_zero_page);
     qtest_add_func("/migration/multifd/tcp/plain/zlib",
                    test_multifd_tcp_zlib);
 #ifdef CONFIG_ZSTD
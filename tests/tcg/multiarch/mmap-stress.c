@@ -0,0 +1,114 @@
+/*
+ * Stress test and benchmark for guests that make many small mappings,
+ * like JITs and garbage collectors do.
+ *
+ * Each round maps many small anonymous regions, changes the protection
+ * of every other one, unmaps and maps again every third one and checks
+ * that no mapping was clobbered by another.  The time taken by each
+ * round is printed, which is how the cost of mmap, mprotect and munmap
+ * under emulation can be compared.
+ *
+ * Usage: mmap-stress [mappings [rounds]]
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+struct mapping {
+    unsigned char *addr;
+    size_t len;
+};
+
+static size_t pagesize;
+
+static void fail(const char *what, size_t i)
+{
+    fprintf(stderr, "FAILED: %s, mapping %zu\n", what, i);
+    exit(EXIT_FAILURE);
+}
+
+static void map_one(struct mapping *m, size_t i, unsigned int seed)
+{
+    m->len = pagesize * (1 + seed % 4);
+    m->addr = mmap(NULL, m->len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m->addr == MAP_FAILED) {
+        fail("mmap", i);
+    }
+    m->addr[0] = i;
+    m->addr[m->len - 1] = ~i;
+}
+
+static void check_one(struct mapping *m, size_t i)
+{
+    if (m->addr[0] != (unsigned char)i ||
+        m->addr[m->len - 1] != (unsigned char)~i) {
+        fail("contents", i);
+    }
+}
+
+static void run_round(struct mapping *maps, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        map_one(&maps[i], i, i * 7 + 3);
+    }
+    for (i = 0; i < n; i += 2) {
+        if (mprotect(maps[i].addr, maps[i].len, PROT_READ)) {
+            fail("mprotect", i);
+        }
+    }
+    for (i = 0; i < n; i += 3) {
+        if (munmap(maps[i].addr, maps[i].len)) {
+            fail("munmap", i);
+        }
+        map_one(&maps[i], i, i * 5 + 1);
+    }
+    for (i = 0; i < n; i += 2) {
+        if (mprotect(maps[i].addr, maps[i].len, PROT_READ | PROT_WRITE)) {
+            fail("mprotect", i);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        check_one(&maps[i], i);
+        if (munmap(maps[i].addr, maps[i].len)) {
+            fail("munmap", i);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024;
+    unsigned int rounds = argc > 2 ? strtoul(argv[2], NULL, 0) : 4;
+    struct mapping *maps;
+    unsigned int r;
+
+    pagesize = sysconf(_SC_PAGESIZE);
+    maps = calloc(n, sizeof(*maps));
+    if (!maps) {
+        return EXIT_FAILURE;
+    }
+
+    for (r = 0; r < rounds; r++) {
+        struct timespec start, end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run_round(maps, n);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("round %u: %zu mappings in %.3f ms\n", r, n,
+               (end.tv_sec - start.tv_sec) * 1e3 +
+               (end.tv_nsec - start.tv_nsec) / 1e6);
+    }
+
+    free(maps);
+    return EXIT_SUCCESS;
+}
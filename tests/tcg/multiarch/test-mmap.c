@@ -28,6 +28,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 
 #define D(x)
@@ -454,6 +455,90 @@ void check_invalid_mmaps(void)
     fprintf(stdout, " passed\n");
 }
 
+/*
+ * Splitting a mapping with mprotect or munmap and restoring it must
+ * leave the page flags of every page right.  Reading into the buffer
+ * only copies all of it if each page is writable.
+ */
+void check_mprotect_munmap_split_merge(void)
+{
+    size_t len = pagesize * 8;
+    unsigned char *p1;
+    void *p2;
+    int fd;
+
+    fprintf(stdout, "%s", __func__);
+
+    fd = open("/dev/zero", O_RDONLY);
+    fail_unless(fd >= 0);
+    p1 = mmap(NULL, len, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    fail_unless(p1 != MAP_FAILED);
+    fail_unless(read(fd, p1, len) == len);
+
+    /* Make pages 2 to 4 read-only, then writable again.  */
+    fail_unless(mprotect(p1 + pagesize * 2, pagesize * 3, PROT_READ) == 0);
+    fail_unless(read(fd, p1, len) != len);
+    fail_unless(read(fd, p1, pagesize * 2) == pagesize * 2);
+    fail_unless(read(fd, p1 + pagesize * 5, pagesize * 3) == pagesize * 3);
+    fail_unless(mprotect(p1 + pagesize * 2, pagesize * 3,
+                         PROT_READ | PROT_WRITE) == 0);
+    fail_unless(read(fd, p1, len) == len);
+
+    /* Punch a hole at page 3, then fill it again.  */
+    fail_unless(munmap(p1 + pagesize * 3, pagesize) == 0);
+    fail_unless(read(fd, p1, len) != len);
+    p2 = mmap(p1 + pagesize * 3, pagesize, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    fail_unless(p2 == p1 + pagesize * 3);
+    fail_unless(read(fd, p1, len) == len);
+
+    munmap(p1, len);
+    close(fd);
+    fprintf(stdout, " passed\n");
+}
+
+/*
+ * Mappings placed by the kernel, with or without a hint, must only
+ * use free address space: replacing a mapped page would zero it.
+ */
+void check_unfixed_mmaps_avoid_mapped_pages(void)
+{
+    unsigned char *p1;
+    unsigned char *p2;
+    unsigned char *p3;
+    size_t hole = pagesize * 3;
+
+    fprintf(stdout, "%s", __func__);
+
+    /* Leave a hole between two mapped pages.  */
+    p1 = mmap(NULL, hole + pagesize * 2, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    fail_unless(p1 != MAP_FAILED);
+    fail_unless(munmap(p1 + pagesize, hole) == 0);
+    p1[0] = 0x55;
+    p1[pagesize + hole] = 0xaa;
+
+    /* Hint at the hole, and at the mapped pages around it.  */
+    p2 = mmap(p1 + pagesize, hole, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    fail_unless(p2 != MAP_FAILED);
+    p3 = mmap(p1, hole + pagesize * 2, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    fail_unless(p3 != MAP_FAILED);
+    fail_unless(p3 != p1);
+    memset(p2, 0, hole);
+    memset(p3, 0, hole + pagesize * 2);
+    fail_unless(p1[0] == 0x55);
+    fail_unless(p1[pagesize + hole] == 0xaa);
+
+    munmap(p1, pagesize);
+    munmap(p1 + pagesize + hole, pagesize);
+    munmap(p2, hole);
+    munmap(p3, hole + pagesize * 2);
+    fprintf(stdout, " passed\n");
+}
+
 int main(int argc, char **argv)
 {
 	char tempname[] = "/tmp/.cmmapXXXXXX";
@@ -496,6 +581,8 @@ int main(int argc, char **argv)
 	check_file_fixed_eof_mmaps();
 	check_file_unfixed_eof_mmaps();
 	check_invalid_mmaps();
+	check_mprotect_munmap_split_merge();
+	check_unfixed_mmaps_avoid_mapped_pages();
 
 	/* Fails at the moment.  */
 	/* check_aligned_anonymous_fixed_mmaps_collide_with_host(); */
@@ -0,0 +1,177 @@
+/*
+ * Test interval trees
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/interval-tree.h"
+
+#define N_NODES 1000
+#define MAX_VALUE 5000
+
+static IntervalTreeNode nodes[N_NODES];
+static bool in_tree[N_NODES];
+static IntervalTreeRoot root;
+
+/* Check the red-black and subtree_last invariants, return the black height. */
+static int check_subtree(IntervalTreeNode *node, IntervalTreeNode *parent,
+                         size_t *count)
+{
+    uint64_t subtree_last;
+    int lh, rh;
+
+    if (!node) {
+        return 1;
+    }
+    g_assert(node->parent == parent);
+    if (node->red) {
+        g_assert(!node->left || !node->left->red);
+        g_assert(!node->right || !node->right->red);
+    }
+    if (node->left) {
+        g_assert_cmpuint(node->left->start, <=, node->start);
+    }
+    if (node->right) {
+        g_assert_cmpuint(node->right->start, >=, node->start);
+    }
+
+    lh = check_subtree(node->left, node, count);
+    rh = check_subtree(node->right, node, count);
+    g_assert_cmpint(lh, ==, rh);
+
+    subtree_last = node->last;
+    if (node->left) {
+        subtree_last = MAX(subtree_last, node->left->subtree_last);
+    }
+    if (node->right) {
+        subtree_last = MAX(subtree_last, node->right->subtree_last);
+    }
+    g_assert_cmpuint(node->subtree_last, ==, subtree_last);
+
+    (*count)++;
+    return lh + !node->red;
+}
+
+static void check_tree(void)
+{
+    size_t count = 0, expected = 0;
+    int i;
+
+    g_assert(!root.root || !root.root->red);
+    check_subtree(root.root, NULL, &count);
+    for (i = 0; i < N_NODES; i++) {
+        expected += in_tree[i];
+    }
+    g_assert_cmpuint(count, ==, expected);
+}
+
+/* Compare an iteration over [start, last] with a linear scan. */
+static void check_query(uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *n;
+    uint64_t prev_start = 0;
+    size_t found = 0, expected = 0;
+    int i;
+
+    for (n = interval_tree_iter_first(&root, start, last); n;
+         n = interval_tree_iter_next(n, start, last)) {
+        g_assert(n->start <= last && n->last >= start);
+        g_assert_cmpuint(n->start, >=, prev_start);
+        prev_start = n->start;
+        found++;
+    }
+    for (i = 0; i < N_NODES; i++) {
+        if (in_tree[i] && nodes[i].start <= last && nodes[i].last >= start) {
+            expected++;
+        }
+    }
+    g_assert_cmpuint(found, ==, expected);
+}
+
+static void test_empty(void)
+{
+    root.root = NULL;
+    g_assert_null(interval_tree_iter_first(&root, 0, UINT64_MAX));
+}
+
+static void test_random(void)
+{
+    int i, step;
+
+    root.root = NULL;
+    memset(in_tree, 0, sizeof(in_tree));
+
+    for (step = 0; step < 20 * N_NODES; step++) {
+        i = g_test_rand_int_range(0, N_NODES);
+        if (in_tree[i]) {
+            interval_tree_remove(&nodes[i], &root);
+            in_tree[i] = false;
+        } else {
+            nodes[i].start = g_test_rand_int_range(0, MAX_VALUE);
+            nodes[i].last = nodes[i].start + g_test_rand_int_range(0, 100);
+            interval_tree_insert(&nodes[i], &root);
+            in_tree[i] = true;
+        }
+        if (step % 64 == 0) {
+            uint64_t start = g_test_rand_int_range(0, MAX_VALUE);
+
+            check_tree();
+            check_query(start, start);
+            check_query(start, start + g_test_rand_int_range(0, 500));
+        }
+    }
+    check_tree();
+    check_query(0, UINT64_MAX);
+
+    for (i = 0; i < N_NODES; i++) {
+        if (in_tree[i]) {
+            interval_tree_remove(&nodes[i], &root);
+            in_tree[i] = false;
+        }
+    }
+    g_assert_null(root.root);
+}
+
+/* Disjoint ranges, as used for the user-mode page flags. */
+static void test_disjoint(void)
+{
+    IntervalTreeNode *n;
+    int i;
+
+    root.root = NULL;
+    for (i = 0; i < N_NODES; i++) {
+        nodes[i].start = i * 16;
+        nodes[i].last = i * 16 + 7;
+        interval_tree_insert(&nodes[i], &root);
+    }
+
+    for (i = 0; i < N_NODES; i++) {
+        n = interval_tree_iter_first(&root, i * 16 + 3, i * 16 + 3);
+        g_assert(n == &nodes[i]);
+        g_assert_null(interval_tree_iter_first(&root, i * 16 + 8,
+                                               i * 16 + 15));
+        n = interval_tree_iter_first(&root, i * 16 + 8, i * 16 + 16);
+        g_assert(n == (i + 1 < N_NODES ? &nodes[i + 1] : NULL));
+    }
+
+    for (i = 0; i < N_NODES; i += 2) {
+        interval_tree_remove(&nodes[i], &root);
+    }
+    n = interval_tree_iter_first(&root, 0, UINT64_MAX);
+    for (i = 1; i < N_NODES; i += 2) {
+        g_assert(n == &nodes[i]);
+        n = interval_tree_iter_next(n, 0, UINT64_MAX);
+    }
+    g_assert_null(n);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/interval-tree/empty", test_empty);
+    g_test_add_func("/interval-tree/random", test_random);
+    g_test_add_func("/interval-tree/disjoint", test_disjoint);
+    return g_test_run();
+}
@@ -0,0 +1,377 @@
+/*
+ * Interval trees (augmented red-black trees)
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/interval-tree.h"
+
+/*
+ * The red-black tree algorithms are the classic ones from Cormen et al.,
+ * "Introduction to Algorithms", with NULL for the leaves.
+ *
+ * To allow lockless lookups, child pointers are only written with
+ * qatomic_set and, when nodes are moved around, a node is always
+ * unlinked from its old position before being linked into the new one.
+ * A concurrent lookup can therefore never follow a cycle, though it may
+ * temporarily fail to reach part of the tree.  Parent pointers, colors
+ * and subtree_last are not used by lockless lookups for anything else
+ * than pruning, so they need no particular care.
+ */
+
+static uint64_t compute_subtree_last(IntervalTreeNode *node)
+{
+    uint64_t max = node->last;
+
+    if (node->left && node->left->subtree_last > max) {
+        max = node->left->subtree_last;
+    }
+    if (node->right && node->right->subtree_last > max) {
+        max = node->right->subtree_last;
+    }
+    return max;
+}
+
+/* Recompute subtree_last from @node up to the root. */
+static void propagate(IntervalTreeNode *node)
+{
+    for (; node; node = node->parent) {
+        node->subtree_last = compute_subtree_last(node);
+    }
+}
+
+static void change_child(IntervalTreeNode *old, IntervalTreeNode *new,
+                         IntervalTreeNode *parent, IntervalTreeRoot *root)
+{
+    if (!parent) {
+        qatomic_set(&root->root, new);
+    } else if (parent->left == old) {
+        qatomic_set(&parent->left, new);
+    } else {
+        qatomic_set(&parent->right, new);
+    }
+}
+
+/*
+ *     X              Y
+ *    / \            / \
+ *   a   Y    =>    X   c
+ *      / \        / \
+ *     b   c      a   b
+ */
+static void rotate_left(IntervalTreeNode *x, IntervalTreeRoot *root)
+{
+    IntervalTreeNode *y = x->right;
+    IntervalTreeNode *parent = x->parent;
+    IntervalTreeNode *b = y->left;
+
+    qatomic_set(&x->right, b);
+    if (b) {
+        b->parent = x;
+    }
+    qatomic_set(&y->left, x);
+    x->parent = y;
+    y->parent = parent;
+    change_child(x, y, parent, root);
+
+    y->subtree_last = x->subtree_last;
+    x->subtree_last = compute_subtree_last(x);
+}
+
+/* Mirror image of rotate_left. */
+static void rotate_right(IntervalTreeNode *x, IntervalTreeRoot *root)
+{
+    IntervalTreeNode *y = x->left;
+    IntervalTreeNode *parent = x->parent;
+    IntervalTreeNode *b = y->right;
+
+    qatomic_set(&x->left, b);
+    if (b) {
+        b->parent = x;
+    }
+    qatomic_set(&y->right, x);
+    x->parent = y;
+    y->parent = parent;
+    change_child(x, y, parent, root);
+
+    y->subtree_last = x->subtree_last;
+    x->subtree_last = compute_subtree_last(x);
+}
+
+static bool is_red(IntervalTreeNode *node)
+{
+    return node && node->red;
+}
+
+static void insert_fixup(IntervalTreeNode *node, IntervalTreeRoot *root)
+{
+    IntervalTreeNode *parent, *gparent, *uncle;
+
+    while ((parent = node->parent) && parent->red) {
+        /* The root is black, so a red parent has a parent too. */
+        gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+            if (is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rotate_left(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rotate_right(gparent, root);
+        } else {
+            uncle = gparent->left;
+            if (is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rotate_right(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rotate_left(gparent, root);
+        }
+    }
+    root->root->red = false;
+}
+
+void interval_tree_insert(IntervalTreeNode *node, IntervalTreeRoot *root)
+{
+    IntervalTreeNode **link = &root->root;
+    IntervalTreeNode *parent = NULL;
+    uint64_t start = node->start;
+    uint64_t last = node->last;
+
+    while (*link) {
+        parent = *link;
+        if (parent->subtree_last < last) {
+            parent->subtree_last = last;
+        }
+        link = start < parent->start ? &parent->left : &parent->right;
+    }
+
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->red = true;
+    node->subtree_last = last;
+
+    /* Make the node contents visible before the node itself. */
+    qatomic_rcu_set(link, node);
+
+    insert_fixup(node, root);
+}
+
+/*
+ * Restore the red-black properties after removing a black node.
+ * @node, which may be NULL, is the child of @parent that replaced it.
+ */
+static void remove_fixup(IntervalTreeNode *node, IntervalTreeNode *parent,
+                         IntervalTreeRoot *root)
+{
+    IntervalTreeNode *sibling;
+
+    while (node != root->root && !is_red(node)) {
+        /*
+         * The removed node was black, so the subtree of the sibling
+         * has a black height of at least one and is not empty.
+         */
+        if (node == parent->left) {
+            sibling = parent->right;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_left(parent, root);
+                sibling = parent->right;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rotate_right(sibling, root);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rotate_left(parent, root);
+        } else {
+            sibling = parent->left;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_right(parent, root);
+                sibling = parent->left;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rotate_left(sibling, root);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rotate_right(parent, root);
+        }
+        node = root->root;
+        break;
+    }
+    if (node) {
+        node->red = false;
+    }
+}
+
+void interval_tree_remove(IntervalTreeNode *node, IntervalTreeRoot *root)
+{
+    IntervalTreeNode *child, *parent, *succ;
+    bool removed_red;
+
+    if (!node->left || !node->right) {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        removed_red = node->red;
+
+        if (child) {
+            child->parent = parent;
+        }
+        change_child(node, child, parent, root);
+    } else {
+        /* Replace the node with its successor, the leftmost on the right. */
+        succ = node->right;
+        while (succ->left) {
+            succ = succ->left;
+        }
+        child = succ->right;
+        removed_red = succ->red;
+
+        if (succ->parent == node) {
+            parent = succ;
+        } else {
+            parent = succ->parent;
+            qatomic_set(&parent->left, child);
+            if (child) {
+                child->parent = parent;
+            }
+            qatomic_set(&succ->right, node->right);
+            node->right->parent = succ;
+        }
+        qatomic_set(&succ->left, node->left);
+        node->left->parent = succ;
+        succ->parent = node->parent;
+        succ->red = node->red;
+        change_child(node, succ, node->parent, root);
+    }
+
+    propagate(parent);
+    if (!removed_red) {
+        remove_fixup(child, parent, root);
+    }
+}
+
+/*
+ * Return the leftmost node in the subtree of @node that overlaps
+ * [@start, @last].  The caller has checked that @node->subtree_last
+ * is at least @start.
+ */
+static IntervalTreeNode *subtree_search(IntervalTreeNode *node,
+                                        uint64_t start, uint64_t last)
+{
+    while (true) {
+        IntervalTreeNode *left = qatomic_read(&node->left);
+
+        if (left && left->subtree_last >= start) {
+            /*
+             * Some node on the left ends at or after start.  If the
+             * leftmost of them starts after last, so do all the nodes
+             * to its right and there is no match at all.
+             */
+            node = left;
+            continue;
+        }
+        if (node->start <= last) {
+            IntervalTreeNode *right;
+
+            if (node->last >= start) {
+                return node;
+            }
+            right = qatomic_read(&node->right);
+            if (right && right->subtree_last >= start) {
+                node = right;
+                continue;
+            }
+        }
+        return NULL;
+    }
+}
+
+IntervalTreeNode *interval_tree_iter_first(IntervalTreeRoot *root,
+                                           uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *node = qatomic_rcu_read(&root->root);
+
+    if (!node || node->subtree_last < start) {
+        return NULL;
+    }
+    return subtree_search(node, start, last);
+}
+
+IntervalTreeNode *interval_tree_iter_next(IntervalTreeNode *node,
+                                          uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *right = node->right;
+    IntervalTreeNode *prev;
+
+    while (true) {
+        /* Invariant: node->start <= last and right == node->right. */
+        if (right && right->subtree_last >= start) {
+            return subtree_search(right, start, last);
+        }
+
+        /* Move up until we come from the left child of a node. */
+        do {
+            prev = node;
+            node = node->parent;
+            if (!node) {
+                return NULL;
+            }
+            right = node->right;
+        } while (prev == right);
+
+        if (node->start > last) {
+            return NULL;
+        }
+        if (node->last >= start) {
+            return node;
+        }
+    }
+}